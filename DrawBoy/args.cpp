@@ -10,72 +10,31 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/ioctl.h>
-#include <termios.h>
 #include <sstream>
 #include <algorithm>
 #include <cstdlib>
-#include "ipc.h"
+#include "loomtransport.h"
+#include "loomlog.h"
+#include "replay.h"
+#include "dryrun.h"
+#include "script.h"
+#include "journal.h"
+#include "startup.h"
+#include "trace.h"
+#include "perfcounters.h"
+#include "picklist.h"
 #include <set>
 #include <memory>
 #include <charconv>
 #include "wif.h"
 #include "dtx.h"
 #include <sys/types.h>
-#include <sys/socket.h>
-#include <netdb.h>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <optional>
 
 namespace {
-struct addr_deleter {
-    void operator()(addrinfo* ap) { ::freeaddrinfo(ap); }
-};
-
-using unique_ai = std::unique_ptr<addrinfo, addr_deleter>;
-
-int
-openTelnet(std::string& address)
-{
-    addrinfo hint{AI_ADDRCONFIG, PF_INET, SOCK_STREAM, IPPROTO_TCP};
-    addrinfo* results;
-
-    if (::getaddrinfo(address.c_str(), "telnet", &hint, &results) < 0)
-        return -2;
-
-    auto aiList = unique_ai(results);
-
-    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
-        int sockFD = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-        if (sockFD < 0)
-            continue;
-
-        if (::connect(sockFD, ai->ai_addr, ai->ai_addrlen) < 0) {
-            ::close(sockFD);
-            continue;
-        }
-
-        return sockFD;
-    }
-    return -1;
-}
-
-int
-checkForSerial(std::string& name)
-{
-    int fd = ::open(name.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
-    int modemBits = 0;
-    if (fd == -1)
-        return -1;
-    if (!::isatty(fd) || ::ioctl(fd, TIOCMGET, &modemBits) == -1)
-    {
-        ::close(fd);
-        return -2;
-    }
-    return fd;
-}
-
 struct dir_deleter {
     void operator()(DIR* dp) { ::closedir(dp); }
 };
@@ -97,9 +56,7 @@ enumSerial(const std::set<std::string>& exclude)
                 if (exclude.contains(dname))
                     continue;
                 std::putchar('.');
-                int fd = checkForSerial(dname);
-                if (fd >= 0) {
-                    ::close(fd);
+                if (SerialTransport::probe(dname)) {
                     std::cout << '\n' << dname << std::endl;
                     result.emplace(std::move(dname));
                 }
@@ -108,212 +65,18 @@ enumSerial(const std::set<std::string>& exclude)
     }
     return result;
 }
-
-
-void
-initLoomPort(int fd, int cdgen)
-{
-    struct termios term;
-
-    if (::tcgetattr(fd, &term) < 0)
-        throw make_system_error("Cannot communicate with loom device");
-    
-    ::cfmakeraw(&term);
-    
-    if (cdgen == 1) {
-        ::cfsetispeed(&term, B1200);            // set 1200 baud
-        ::cfsetospeed(&term, B1200);
-        term.c_cflag |= PARENB;                 // set 7E2
-        term.c_cflag &= (tcflag_t)(~PARODD);
-        term.c_cflag |= CSTOPB;
-        term.c_cflag = (term.c_cflag & (tcflag_t)(~CSIZE)) | CS7;
-    } else {
-        ::cfsetispeed(&term, B9600);            // set 9600 baud
-        ::cfsetospeed(&term, B9600);
-        term.c_cflag &= (tcflag_t)(~PARENB);    // set 8N1
-        term.c_cflag &= (tcflag_t)(~CSTOPB);
-        term.c_cflag = (term.c_cflag & (tcflag_t)(~CSIZE)) | CS8;
-    }
-    term.c_cflag |= CLOCAL;
-    term.c_cc[VMIN] = 0;
-    term.c_cc[VTIME] = 1;
-
-    if (::tcsetattr(fd, TCSAFLUSH, &term) < 0)
-        throw make_system_error("Cannot communicate with loom device");
 }
 
 void
-addpick(int _pick, std::vector<int>& newpicks, bool isTabby, bool patternBeforeTabby)
-{
-    if (isTabby) {
-        if (patternBeforeTabby) {
-            newpicks.push_back(_pick);
-            newpicks.push_back(-3);
-        } else {
-            newpicks.push_back(-3);
-            newpicks.push_back(_pick);
-        }
-    } else {
-        newpicks.push_back(_pick);
-    }
-}
-
-int my_stoi(std::string_view str, size_t* pos = nullptr)
-{
-    int v = 0;
-    auto r = std::from_chars(str.begin(), str.end(), v);
-    if (pos)
-        *pos = (size_t)(r.ptr - str.begin());
-    if (r.ec == std::errc::invalid_argument)
-        throw std::invalid_argument(std::string(str));
-    if (r.ec == std::errc::result_out_of_range)
-        throw std::out_of_range(std::string(str));
-    return v;
-}
-
-size_t
-findMatch(std::string_view str)
+Options::parsePicks(const std::string &str, int maxPick)
 {
-    int level = 0;
-    for (size_t i = 0; i < str.length(); ++i) {
-        if (str[i] == '(') ++level;
-        if (str[i] == ')') --level;
-        if (level == 0)
-            return i;
-        if (level < 0)
-            return 0;
-    }
-    return 0;
+    picks = parsePickList(str, maxPick);
 }
 
 std::vector<int>
-ParsePicks(std::string_view str, int maxPick, bool patternBeforeTabby, bool threading)
+Options::parsePickList(const std::string &str, int maxPick) const
 {
-    std::vector<int> newpicks;
-    
-    while (!str.empty()) {
-        try {
-            int mult = 1;
-            std::vector<int> pickRange;
-            size_t multToken = str.find("x");
-            if (multToken != std::string::npos && std::isdigit(str.front())) {
-                size_t check;
-                mult = my_stoi(str, &check);
-                if (check == multToken) {   // multiplier was for this term
-                    if (mult < 1)
-                        throw std::runtime_error("Syntax error in treadling multiplier.");
-                    str.remove_prefix(multToken + 1);
-                    if (str.empty() || str.front() == ',')
-                        throw std::runtime_error("Syntax error in treadling multiplier.");
-                } else {                    // multiplier was for another term
-                    mult = 1;
-                }
-            }
-            if (std::strchr("ABab", str.front())) {
-                if (threading)
-                    throw std::runtime_error("Tabby entries make no sense in treadle-the-threading mode.");
-                while (!str.empty() && std::strchr("ABab", str.front())) {
-                    switch (str.front()) {
-                        case 'a':
-                        case 'A':
-                            addpick(-1, pickRange, false, false);
-                            break;
-                        case 'b':
-                        case 'B':
-                            addpick(-2, pickRange, false, false);
-                            break;
-                        default:
-                            break;
-                    }
-                    str.remove_prefix(1);
-                }
-            } else if (str.front() == '(') {
-                if (size_t match = findMatch(str)) {
-                    pickRange = ParsePicks(str.substr(1, match - 1), maxPick, patternBeforeTabby, threading);
-                    str.remove_prefix(match + 1);
-                } else {
-                    throw std::runtime_error("Unbalanced parentheses in pick list.");
-                }
-            } else {
-                size_t rangeToken = std::string::npos;
-                bool tabbyRange = str.front() == '~';     // single pick w/tabby
-                if (tabbyRange)
-                    str.remove_prefix(1);
-                if (tabbyRange && threading)
-                    throw std::runtime_error("Tabby entries make no sense in treadle-the-threading mode.");
-                int start = my_stoi(str, &rangeToken);
-                int end = start;
-                if (rangeToken < str.length() && (str[rangeToken] == '~' || str[rangeToken] == '-')) {
-                    if (tabbyRange)
-                        throw std::runtime_error("Spurious ~ in treadling range.");
-                    tabbyRange = str[rangeToken] == '~';  // pick range w/tabby
-                    if (tabbyRange && threading)
-                        throw std::runtime_error("Tabby entries make no sense in treadle-the-threading mode.");
-                    str.remove_prefix(rangeToken + 1);
-                    end = my_stoi(str, &rangeToken);
-                    str.remove_prefix(rangeToken);
-                } else {
-                    str.remove_prefix(rangeToken);
-                }
-                if (start < 1 || end < 1)
-                    throw std::runtime_error("Bad treadling range.");
-                if (start > maxPick || end > maxPick)
-                    throw std::runtime_error("Pick list includes picks that are not in the wif file.");
-                if (start <= end) {
-                    for (int p = start; p <= end; ++p)
-                        addpick(p, pickRange, tabbyRange, patternBeforeTabby);
-                } else {
-                    for (int p = end; p >= start; --p)
-                        addpick(p, pickRange, tabbyRange, patternBeforeTabby);
-                }
-            }
-            if (!str.empty() && str.front() != ',')
-                throw std::runtime_error("Unparsed text in treadling range.");
-            if (!str.empty())
-                str.remove_prefix(1);
-            for (auto i = 0; i < mult; ++i)
-                newpicks.insert(newpicks.end(), pickRange.begin(), pickRange.end());
-        } catch (std::runtime_error& rte) {
-            throw;
-        } catch (...) {
-            throw std::runtime_error("Syntax error in treadling range.");
-        }
-    }
-    return newpicks;
-}
-
-}
-
-void
-Options::parsePicks(const std::string &str, int maxPick)
-{
-    // If no treadle list provided then treadle the whole liftplan
-    if (str.empty()) {
-        picks.resize((size_t)maxPick);
-        for (int i = 0; i < maxPick; ++i)
-            picks[(size_t)i] = i + 1;
-        return;
-    }
-    
-    bool patternBeforeTabby = tabbyPattern == TabbyPattern::xAyB || tabbyPattern == TabbyPattern::xByA;
-    bool tabbyAFirst = tabbyPattern == TabbyPattern::xAyB || tabbyPattern == TabbyPattern::AxBy;
-    
-    picks = ParsePicks(str, maxPick, patternBeforeTabby, treadleThreading);
-
-    // Replace auto-tabby picks with actual tabby A or tabby B
-    bool tabbyIsA = tabbyAFirst;
-    int picksSinceTabby = 10;       // anything > 1
-    for (auto& _pick: picks) {
-        if (_pick == -3) {
-            if (picksSinceTabby > 1)
-                tabbyIsA = tabbyAFirst;
-            _pick = tabbyIsA ? TabbyA : TabbyB;
-            tabbyIsA = !tabbyIsA;
-            picksSinceTabby = 0;
-        } else {
-            ++picksSinceTabby;
-        }
-    }
+    return ::parsePickList(str, maxPick, tabbyPattern, treadleThreading);
 }
 
 Options::Options(int argc, const char * argv[])
@@ -331,6 +94,8 @@ Options::Options(int argc, const char * argv[])
 
     pickFile = getenv("HOME");
     pickFile.append("/.drawboypick");
+    journalFile = getenv("HOME");
+    journalFile.append("/.drawboyjournal");
 
     ToLowerReader tlr;
     
@@ -371,7 +136,7 @@ Options::Options(int argc, const char * argv[])
         "The path of the loom device in the /dev directory", {"loomDevice"},
         envLoom, args::Options::Single);
     args::ValueFlag<std::string> _loomAddress(parser, "LOOM_ADDRESS",
-        "The network address or IP address of the loom", {"loomAddress"},
+        "The network address or IP address of the loom, with an optional :port", {"loomAddress"},
         envAddress, args::Options::Single);
     args::MapFlag<std::string, int> _maxShafts(parser, "SHAFT_COUNT",
         "Number of shafts on the loom", {"shafts"}, shaftMap, defShaft,
@@ -383,22 +148,71 @@ Options::Options(int argc, const char * argv[])
         {"colorAlert"}, alertMap, ColorAlert::None);
     args::Flag _ascii(parser, "ASCII only", "Restricts output to ASCII", {"ascii"}, args::Options::Single);
     args::Flag _log(parser, "Enable logging", "Logs loom I/O to /tmp", {"log"}, args::Options::Hidden);
+    args::ValueFlag<int> _vtime(parser, "DECISECONDS", "VTIME setting for the serial port", {"vtime"}, 1,
+        args::Options::Hidden);
+    args::Flag _realtime(parser, "real-time mode",
+        "Locks memory and requests real-time scheduling for loom I/O", {"realtime"}, args::Options::Single);
+    args::ValueFlag<int> _realtimeCPU(parser, "CPU", "Pins loom I/O to a CPU in real-time mode",
+        {"realtimeCPU"}, -1, args::Options::Single);
+    args::ValueFlag<int> _redrawInterval(parser, "MS", "Minimum time between screen redraws, in milliseconds",
+        {"redrawInterval"}, 0, args::Options::Single);
+    args::Flag _stats(parser, "statistics", "Reports pick timing statistics at exit", {"stats"},
+        args::Options::Single);
+    args::ValueFlag<int> _latencyBudget(parser, "MS", "Warns when a pick takes longer than this, in milliseconds",
+        {"latencyBudget"}, 0, args::Options::Single);
+    args::Flag _profileStartup(parser, "startup profile",
+        "Reports the time and memory used by each phase of starting up", {"profileStartup"},
+        args::Options::Single);
+    args::ValueFlag<std::string> _profileStartupJSON(parser, "JSON_PATH",
+        "Writes the startup profile to a JSON file", {"profileStartupJSON"}, "", args::Options::Single);
+    args::ValueFlag<std::string> _trace(parser, "TRACE_PATH",
+        "Writes a timeline of driver activity to a Chrome trace-event file", {"trace"}, "",
+        args::Options::Single);
+    args::ValueFlag<std::string> _replay(parser, "LOG_PATH",
+        "Replays a session recorded with --log and checks that the same picks are sent", {"replay"},
+        "", args::Options::Single);
+    args::MapFlag<std::string, bool, ToLowerReader> _replaySpeed(parser, "REPLAY_SPEED",
+        "Replays as fast as possible (fast) or with the recorded timing (real)", {"replaySpeed"},
+        replaySpeedMap, false, args::Options::Single);
+    args::ImplicitValueFlag<int> _dryRun(parser, "PASSES",
+        "Weaves the pick list against a simulated loom as fast as possible and reports the speed", {"dryRun"},
+        1, 0, args::Options::Single);
+    args::MapFlag<std::string, bool, ToLowerReader> _dryRunOutput(parser, "OUTPUT",
+        "Shows the dry run on the terminal or discards the output (null)", {"dryRunOutput"},
+        dryRunOutputMap, false, args::Options::Single);
+    args::ValueFlag<std::string> _script(parser, "SCRIPT_PATH",
+        "Reads keyboard commands from a script file, or - for standard input, instead of the terminal",
+        {"script"}, "", args::Options::Single);
+    args::ValueFlag<std::string> _output(parser, "OUTPUT_PATH",
+        "Writes the display to a file instead of the terminal", {"output"}, "", args::Options::Single);
     args::MapFlag<std::string, ANSIsupport, ToLowerReader> _ansi(parser, "ANSI_SUPPORT",
         "Does the terminal support ANSI style codes and possibly true-color", {"ansi"},
         ANSImap, defANSI, args::Options::Single);
     args::Positional<std::string> _draftFile(parser, "DRAFT_PATH", "The path of the WIF or DTX file",
         args::Options::Required);
 
+    std::optional<int> resumeOffset;
+    
     try {
         parser.Prog("drawboy");
         parser.ParseCLI(argc, argv);
         if (!findloom) {
-            if (_cd1.Get() + _cd2.Get() + _cd3.Get() + _cd4.Get() != 1 && defGen == 0)
+            if (_cd1.Get() + _cd2.Get() + _cd3.Get() + _cd4.Get() != 1 && defGen == 0 && !_replay)
                 throw args::ParseError("Option Compu-dobby generation is required: --cd1, --cd2, --cd3, or --cd4.");
-            if (_loomDevice.Get().empty() && !defNetwork && !_loomAddress && !envSocket)
+            if (_loomDevice.Get().empty() && !defNetwork && !_loomAddress && !envSocket && !_replay && !_dryRun)
                 throw args::ParseError("Option loom device path or loom network address is required: --loomDevice or --loomAddress.");
             if (_net && args::get(_loomAddress).data()[0] == '\0')
                 throw args::ParseError("Option loom  network address is required for network mode: --loomAddress.");
+            if (args::get(_redrawInterval) < 0 || args::get(_latencyBudget) < 0)
+                throw args::ParseError("Argument 'MS' cannot be negative.");
+            if (args::get(_vtime) < 0 || args::get(_vtime) > 255)
+                throw args::ParseError("Argument 'DECISECONDS' must be from 0 to 255.");
+            if (args::get(_dryRun) < 0)
+                throw args::ParseError("Argument 'PASSES' cannot be negative.");
+            if ((bool)_replay + (bool)_dryRun + (bool)_script > 1)
+                throw args::ParseError("Only one of --replay, --dryRun, and --script can be used.");
+            if (_output && !_replay && !_dryRun && !_script)
+                throw args::ParseError("Option --output needs --script, --replay, or --dryRun.");
             if (_pick) {
                 bool autoPick = _pick.Get().starts_with("last");
                 int pickNum = 0;
@@ -410,29 +224,10 @@ Options::Options(int argc, const char * argv[])
                         throw args::ParseError("Argument 'PICK' received invalid value type '" +
                             _pick.Get() + "'");
                 }
-                if (autoPick) {
-                    bool success = false;
-                    if (std::FILE* pickf{std::fopen(pickFile.c_str(), "r")}) {
-                        char buf[12];
-                        if (std::fgets(buf, 12, pickf)) {
-                            int pickBase = 1;
-                            auto baseRes = std::from_chars(buf, buf + 12, pickBase, 10);
-                            if (baseRes.ec == std::errc()) {
-                                pick = pickBase + pickNum;
-                                success = true;
-                            }
-                        }
-                        std::fclose(pickf);
-                    }
-                    if (success) {
-                        std::print("Continuing at pick {}.\n\n", pick);
-                    } else {
-                        std::print("Failed to fetch previous pick. Starting at pick 1.\n\n");
-                        pick = 1;
-                    }
-                } else {
+                if (autoPick)
+                    resumeOffset = pickNum;     // resolved once the draft is read
+                else
                     pick = pickNum;
-                }
             }
         }
     } catch (const args::Completion& e) {
@@ -481,9 +276,29 @@ Options::Options(int argc, const char * argv[])
     dobbyType = args::get(_dobbyType);
     ascii = args::get(_ascii) || envASCII != nullptr;
     ansi = args::get(_ansi);
+    if (_output) {
+        if (!std::freopen(args::get(_output).c_str(), "w", stdout))
+            throw make_system_error("Cannot open output file");
+        if (!_ansi)
+            ansi = ANSIsupport::no;
+    }
+    if (_script)
+        script = std::make_unique<Script>(args::get(_script));
     colorAlert = args::get(_bell);
     tabbyPattern = args::get(_tabbyPattern);
     treadleThreading = _threading;
+    realtime = _realtime;
+    realtimeCPU = args::get(_realtimeCPU);
+    if (_realtimeCPU && !realtime)
+        std::cout << "CPU pinning is only done in real-time mode.\n";
+    redrawInterval = args::get(_redrawInterval);
+    stats = _stats;
+    if (_stats || _dryRun)
+        hotPath.enable();
+    latencyBudget = args::get(_latencyBudget);
+    vtime = args::get(_vtime);
+    profileStartup = _profileStartup || _profileStartupJSON;
+    profileStartupJSON = args::get(_profileStartupJSON);
     std::string draftFile = args::get(_draftFile);
     compuDobbyGen = defGen;
     if (dobbyType == DobbyType::Virtual) {
@@ -503,6 +318,17 @@ Options::Options(int argc, const char * argv[])
     else if (_cd4)
         compuDobbyGen = 4;
 
+    if (_replay) {
+        replay = std::make_unique<Replay>(args::get(_replay), args::get(_replaySpeed));
+        if (_cd1 || _cd2 || _cd3 || _cd4) {
+            if (compuDobbyGen != replay->compuDobbyGen())
+                throw std::runtime_error(std::format("The log was recorded with a Compu-Dobby {}.",
+                                                     replay->compuDobbyGen()));
+        } else {
+            compuDobbyGen = replay->compuDobbyGen();
+        }
+    }
+
     if (virtualPositive && compuDobbyGen != 4)
         std::cout << "Virtual positive mode is only available with Compu-Dobby IV.\n";
     if (dobbyType == DobbyType::Unspecified && compuDobbyGen != 4) {
@@ -525,7 +351,9 @@ Options::Options(int argc, const char * argv[])
     if (compuDobbyGen != 4 && virtualPositive)
         std::cout << "Only Compu-Dobby IV/4.5 looms can be virtual positive dobbies.\n";
 
+    startupProfile.phase("draft");
     if (auto draftfileowner = std::ifstream(draftFile)) {
+        HotPath::Scope measured(HotPath::Section::DraftParse);
         if (draftFile.ends_with(".wif"))
             draftContents = std::make_unique<wif>(draftfileowner);
         else if (draftFile.ends_with(".dtx"))
@@ -541,42 +369,64 @@ Options::Options(int argc, const char * argv[])
         return;
     }
     
+    startupProfile.phase("resume");
+    draftHash = WeavingJournal::hashFile(draftFile);
+    if (resumeOffset) {
+        // The journal knows the last pick woven even if drawboy did not exit
+        // cleanly, but only trust it for the same draft
+        bool success = false;
+        auto last = WeavingJournal::last(journalFile);
+        if (last && last->draftHash == draftHash) {
+            pick = last->resumePick + *resumeOffset;
+            success = true;
+        } else if (std::FILE* pickf{std::fopen(pickFile.c_str(), "r")}) {
+            char buf[12];
+            if (std::fgets(buf, 12, pickf)) {
+                int pickBase = 1;
+                auto baseRes = std::from_chars(buf, buf + 12, pickBase, 10);
+                if (baseRes.ec == std::errc()) {
+                    pick = pickBase + *resumeOffset;
+                    success = true;
+                }
+            }
+            std::fclose(pickf);
+        }
+        if (success) {
+            std::print("Continuing at pick {}.\n\n", pick);
+        } else {
+            std::print("Failed to fetch previous pick. Starting at pick 1.\n\n");
+            pick = 1;
+        }
+    }
+    
+    startupProfile.phase("pick list");
     parsePicks(args::get(_picks), draftContents->picks);
     
     if (draftContents->maxShafts > maxShafts && compuDobbyGen < 4)
         throw std::runtime_error("Draft file requires more shafts than the loom possesses.");
     
-    if (envSocket) {
-        IPC::Client fakeLoom(envSocket);
-        loomDeviceFD = fakeLoom.release();
-    } else if (useNetwork) {
-        loomDeviceFD = openTelnet(loomAddress);
-
-        if (loomDeviceFD == -1)
-            throw std::runtime_error("Cannot open loom on network.");
-        if (loomDeviceFD == -2)
-            throw std::runtime_error("Loom address cannot be found on network.");
-    } else {
-        loomDeviceFD = checkForSerial(loomDevice);
-
-        if (loomDeviceFD == -1)
-            throw std::runtime_error("Cannot open loom device.");
-        if (loomDeviceFD == -2)
-            throw std::runtime_error("Loom device is not a serial port.");
-        
-        initLoomPort(loomDeviceFD, compuDobbyGen);
+    if (_dryRun) {
+        stats = true;
+        dryRun = std::make_unique<DryRun>(compuDobbyGen, maxShafts, dobbyType, args::get(_dryRun),
+                                          args::get(_dryRunOutput));
     }
     
-    std::string tabby = args::get(_tabby);
+    // Network and serial connections profile their own steps
+    if (replay || dryRun || envSocket)
+        startupProfile.phase("loom connection");
+    if (replay)
+        loom = replay->loomTransport();
+    else if (dryRun)
+        loom = dryRun->loomTransport(picks.size());
+    else if (envSocket)
+        loom = std::make_unique<UnixTransport>(envSocket);
+    else if (useNetwork)
+        loom = std::make_unique<TCPTransport>(loomAddress);
+    else
+        loom = std::make_unique<SerialTransport>(loomDevice, compuDobbyGen, vtime);
     
-    for (size_t shaft = 0; shaft < tabby.length(); ++shaft) {
-        if (tabby[shaft] == 'a')
-            tabbyA |= 1ull << shaft;
-        else if (tabby[shaft] == 'b')
-            tabbyB |= 1ull << shaft;
-        else
-            throw std::runtime_error("Bad character in tabby specification.");
-    }
+    startupProfile.phase("setup");
+    std::tie(tabbyA, tabbyB) = parseTabby(args::get(_tabby));
             
     if (tabbyA == 0)
         std::cerr << "Tabby A has no shafts set." << std::endl;
@@ -585,30 +435,30 @@ Options::Options(int argc, const char * argv[])
     
     tabbyColor = color(args::get(_tabbyColor).c_str());
     
+    if (_trace)
+        eventTrace.open(args::get(_trace));
+    
+    if (!replay && !dryRun) {
+        journal = WeavingJournal::open(journalFile);
+        if (!journal)
+            std::cerr << "Another drawboy is using " << journalFile
+                      << ", so picks woven here are not journaled." << std::endl;
+    }
+    
     if (_log) {
         auto now = std::chrono::system_clock::now();
         auto date = std::chrono::floor<std::chrono::days>(now);
         auto clocktime = std::chrono::floor<std::chrono::seconds>(now - date);
         std::chrono::hh_mm_ss time_of_day{clocktime};
         
-        std::string fname = std::format("drawboy_{}-{}.log",
+        std::string fname = std::format("drawboy_{}-{}.dblog",
                                         date,
                                         time_of_day);
         auto tmpdir = std::filesystem::temp_directory_path();
         auto tempfile = tmpdir / fname;
-        std::cout << "Logging to " << tempfile << "\n";
-        logFile = fopen(tempfile.c_str(), "w");
+        std::cout << "Logging to " << tempfile << ", view it with loomlogdump\n";
+        loomLog = std::make_unique<LoomLog>(tempfile, compuDobbyGen);
     }
 }
 
-Options::~Options()
-{
-    if (loomDeviceFD >= 0) {
-        ::close(loomDeviceFD);
-        loomDeviceFD = -1;
-    }
-    if (logFile) {
-        std::fclose(logFile);
-        logFile = nullptr;
-    }
-}
+Options::~Options() = default;
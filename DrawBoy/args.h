@@ -19,18 +19,25 @@
 #include <cstdio>
 
 class draft;
+class LoomLog;
+class LoomTransport;
+class Replay;
+class DryRun;
+class Script;
+class WeavingJournal;
 
 struct Options {
     Options(int argc, const char * argv[]);
     ~Options();
     void parsePicks(const std::string& str, int maxPick);
+    std::vector<int> parsePickList(const std::string& str, int maxPick) const;
     
     bool driveLoom = true;
     int compuDobbyGen;
     bool useNetwork;
     std::string loomDevice;
     std::string loomAddress;
-    int loomDeviceFD = 0;
+    std::unique_ptr<LoomTransport> loom;
     std::unique_ptr<draft> draftContents;
     int maxShafts;
     DobbyType dobbyType = DobbyType::Unspecified;
@@ -45,6 +52,20 @@ struct Options {
     uint64_t tabbyA = 0, tabbyB = 0;
     TabbyPattern tabbyPattern = TabbyPattern::xAyB;
     std::string pickFile;
-    FILE* logFile = nullptr;
+    std::string journalFile;
+    uint64_t draftHash = 0;
+    std::unique_ptr<WeavingJournal> journal;
+    std::unique_ptr<LoomLog> loomLog;
+    std::unique_ptr<Replay> replay;
+    std::unique_ptr<DryRun> dryRun;
+    std::unique_ptr<Script> script;
+    bool realtime = false;
+    int realtimeCPU = -1;
+    int redrawInterval = 0;     // milliseconds
+    bool stats = false;
+    int latencyBudget = 0;      // milliseconds
+    int vtime = 1;              // deciseconds, for the serial port
+    bool profileStartup = false;
+    std::string profileStartupJSON;
 };
 
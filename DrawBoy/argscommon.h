@@ -98,6 +98,14 @@ inline std::unordered_map<std::string, ColorAlert> alertMap {
     {"pulse", ColorAlert::Pulse},
     {"alternating", ColorAlert::Alternating},
 };
+inline std::unordered_map<std::string, bool> replaySpeedMap {
+    {"fast", false},
+    {"real", true},
+};
+inline std::unordered_map<std::string, bool> dryRunOutputMap {
+    {"terminal", false},
+    {"null", true},
+};
 
 inline std::system_error
 make_system_error(const char* what) {
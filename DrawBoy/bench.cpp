@@ -0,0 +1,351 @@
+/*
+ *  bench.cpp
+ *  DrawBoy
+ */
+
+
+#include "args.h"
+#include "args.hxx"
+#include "driver.h"
+#include "dtx.h"
+#include "perfcounters.h"
+#include "results.h"
+#include "synthetic.h"
+#include "term.h"
+#include "wif.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <print>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Micro-benchmarks of drawboy's hot paths: parsing drafts and pick lists,
+// calculating lifts, drawing pick lines, parsing terminal input and encoding
+// picks for the loom. `make bench` runs them; --json saves the results and
+// --compare checks a run against saved results.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// Keeps the compiler from optimizing away a result
+template <typename T>
+void
+keep(T value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Result {
+    std::string name;
+    const char* unit;           // what one item is
+    uint64_t iterations;
+    uint64_t items;
+    double seconds;
+
+    double nsPerItem() const { return seconds * 1e9 / (double)items; }
+    double itemsPerSecond() const { return (double)items / seconds; }
+};
+
+class Bench {
+  public:
+    Bench(std::chrono::milliseconds minTime, std::string filter)
+    : _minTime(std::chrono::duration<double>(minTime).count()), _filter(std::move(filter))
+    { }
+
+    // body(n) does the operation n times and returns the number of items
+    // it processed
+    void run(const char* name, const char* unit, const std::function<uint64_t(uint64_t)>& body);
+
+    const std::vector<Result>& results() const { return _results; }
+
+  private:
+    double _minTime;            // seconds
+    std::string _filter;
+    std::vector<Result> _results;
+};
+
+void
+Bench::run(const char* name, const char* unit, const std::function<uint64_t(uint64_t)>& body)
+{
+    if (!std::string_view(name).contains(_filter))
+        return;
+
+    // Grow the iteration count until one run takes at least the minimum time
+    body(1);                    // warm up
+    uint64_t n = 1;
+    while (true) {
+        auto start = clock_type::now();
+        uint64_t items = body(n);
+        double secs = std::chrono::duration<double>(clock_type::now() - start).count();
+        if (secs >= _minTime || n >= 1'000'000'000) {
+            _results.push_back({name, unit, n, items, secs});
+            std::print(stderr, "{:<24}{:>12.1f} ns/{}\n", name, _results.back().nsPerItem(), unit);
+            return;
+        }
+        double scale = secs > 0.0 ? _minTime * 1.2 / secs : 100.0;
+        n = std::max(n + 1, (uint64_t)((double)n * std::min(scale, 100.0)));
+    }
+}
+
+// A draft file for the Options that drawboy would build from it
+class TempDraft {
+  public:
+    explicit TempDraft(const std::string& text)
+    {
+        _path = std::filesystem::temp_directory_path() / "drawboy-benchXXXXXX.wif";
+        int fd = ::mkstemps(_path.data(), 4);
+        if (fd < 0)
+            throw make_system_error("Cannot create benchmark draft");
+        std::string_view rest(text);
+        while (!rest.empty()) {
+            auto n = ::write(fd, rest.data(), rest.size());
+            if (n <= 0) {
+                ::close(fd);
+                throw make_system_error("Cannot write benchmark draft");
+            }
+            rest.remove_prefix((size_t)n);
+        }
+        ::close(fd);
+    }
+    ~TempDraft() { ::unlink(_path.c_str()); }
+    const std::string& path() const { return _path; }
+
+  private:
+    std::string _path;
+};
+
+// Options for a dry run, so that no loom is needed
+std::unique_ptr<Options>
+makeOptions(const char* generation, const std::string& draftPath)
+{
+    std::vector<const char*> argv = {"drawboy-bench", generation, "--shafts=24", "--dryRun",
+        "--dryRunOutput=null", "--dobbyType=positive", "--ansi=truecolor", draftPath.c_str()};
+    auto opts = std::make_unique<Options>((int)argv.size(), argv.data());
+    hotPath.disable();          // a dry run turns the counters on
+    std::fflush(stdout);
+    return opts;
+}
+
+// Sends stdout to memory while drawing, so that only drawboy's own work is timed
+class MemorySink {
+  public:
+    MemorySink()
+    {
+        std::fflush(stdout);
+        _saved = stdout;
+        _sink = ::open_memstream(&_buffer, &_size);
+        if (!_sink)
+            throw make_system_error("Cannot open memory stream");
+        stdout = _sink;
+    }
+    ~MemorySink()
+    {
+        stdout = _saved;
+        std::fclose(_sink);
+        std::free(_buffer);
+    }
+    void rewind() { std::fseek(_sink, 0, SEEK_SET); }
+
+  private:
+    std::FILE* _saved;
+    std::FILE* _sink;
+    char* _buffer = nullptr;
+    std::size_t _size = 0;
+};
+
+// A draft like the ones weavers use, with picks as given
+SyntheticDraft
+benchDraft(int picks, bool liftplan)
+{
+    SyntheticDraft draft;
+    draft.shafts = 24;
+    draft.treadles = 32;
+    draft.ends = 2000;
+    draft.picks = picks;
+    draft.colors = 16;
+    draft.liftplan = liftplan;
+    draft.threadingOrder = SyntheticDraft::Order::Point;
+    draft.treadlingOrder = SyntheticDraft::Order::Random;
+    draft.treadlingRepeat = 2000;
+    draft.generate();
+    return draft;
+}
+
+void
+runBenchmarks(Bench& bench, int draftPicks)
+{
+    const SyntheticDraft liftplan = benchDraft(draftPicks, true);
+    const SyntheticDraft treadling = benchDraft(draftPicks, false);
+    const std::string wifLiftplan = liftplan.wifText();
+    const std::string wifTreadling = treadling.wifText();
+    const std::string dtxLiftplan = liftplan.dtxText();
+    const std::string dtxTreadling = treadling.dtxText();
+
+    auto parse = [draftPicks](const std::string& text, bool isWIF) {
+        return [&text, isWIF, draftPicks](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                std::istringstream in(text);
+                if (isWIF)
+                    keep(wif(in).liftplan.size());
+                else
+                    keep(dtx(in).liftplan.size());
+            }
+            return n * (uint64_t)draftPicks;
+        };
+    };
+    bench.run("wif parse liftplan", "pick", parse(wifLiftplan, true));
+    bench.run("wif parse treadling", "pick", parse(wifTreadling, true));
+    bench.run("dtx parse liftplan", "pick", parse(dtxLiftplan, false));
+    bench.run("dtx parse treadling", "pick", parse(dtxTreadling, false));
+
+    const SyntheticDraft small = benchDraft(2000, true);
+    TempDraft draft(small.wifText());
+    auto cd2 = makeOptions("--cd2", draft.path());
+    auto cd4 = makeOptions("--cd4", draft.path());
+    int pickCount = (int)cd2->picks.size();
+
+    bench.run("pick list nested", "pick", [&](uint64_t n) {
+        uint64_t items = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            auto list = cd2->parsePickList("4x(1-100,2x(~101,102~150,3x(A,B)),3x(200-151,1500~1600))",
+                                           small.picks);
+            items += list.size();
+        }
+        return items;
+    });
+
+    int pipeFDs[2];
+    if (::pipe(pipeFDs) != 0)
+        throw make_system_error("Cannot create terminal input");
+    ::fcntl(pipeFDs[0], F_SETFL, ::fcntl(pipeFDs[0], F_GETFL) | O_NONBLOCK);
+    Term term(true, pipeFDs[0]);
+    PickPath path2(term, *cd2);
+    PickPath path4(term, *cd4);
+
+    bench.run("calculate lift", "pick", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+            keep(path2.lift((int)(i % (uint64_t)pickCount)));
+        return n;
+    });
+    bench.run("encode CD I-III", "pick", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+            keep(path2.encode((int)(i % (uint64_t)pickCount)).size());
+        return n;
+    });
+    bench.run("encode CD IV", "pick", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+            keep(path4.encode((int)(i % (uint64_t)pickCount)).size());
+        return n;
+    });
+    bench.run("display pick", "pick", [&](uint64_t n) {
+        MemorySink sink;
+        for (uint64_t i = 0; i < n; ++i) {
+            path2.display((int)(i % (uint64_t)pickCount));
+            if (i % 1024 == 1023)
+                sink.rewind();
+        }
+        return n;
+    });
+
+    // Keys, arrows with and without modifiers, and function keys: 12 events
+    std::string keys;
+    while (keys.size() < 4096)
+        keys.append("t\x1b[A\x1b[B\x1b[1;5C\x1b[1;2Dl\x1b[5~\x1b[6~r\x1bOP\x1b[H\r");
+    bench.run("terminal events", "event", [&](uint64_t n) {
+        uint64_t events = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            if (::write(pipeFDs[1], keys.data(), keys.size()) != (ssize_t)keys.size())
+                throw make_system_error("Cannot write terminal input");
+            while (term.getEvent().type != Term::EventType::None)
+                ++events;
+        }
+        return events;
+    });
+    ::close(pipeFDs[0]);
+    ::close(pipeFDs[1]);
+}
+
+// Returns the number of benchmarks slower than the baseline by more than
+// the threshold
+int
+report(const std::vector<Result>& results, const Baseline* baseline, double threshold)
+{
+    int regressions = 0;
+    if (baseline)
+        std::print("{:<24}{:>12} {:>14} {:>12} {:>8}\n", "Benchmark", "ns/item", "items/s",
+                   "baseline", "change");
+    else
+        std::print("{:<24}{:>12} {:>14}\n", "Benchmark", "ns/item", "items/s");
+    for (auto& r: results) {
+        std::print("{:<24}{:>12.1f} {:>14.0f}", r.name, r.nsPerItem(), r.itemsPerSecond());
+        if (baseline) {
+            if (auto change = worseThan(*baseline, r.name, "nsPerItem", r.nsPerItem(), false)) {
+                bool regressed = *change > threshold;
+                if (regressed)
+                    ++regressions;
+                std::print(" {:>12.1f} {:>+7.1f}%{}", baseline->at(r.name).at("nsPerItem"), *change,
+                           regressed ? "  SLOWER" : "");
+            } else {
+                std::print(" {:>12} {:>8}", "-", "new");
+            }
+        }
+        std::putchar('\n');
+    }
+    if (baseline)
+        std::print("{} of {} benchmarks more than {:.0f}% slower than the baseline\n",
+                   regressions, results.size(), threshold);
+    return regressions;
+}
+
+std::vector<ResultRecord>
+records(const std::vector<Result>& results)
+{
+    std::vector<ResultRecord> records;
+    for (auto& r: results)
+        records.push_back({r.name, {{"unit", r.unit}, {"iterations", (double)r.iterations},
+            {"items", (double)r.items}, {"seconds", r.seconds}, {"nsPerItem", r.nsPerItem()},
+            {"itemsPerSecond", r.itemsPerSecond()}}});
+    return records;
+}
+
+}
+
+int main(int argc, const char * argv[]) {
+    args::ArgumentParser parser("Benchmarks drawboy's hot paths.",
+        "Save results with --json and check later runs against them with --compare.");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    ResultOptions results(parser, 10.0,
+        "How much slower than the baseline is a regression (defaults to 10)");
+    args::ValueFlag<int> _minTime(parser, "MS",
+        "Minimum time for each benchmark, in milliseconds (defaults to 250)", {"minTime"}, 250,
+        args::Options::Single);
+    args::ValueFlag<int> _draftPicks(parser, "PICKS",
+        "Picks in the drafts that are parsed (defaults to 20000)", {"draftPicks"}, 20000,
+        args::Options::Single);
+    args::ValueFlag<std::string> _filter(parser, "TEXT",
+        "Only runs the benchmarks whose names contain this", {"filter"}, "", args::Options::Single);
+
+    return runTool(parser, "drawboy-bench", argc, argv, [&] {
+        Baseline baseline;
+        if (results.compare)
+            baseline = readBaseline(args::get(results.compare), "benchmarks");
+
+        Bench bench(std::chrono::milliseconds(std::max(1, args::get(_minTime))), args::get(_filter));
+        runBenchmarks(bench, std::max(1, args::get(_draftPicks)));
+
+        std::putchar('\n');
+        int regressions = report(bench.results(), results.compare ? &baseline : nullptr,
+                                 args::get(results.threshold));
+        if (results.json)
+            writeResults(records(bench.results()), "benchmarks", args::get(results.json));
+        return regressions ? 1 : 0;
+    });
+}
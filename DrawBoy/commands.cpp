@@ -0,0 +1,178 @@
+/*
+ *  commands.cpp
+ *  DrawBoy
+ */
+
+
+#include "commands.h"
+#include "argscommon.h"
+#include <cstdlib>
+#include <iterator>
+#include <optional>
+
+PickState::Change
+PickState::apply(Command& cmd, bool deferred)
+{
+    switch (cmd.command) {
+        case Commands::Tabby:
+            if (treadleThreading)
+                return Change::Refused;
+            if (mode == Mode::Tabby)
+                return Change::None;
+            mode = Mode::Tabby;
+            if (nextPick >= 0)      // entering a pick from tabby mode leaves a tabby pick here
+                oldPick = nextPick;
+            nextPick = weaveForward ? TabbyA : TabbyB;
+            return Change::Pick;
+        case Commands::Liftplan:
+            if (treadleThreading)
+                return Change::Refused;
+            if (mode == Mode::Weave)
+                return Change::None;
+            if (inTabby())          // and not just entering a pick from weave mode
+                nextPick = oldPick;
+            mode = Mode::Weave;
+            return Change::Pick;
+        case Commands::Reverse:
+            weaveForward = !weaveForward;
+            nextPick = currentPick;
+            advancePick(true);
+            return Change::Pick;
+        case Commands::AdvancePick:
+            if (cmd.argument == 0)
+                return Change::None;
+            for (int i = 0; i < std::abs(cmd.argument); ++i)
+                advancePick(cmd.argument > 0);
+            return Change::Pick;
+        case Commands::DoSetPick:
+            if (cmd.argument > 0) {
+                nextPick = oldPick = cmd.argument - 1;
+                mode = Mode::Weave;
+                return Change::Pick;
+            }
+            if (deferred)
+                return Change::None;
+            mode = oldMode;
+            return Change::Mode;
+        case Commands::DoSetPickList:
+            picks = std::move(cmd.picks);
+            nextPick = oldPick = 0;     // Current pick is from old pick list
+            currentPick = -10;          // it is meaningless in new pick list
+            mode = Mode::Weave;
+            return Change::Pick;
+        default:
+            return Change::None;
+    }
+}
+
+void
+PickState::setPick(int newPick)
+{
+    nextPick = newPick;
+    int psize = treadleThreading ? ends : (int)picks.size();
+    if (nextPick >= 9999)
+        nextPick -= (nextPick / psize) * psize;
+    while (nextPick < 0)
+        nextPick += psize;
+}
+
+void
+PickState::advancePick(bool forward)
+{
+    switch (mode) {
+        case Mode::Weave:
+                                    //   VV     logical XNOR
+            setPick(nextPick + ((forward == weaveForward) ? 1 : -1));
+            break;
+        case Mode::Tabby:
+            nextPick = nextPick == TabbyA ? TabbyB : TabbyA;
+            break;
+        default:
+            break;
+    }
+}
+
+// Every rule here leaves exactly the PickState that applying the commands
+// one at a time would, except that merged AdvancePick commands may leave
+// the next pick a whole pass through the pick list away: the same pick.
+// commandtest checks this for every short queue.
+std::deque<Command>
+reduceCommands(std::deque<Command> commands, bool treadleThreading)
+{
+    std::deque<Command> reduced;
+    bool refused = false;
+
+    for (auto& cmd: commands) {
+        switch (cmd.command) {
+            case Commands::AdvancePick:
+                if (cmd.argument == 0)
+                    continue;
+                if (!reduced.empty() && reduced.back().command == Commands::AdvancePick) {
+                    reduced.back().argument += cmd.argument;
+                    if (reduced.back().argument == 0)
+                        reduced.pop_back();
+                    continue;
+                }
+                break;
+            case Commands::Tabby:
+            case Commands::Liftplan: {
+                if (treadleThreading) {
+                    refused = true;
+                    continue;
+                }
+                if (!reduced.empty() && reduced.back().command == cmd.command)
+                    continue;       // already in that mode
+                if (cmd.command == Commands::Tabby)
+                    break;
+                // Tabby picks chosen since the last Tabby command are
+                // discarded when Liftplan restores the saved pick.
+                auto back = reduced.end();
+                while (back != reduced.begin() && std::prev(back)->command == Commands::AdvancePick)
+                    --back;
+                if (back != reduced.begin() && std::prev(back)->command == Commands::Tabby) {
+                    reduced.erase(back, reduced.end());
+                    // Tabby, Liftplan, Tabby, Liftplan does what Tabby, Liftplan does
+                    auto n = reduced.size();
+                    if (n >= 3 && reduced[n - 2].command == Commands::Liftplan &&
+                        reduced[n - 3].command == Commands::Tabby)
+                    {
+                        reduced.pop_back();
+                        continue;
+                    }
+                }
+                break;
+            }
+            case Commands::DoSetPick:
+            case Commands::DoSetPickList: {
+                if (cmd.command == Commands::DoSetPick && cmd.argument <= 0)
+                    continue;       // cancelled pick entry does nothing when deferred
+                // Everything before this sets the next pick, the saved pick and
+                // the mode, only the weaving direction and the pick list
+                // survive it.
+                bool reverse = false;
+                std::optional<Command> pickList;
+                for (auto& prev: reduced) {
+                    if (prev.command == Commands::Reverse)
+                        reverse = !reverse;
+                    if (prev.command == Commands::DoSetPickList)
+                        pickList = std::move(prev);
+                }
+                reduced.clear();
+                if (pickList && cmd.command == Commands::DoSetPick)
+                    reduced.push_back(std::move(*pickList));
+                if (reverse)
+                    reduced.push_back({Commands::Reverse});
+                break;
+            }
+            default:
+                break;
+        }
+        reduced.push_back(std::move(cmd));
+    }
+
+    // Refused commands change nothing, but one is kept so that the user
+    // still hears the bell
+    if (refused)
+        reduced.push_front({Commands::Tabby});
+    return reduced;
+}
@@ -0,0 +1,82 @@
+/*
+ *  commands.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+enum class Mode {
+    Weave,
+    Tabby,
+    PickEntry,
+    PickListEntry,
+    Quit,
+};
+
+enum class Commands {
+    Null,
+    Tabby,
+    Liftplan,
+    Reverse,
+    SetPick,
+    AdvancePick,
+    SetPickList,
+    DoSetPick,
+    DoSetPickList,
+    Quit
+};
+
+struct Command
+{
+    Commands command = Commands::Null;
+    int argument = 0;
+    std::vector<int> picks{};   // parsed pick list for DoSetPickList
+};
+
+// Where the weaving is: the pick on the loom, the one to send next, and the
+// mode and direction that choose the pick after that. Commands change it.
+struct PickState
+{
+    enum class Change {
+        Refused,        // Tabby or Liftplan while treadling the threading
+        None,
+        Mode,           // only the prompt needs updating
+        Pick,           // the next pick must be sent
+    };
+
+    PickState(std::vector<int>& pickList, bool threading, int threadingEnds)
+    : picks(pickList), treadleThreading(threading), ends(threadingEnds)
+    { }
+
+    // Tabby, Liftplan, Reverse, AdvancePick, DoSetPick and DoSetPickList.
+    // When deferred the command was queued while the shed was closed.
+    Change apply(Command& cmd, bool deferred);
+    void advancePick(bool forward);
+    void setPick(int newPick);
+
+    // Also while entering a pick or pick list from tabby mode
+    bool inTabby() const
+    {
+        return mode == Mode::Tabby ||
+               ((mode == Mode::PickEntry || mode == Mode::PickListEntry) && oldMode == Mode::Tabby);
+    }
+
+    std::vector<int>& picks;
+    bool treadleThreading;
+    int ends;                   // of the threading
+
+    Mode mode = Mode::Weave;
+    Mode oldMode = Mode::Weave;
+    int currentPick = 0, nextPick = 1;
+    int oldPick = -1;           // to go back to after tabby
+    bool weaveForward = true;
+};
+
+// Reduces commands queued while the shed was closed to a shorter list that
+// leaves the same PickState when applied in order, so that opening the shed
+// costs one pick calculation and one send.
+std::deque<Command> reduceCommands(std::deque<Command> commands, bool treadleThreading);
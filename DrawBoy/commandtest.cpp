@@ -0,0 +1,163 @@
+/*
+ *  commandtest.cpp
+ *  DrawBoy
+ */
+
+
+#include "commands.h"
+#include "argscommon.h"
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Checks reduceCommands against applying the queued commands one at a time:
+// every queue of up to MaxLength commands, from a range of starting states,
+// must leave the same PickState either way.
+
+namespace {
+const int MaxLength = 6;
+const int ThreadingEnds = 5;
+const std::vector<int> FirstPicks{0, 1, 2, 3, 4, 5, 6};
+const std::vector<int> NewPicks{3, 2, TabbyA, 1};
+
+const std::vector<Command> Alphabet{
+    {Commands::Tabby},
+    {Commands::Liftplan},
+    {Commands::Reverse},
+    {Commands::AdvancePick, 1},
+    {Commands::AdvancePick, -1},
+    {Commands::AdvancePick, 2},
+    {Commands::DoSetPick, 3},
+    {Commands::DoSetPick, 0},
+    {Commands::DoSetPickList, 0, NewPicks},
+};
+
+struct Start {
+    Mode mode, oldMode;
+    int currentPick, nextPick, oldPick;
+};
+
+// Weaving, just after a new pick list, just out of tabby, in tabby, just
+// into tabby, and entering a pick
+const std::vector<Start> Starts{
+    {Mode::Weave, Mode::Weave, 2, 3, -1},
+    {Mode::Weave, Mode::Weave, 6, 7, 1},
+    {Mode::Weave, Mode::Weave, -10, 0, 0},
+    {Mode::Weave, Mode::Weave, TabbyB, 4, 4},
+    {Mode::Tabby, Mode::Tabby, TabbyA, TabbyB, 3},
+    {Mode::Tabby, Mode::Tabby, 3, TabbyA, 3},
+    {Mode::PickEntry, Mode::Weave, 2, 3, -1},
+    {Mode::PickEntry, Mode::Tabby, TabbyA, TabbyB, 3},
+};
+
+struct Outcome {
+    std::vector<int> picks;
+    PickState state;
+    int refused = 0;
+
+    Outcome(const Start& start, bool forward, bool threading)
+    : picks(FirstPicks), state(picks, threading, ThreadingEnds)
+    {
+        state.mode = start.mode;
+        state.oldMode = start.oldMode;
+        state.currentPick = start.currentPick;
+        state.nextPick = start.nextPick;
+        state.oldPick = start.oldPick;
+        state.weaveForward = forward;
+    }
+
+    Outcome(const Outcome&) = delete;
+
+    void apply(std::deque<Command> commands)
+    {
+        for (auto& cmd: commands)
+            if (state.apply(cmd, true) == PickState::Change::Refused)
+                ++refused;
+    }
+
+    // Picks a whole pass through the pick list apart are the same pick
+    int normal(int pick) const
+    {
+        int psize = state.treadleThreading ? state.ends : (int)picks.size();
+        return pick >= 0 ? pick % psize : pick;
+    }
+
+    bool operator==(const Outcome& other) const
+    {
+        return state.mode == other.state.mode && state.oldMode == other.state.oldMode &&
+               normal(state.nextPick) == other.normal(other.state.nextPick) &&
+               normal(state.oldPick) == other.normal(other.state.oldPick) &&
+               state.currentPick == other.state.currentPick &&
+               state.weaveForward == other.state.weaveForward && picks == other.picks &&
+               (refused > 0) == (other.refused > 0);
+    }
+};
+
+std::string
+describe(const std::deque<Command>& commands)
+{
+    std::string text;
+    for (auto& cmd: commands) {
+        switch (cmd.command) {
+            case Commands::Tabby:           text += " Tabby"; break;
+            case Commands::Liftplan:        text += " Liftplan"; break;
+            case Commands::Reverse:         text += " Reverse"; break;
+            case Commands::AdvancePick:     text += " Advance(" + std::to_string(cmd.argument) + ")"; break;
+            case Commands::DoSetPick:       text += " SetPick(" + std::to_string(cmd.argument) + ")"; break;
+            case Commands::DoSetPickList:   text += " SetPickList"; break;
+            default:                        text += " ?"; break;
+        }
+    }
+    return text;
+}
+
+int failures = 0;
+long checked = 0;
+
+void
+check(const std::deque<Command>& queue)
+{
+    for (bool threading: {false, true}) {
+        auto reduced = reduceCommands(queue, threading);
+        if (reduced.size() > queue.size() + (threading ? 1 : 0)) {
+            if (++failures <= 20)
+                std::printf("Longer:%s ->%s\n", describe(queue).c_str(), describe(reduced).c_str());
+        }
+        for (auto& start: Starts) {
+            for (bool forward: {true, false}) {
+                Outcome replayed(start, forward, threading), applied(start, forward, threading);
+                replayed.apply(queue);
+                applied.apply(reduced);
+                ++checked;
+                if (!(replayed == applied) && ++failures <= 20)
+                    std::printf("Differs:%s ->%s (start %zu, %s%s)\n", describe(queue).c_str(),
+                                describe(reduced).c_str(), (size_t)(&start - Starts.data()),
+                                forward ? "forward" : "backward", threading ? ", threading" : "");
+            }
+        }
+    }
+}
+
+void
+enumerate(std::deque<Command>& queue)
+{
+    check(queue);
+    if (queue.size() == MaxLength)
+        return;
+    for (auto& cmd: Alphabet) {
+        queue.push_back(cmd);
+        enumerate(queue);
+        queue.pop_back();
+    }
+}
+}
+
+int
+main()
+{
+    std::deque<Command> queue;
+    enumerate(queue);
+    std::printf("%ld replays checked, %d failures\n", checked, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/*
+ *  draftgen.cpp
+ *  DrawBoy
+ */
+
+
+#include "synthetic.h"
+#include "args.hxx"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+// Writes synthetic WIF and DTX drafts of any size, for benchmarking drawboy
+// and testing its draft parsers. The same options and seed always give the
+// same draft.
+
+namespace {
+std::unordered_map<std::string, SyntheticDraft::Order> orderMap{
+    {"straight", SyntheticDraft::Order::Straight},
+    {"point", SyntheticDraft::Order::Point},
+    {"random", SyntheticDraft::Order::Random},
+};
+
+enum class Format {
+    WIF,
+    DTX,
+};
+
+std::unordered_map<std::string, Format> formatMap{
+    {"wif", Format::WIF},
+    {"dtx", Format::DTX},
+};
+}
+
+int main(int argc, const char * argv[]) {
+    args::ArgumentParser parser("Writes synthetic drafts for benchmarks and tests.",
+        "The format follows the extension of the output file unless --format is given.");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<int> _shafts(parser, "SHAFT_COUNT", "Number of shafts, 1 to 40 (defaults to 8)",
+        {"shafts"}, 8, args::Options::Single);
+    args::ValueFlag<int> _treadles(parser, "TREADLE_COUNT",
+        "Number of treadles, 1 to 64 (defaults to 10)", {"treadles"}, 10, args::Options::Single);
+    args::ValueFlag<int> _ends(parser, "ENDS", "Number of warp ends (defaults to 400)", {"ends"}, 400,
+        args::Options::Single);
+    args::ValueFlag<int> _picks(parser, "PICKS", "Number of picks (defaults to 1000)", {"picks"}, 1000,
+        args::Options::Single);
+    args::ValueFlag<int> _colors(parser, "COLORS", "Number of palette colors (defaults to 8)",
+        {"colors"}, 8, args::Options::Single);
+    args::Flag _liftplan(parser, "liftplan", "Writes a liftplan instead of a tie-up and treadling",
+        {"liftplan"}, args::Options::Single);
+    args::MapFlag<std::string, SyntheticDraft::Order> _threading(parser, "ORDER",
+        "Threading order: straight, point, or random (defaults to straight)", {"threading"},
+        orderMap, SyntheticDraft::Order::Straight, args::Options::Single);
+    args::MapFlag<std::string, SyntheticDraft::Order> _treadling(parser, "ORDER",
+        "Treadling order: straight, point, or random (defaults to straight)", {"treadling"},
+        orderMap, SyntheticDraft::Order::Straight, args::Options::Single);
+    args::ValueFlag<int> _threadingRepeat(parser, "ENDS",
+        "Ends in the threading repeat (defaults to no repeat)", {"threadingRepeat"}, 0,
+        args::Options::Single);
+    args::ValueFlag<int> _treadlingRepeat(parser, "PICKS",
+        "Picks in the treadling repeat (defaults to no repeat)", {"treadlingRepeat"}, 0,
+        args::Options::Single);
+    args::ValueFlag<uint64_t> _seed(parser, "SEED", "Seed for the random choices (defaults to 1)",
+        {"seed"}, 1, args::Options::Single);
+    args::MapFlag<std::string, Format> _format(parser, "FORMAT", "Draft format: wif or dtx",
+        {"format"}, formatMap, Format::WIF, args::Options::Single);
+    args::Positional<std::string> _output(parser, "OUTPUT_PATH",
+        "The draft file to write, or - for standard output", args::Options::Required);
+
+    try {
+        parser.Prog("draftgen");
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::Error& e) {
+        std::cerr << e.what() << "\n\n" << parser;
+        return 4;
+    }
+
+    std::string path = args::get(_output);
+    Format format = args::get(_format);
+    if (!_format) {
+        if (path.ends_with(".dtx"))
+            format = Format::DTX;
+        else if (!path.ends_with(".wif") && path != "-") {
+            std::cerr << "Use a .wif or .dtx output file or give the --format.\n";
+            return 4;
+        }
+    }
+
+    try {
+        SyntheticDraft draft;
+        draft.shafts = args::get(_shafts);
+        draft.treadles = args::get(_treadles);
+        draft.ends = args::get(_ends);
+        draft.picks = args::get(_picks);
+        draft.colors = args::get(_colors);
+        draft.liftplan = _liftplan;
+        draft.threadingOrder = args::get(_threading);
+        draft.treadlingOrder = args::get(_treadling);
+        draft.threadingRepeat = args::get(_threadingRepeat);
+        draft.treadlingRepeat = args::get(_treadlingRepeat);
+        draft.seed = args::get(_seed);
+        draft.generate();
+
+        std::ofstream file;
+        if (path != "-") {
+            file.open(path, std::ios::out | std::ios::trunc);
+            if (!file)
+                throw std::runtime_error("Cannot open " + path + " for writing.");
+        }
+        std::ostream& out = path == "-" ? std::cout : file;
+        if (format == Format::DTX)
+            draft.writeDTX(out);
+        else
+            draft.writeWIF(out);
+        out.flush();
+        if (!out)
+            throw std::runtime_error("Cannot write the draft.");
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 4;
+    }
+    return 0;
+}
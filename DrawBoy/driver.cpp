@@ -6,8 +6,20 @@
 
 #include "driver.h"
 #include "args.h"
+#include "commands.h"
 #include "term.h"
 #include "draft.h"
+#include "realtime.h"
+#include "stats.h"
+#include "loomlog.h"
+#include "loomtransport.h"
+#include "replay.h"
+#include "dryrun.h"
+#include "script.h"
+#include "journal.h"
+#include "startup.h"
+#include "trace.h"
+#include "perfcounters.h"
 #include <exception>
 #include <sys/select.h>
 #include <unistd.h>
@@ -20,6 +32,9 @@
 #include <print>
 #include <set>
 #include <deque>
+#include <chrono>
+#include <functional>
+#include <algorithm>
 
 namespace {
 std::string pickString(int pick, bool padded)
@@ -35,21 +50,13 @@ std::string pickString(int pick, bool padded)
 }
 
 static const int ClearPick = -42;
-}
 
-enum class Mode {
-    Weave,
-    Tabby,
-    PickEntry,
-    PickListEntry,
-    Quit,
-};
+// In real-time mode long waits are sliced so that wakeup delay can be sampled
+const std::chrono::milliseconds JitterTick{100};
 
-enum class LogDirection {
-    Unknown,
-    Reading,
-    Writing
-};
+// How long to wait for the loom before resending the reset
+const std::chrono::seconds LoomTimeout{3};
+}
 
 enum class Arms {
     Up,
@@ -57,19 +64,6 @@ enum class Arms {
     Unknown,
 };
 
-enum class Commands {
-    Null,
-    Tabby,
-    Liftplan,
-    Reverse,
-    SetPick,
-    AdvancePick,
-    SetPickList,
-    DoSetPick,
-    DoSetPickList,
-    Quit
-};
-
 std::map<Commands, const char*> CommandNames = {
     {Commands::Tabby, "Tabby"},
     {Commands::Liftplan, "Liftplan"},
@@ -79,10 +73,15 @@ std::map<Commands, const char*> CommandNames = {
     {Commands::DoSetPickList, "Pick list set"}
 };
 
-struct Command
+// A message waiting to go out to the loom. On a Compu-Dobby IV the messages
+// after one that waits for <ready> are held until the loom sends it, and then
+// the continuation runs.
+struct LoomMessage
 {
-    Commands command = Commands::Null;
-    int argument = 0;
+    std::string text;
+    bool waitReady = false;
+    std::function<void()> onReady;
+    std::function<void()> onWritten;
 };
 
 std::map<Mode, const char*> ModePrompt{
@@ -93,14 +92,13 @@ std::map<Mode, const char*> ModePrompt{
     {Mode::Quit, "Quitting"},
 };
 
-struct View
+struct View : PickState
 {
     Term& term;
     Options& opts;
     DobbyType HWdobbyType = DobbyType::Positive;
 
     draft& draftContent;
-    int currentPick = 0, nextPick = 1;
     bool pickSent = true;
     std::string pickValue;
     int parenLevel = 0;
@@ -111,45 +109,84 @@ struct View
     
     std::string loomOutput;
     Arms loomState = Arms::Unknown;
+    Jitter::clock::time_point armsDownAt;
+    int AVLstate = 1;
+    bool atLeastOnce = false;
+    bool doAdvancePick = false;
+    
+    std::deque<LoomMessage> outbound;
+    size_t outboundSent = 0;        // bytes of outbound.front() already written
+    bool awaitingReady = false;
+    std::function<void()> readyContinuation;
+    Jitter::clock::time_point readyWaitStart;
+    bool draining = false;
 
-    Mode mode = Mode::Weave;
-    Mode oldMode = Mode::Weave;
-    int oldPick = -1;
-    bool weaveForward = true;
+    Jitter jitter;
+    PickStats pickStats;
     
-    LogDirection logdirn = LogDirection::Unknown;
+    // Loom and screen updates requested while handling a batch of terminal
+    // events, applied once the whole batch has been handled
+    bool sendPending = false;
+    bool promptPending = false;
+    bool redrawPending = false;     // redraw the pick line too
+    Jitter::clock::time_point lastRedraw;
+    uint64_t eventCount = 0, batchCount = 0, sendsFolded = 0, redrawsFolded = 0;
     
     View(Term& t, Options& o)
-    : term(t), opts(o), draftContent(*o.draftContents),
-      currentPick(o.pick - 2), nextPick(o.pick - 1)
+    : PickState(o.picks, o.treadleThreading, o.draftContents->ends),
+      term(t), opts(o), draftContent(*o.draftContents),
+      pickStats(o.compuDobbyGen == 4, o.latencyBudget)
     {
+        currentPick = o.pick - 2;
+        nextPick = o.pick - 1;
         if (currentPick < 0)
             currentPick += (int)opts.picks.size();
+        if (opts.realtime)
+            loomOutput.reserve(4096);   // pre-fault before the first shed
     }
     
+    void handleEvents();
     void handleEvent(const Term::Event& ev);
     bool handleGlobalEvent(const Term::Event& ev);
     bool handlePickEvent(const Term::Event& ev);
     bool handlePickEntryEvent(const Term::Event& ev);
     bool handlePickListEntryEvent(const Term::Event& ev);
+    bool handlePasteEvent(const Term::Event& ev);
     
     std::deque<Command> pendingCommands;
     void doCommand(Command cmd, bool deferPick = false);
+    void reducePendingCommands();
 
     void sendPick();
-    void sendToLoom(std::string_view msg, bool waitReady);
+    std::string encodePick(uint64_t lift) const;
+    void sendToLoom(std::string_view msg, bool waitReady, std::function<void()> onReady = {},
+                    std::function<void()> onWritten = {});
+    void flushToLoom();
+    void readyReceived();
+    void drainToLoom();
+    bool loomIdle() const { return outbound.empty() && !awaitingReady; }
     std::pair<uint64_t, color> calculateLift(int pick);
-    void advancePick(bool forward);
-    void setPick(int newPick);
     color displayPick();
     void colorCheck(color currentColor);
     void displayPrompt();
+    void requestSend();
+    void requestPrompt(bool redrawPick = false);
+    bool updatesPending() const { return sendPending || promptPending; }
+    void applyUpdates();
+    void reportFolding();
+    int resumePick() const { return currentPick >= 0 ? currentPick + 1 : oldPick + 1; }
+    void journalPick();
+    int selectLoom(fd_set& rdset, fd_set& wrset, Jitter::clock::duration timeout);
     int listenToLoom();
+    void processLoomOutput();
+    void processLoomLine(const std::string& loomLine);
+    void setAVLstate(int state);
+    void weave();
+    void reportSession();
     void run();
     
-    ssize_t readLoom(char &c);
+    ssize_t readLoom(char* buf, size_t len);
     ssize_t writeLoom(std::string_view msg);
-    void prettyPrint(char c);
     
     const char* toColor(const color& c)
     { return opts.ansi == ANSIsupport::no ? "" : Term::colorToStyle(c, opts.ansi == ANSIsupport::truecolor); }
@@ -157,6 +194,8 @@ struct View
     { return opts.ansi == ANSIsupport::no ? "" : Term::Style::bold; }
     const char* reset()
     { return opts.ansi == ANSIsupport::no ? "" : Term::Style::reset; }
+    void clearToEOL()
+    { if (opts.ansi != ANSIsupport::no) Term::clearToEOL(); else std::fflush(stdout); }
 };
 
 std::pair<uint64_t, color>
@@ -207,6 +246,7 @@ View::calculateLift(int pick)
 color
 View::displayPick()
 {
+    HotPath::Scope measured(HotPath::Section::Display);
     auto [lift, weftColor] = calculateLift(currentPick);
 
     // Output drawdown
@@ -247,7 +287,7 @@ View::displayPick()
     std::putchar('|');
     std::fputs(reset(), stdout);
 
-    Term::clearToEOL();
+    clearToEOL();
     std::fputs("\r\n", stdout);
     return weftColor;
 }
@@ -279,10 +319,11 @@ View::colorCheck(color currentColor)
 void
 View::displayPrompt()
 {
-    const char* menuPrefix = (loomState == Arms::Down && !opts.ascii) ?
+    bool plain = opts.ascii || opts.ansi == ANSIsupport::no;
+    const char* menuPrefix = (loomState == Arms::Down && !plain) ?
                                 Term::Style::inverse : "";
     const char* menuSuffix = loomState == Arms::Down ?
-                                (opts.ascii ? ")" : Term::Style::reset) : "";
+                                (plain ? ")" : Term::Style::reset) : "";
     auto menu = std::format("{0}T{1}abby  {0}L{1}iftplan  {0}R{1}everse  {0}S{1}elect pick  {0}P{1}ick list  {0}Q{1}uit   ", menuPrefix, menuSuffix);
     std::putchar('\r');
     switch (mode) {
@@ -313,7 +354,88 @@ View::displayPrompt()
             std::print("[{}] {}", ModePrompt[mode], menu);
             break;
     }
-    Term::clearToEOL();
+    clearToEOL();
+}
+
+void
+View::requestSend()
+{
+    if (sendPending)
+        ++sendsFolded;
+    sendPending = true;
+    requestPrompt();
+}
+
+void
+View::requestPrompt(bool redrawPick)
+{
+    if (promptPending)
+        ++redrawsFolded;
+    promptPending = true;
+    redrawPending = redrawPending || redrawPick;
+}
+
+// Sends the next pick and redraws the prompt if the terminal events just
+// handled asked for it. Redraws closer together than the redraw interval
+// are held back and folded into the next one.
+void
+View::applyUpdates()
+{
+    if (sendPending) {
+        sendPending = false;
+        if (loomState == Arms::Down)
+            sendPick();
+    }
+    if (!promptPending)
+        return;
+    
+    auto now = Jitter::clock::now();
+    if (now < lastRedraw + std::chrono::milliseconds(opts.redrawInterval))
+        return;
+    TraceScope traced(redrawPending ? "redraw" : "prompt", "display");
+    if (redrawPending) {
+        Term::moveCursorRel(-1, 0);
+        displayPick();
+    }
+    displayPrompt();
+    std::fflush(stdout);
+    promptPending = redrawPending = false;
+    lastRedraw = now;
+}
+
+void
+View::reportFolding()
+{
+    uint64_t eventsFolded = eventCount - batchCount;
+    if (eventsFolded == 0 && sendsFolded == 0 && redrawsFolded == 0)
+        return;
+    std::print("\r\n{} terminal events in {} batches: {} loom sends and {} redraws folded\r\n",
+               eventCount, batchCount, sendsFolded, redrawsFolded);
+}
+
+// Handles every terminal event that is already waiting before anything is
+// sent to the loom or redrawn, so that a burst of auto-repeated keys or
+// resizes costs at most one loom send and one redraw.
+void
+View::handleEvents()
+{
+    uint64_t count = 0;
+    do {
+        Term::Event ev;
+        {
+            HotPath::Scope measured(HotPath::Section::TermEvent);
+            ev = term.getEvent();
+        }
+        if (ev.type == Term::EventType::None)
+            break;
+        ++count;
+        handleEvent(ev);
+    } while (mode != Mode::Quit && term.pendingEvent());
+    
+    if (count) {
+        eventCount += count;
+        ++batchCount;
+    }
 }
 
 void
@@ -329,11 +451,11 @@ View::handleEvent(const Term::Event &ev)
                 return;
             break;
         case Mode::PickEntry:
-            if (handlePickEntryEvent(ev))
+            if (handlePasteEvent(ev) || handlePickEntryEvent(ev))
                 return;
             break;
         case Mode::PickListEntry:
-            if (handlePickListEntryEvent(ev))
+            if (handlePasteEvent(ev) || handlePickListEntryEvent(ev))
                 return;
             break;
         default:
@@ -351,6 +473,11 @@ View::handleGlobalEvent(const Term::Event& ev)
                     mode = Mode::Quit;
                     return true;
                     
+                case '\x14':      // control-t  - like BSD's SIGINFO
+                    std::print("\r\n{}\r\n", pickStats.statusLine());
+                    requestPrompt();
+                    return true;
+                    
                 case '\x0c':      // control-l  - like in vi!
                     displayPick();
                     if (loomState == Arms::Down)
@@ -359,7 +486,7 @@ View::handleGlobalEvent(const Term::Event& ev)
                     
                 case '\x1b':      // escape
                     mode = oldMode;
-                    displayPrompt();
+                    requestPrompt();
                     return true;
                     
                 default:
@@ -368,12 +495,9 @@ View::handleGlobalEvent(const Term::Event& ev)
             break;
         }
             
-        case Term::EventType::Resize: {
-            Term::moveCursorRel(-1, 0);
-            displayPick();
-            displayPrompt();
+        case Term::EventType::Resize:
+            requestPrompt(true);
             return true;
-        }
             
         default:
             break;
@@ -430,6 +554,26 @@ View::handlePickEvent(const Term::Event &ev)
     return false;
 }
 
+// Pasted text is entered as if it were typed, except that line endings do
+// not end the entry.
+bool
+View::handlePasteEvent(const Term::Event &ev)
+{
+    if (ev.type != Term::EventType::Paste)
+        return false;
+    
+    Mode entryMode = mode;
+    for (char c: ev.text) {
+        if (c == '\r' || c == '\n' || mode != entryMode)
+            continue;
+        Term::Event typed{};
+        typed.type = Term::EventType::Char;
+        typed.character = c;
+        handleEvent(typed);
+    }
+    return true;
+}
+
 bool
 View::handlePickEntryEvent(const Term::Event &ev)
 {
@@ -447,7 +591,7 @@ View::handlePickEntryEvent(const Term::Event &ev)
                 std::putchar('\a');
             } else {
                 pickValue.pop_back();
-                displayPrompt();
+                requestPrompt();
             }
             return true;
         }
@@ -494,13 +638,27 @@ View::handlePickListEntryEvent(const Term::Event &ev)
                 std::putchar('\a');
             } else {
                 pickValue.pop_back();
-                displayPrompt();
+                requestPrompt();
             }
             return true;
         }
         if (ev.character == '\r') {
+            if (parenLevel != 0) {
+                std::putchar('\a');
+                std::fflush(stdout);
+                return true;
+            }
+            // Parse now so that errors are reported even if the command is queued
+            Command cmd{Commands::DoSetPickList};
             mode = Mode::Weave;
-            doCommand({Commands::DoSetPickList});
+            try {
+                cmd.picks = opts.parsePickList(pickValue, draftContent.picks);
+            } catch (std::exception& e) {
+                std::print("\r\n\a{}{}{}\r\n", bold(), e.what(), reset());
+                requestPrompt();
+                return true;
+            }
+            doCommand(std::move(cmd));
             return true;
         }
     }
@@ -519,209 +677,181 @@ View::doCommand(Command cmd, bool deferPick)
         mode = Mode::Quit;
         return;
     }
+    auto traceName = CommandNames.find(cmd.command);
+    TraceScope traced(traceName != CommandNames.end() ? traceName->second : "Enter pick",
+                      "command", "argument", cmd.argument);
     
     if (auto cmdName = CommandNames.find(cmd.command);
         loomState != Arms::Down && cmdName != CommandNames.end())
     {
         std::print(" {} command queued.\r\n", cmdName->second);
-        displayPrompt();
         std::fflush(stdout);
+        requestPrompt();
         
         if (cmd.command == Commands::AdvancePick && !pendingCommands.empty() &&
-            pendingCommands.front().command == Commands::AdvancePick)
+            pendingCommands.back().command == Commands::AdvancePick)
         {   // Merge together AdvancePick commands
-            pendingCommands.front().argument += cmd.argument;
+            pendingCommands.back().argument += cmd.argument;
         } else {
-            pendingCommands.push_front(cmd);
+            pendingCommands.push_back(std::move(cmd));
         }
         return;
     }
     
     switch (cmd.command) {
-        case Commands::Null:
-        case Commands::Quit:
-            break;      // already handled
-        case Commands::Tabby:
-            if (opts.treadleThreading) {
-                std::putchar('\a');
-                std::fflush(stdout);
-                return;
-            }
-            if (mode == Mode::Tabby) return;
-            mode = Mode::Tabby;
-            oldPick = nextPick;
-            nextPick = weaveForward ? TabbyA : TabbyB;
-            if (!deferPick) {
-                sendPick();
-                displayPrompt();
-            }
-            break;
-        case Commands::Liftplan:
-            if (opts.treadleThreading) {
-                std::putchar('\a');
-                std::fflush(stdout);
-                return;
-            }
-            if (mode == Mode::Weave) return;
-            mode = Mode::Weave;
-            nextPick = oldPick;
-            if (!deferPick) {
-                sendPick();
-                displayPrompt();
-            }
-            break;
-        case Commands::Reverse:
-            weaveForward = !weaveForward;
-            nextPick = currentPick;
-            advancePick(true);
-            if (!deferPick) {
-                sendPick();
-                displayPrompt();
-            }
-            break;
-        case Commands::AdvancePick:
-            if (cmd.argument == 0)
-                return;
-            for (int i = 0; i < std::abs(cmd.argument); ++i)
-                advancePick(cmd.argument > 0);
-            if (!deferPick) {
-                sendPick();
-                displayPrompt();
-            }
-            break;
         case Commands::SetPick:
             oldMode = mode;
             mode = Mode::PickEntry;
             pickValue.clear();
-            displayPrompt();
+            requestPrompt();
             break;
         case Commands::SetPickList:
             oldMode = mode;
             mode = Mode::PickListEntry;
             pickValue.clear();
             parenLevel = 0;
-            displayPrompt();
+            requestPrompt();
             break;
-        case Commands::DoSetPick:
-            if (cmd.argument > 0) {
-                nextPick = cmd.argument - 1;
-                mode = Mode::Weave;
-                if (!deferPick) {
-                    sendPick();
-                    displayPrompt();
-                }
-            } else {
-                if (!deferPick) {
-                    mode = oldMode;
-                    displayPrompt();
-                }
-            }
-            break;
-        case Commands::DoSetPickList:
-            if (parenLevel != 0) {
-                std::putchar('\a');
-                std::fflush(stdout);
-                return;
-            }
-            try {
-                opts.parsePicks(pickValue, draftContent.picks);
-                nextPick = 0;       // Current pick is from old pick list
-                currentPick = -10;  // it is meaningless in new pick list
-                mode = Mode::Weave;
-                if (!deferPick)
-                    sendPick();
-            } catch (std::exception& e) {
-                std::print("\r\n\a{}{}{}\r\n", bold(), e.what(), reset());
+        default:
+            switch (apply(cmd, deferPick)) {
+                case Change::Refused:
+                    std::putchar('\a');
+                    std::fflush(stdout);
+                    break;
+                case Change::None:
+                    break;
+                case Change::Mode:
+                    if (!deferPick)
+                        requestPrompt();
+                    break;
+                case Change::Pick:
+                    if (!deferPick)
+                        requestSend();
+                    break;
             }
-            if (!deferPick)
-                displayPrompt();
             break;
     }
 }
 
 void
-View::setPick(int newPick)
+View::reducePendingCommands()
 {
-    nextPick = newPick;
-    int psize = opts.treadleThreading ? draftContent.ends : (int)opts.picks.size();
-    if (nextPick >= 9999)
-        nextPick -= (nextPick / psize) * psize;
-    while (nextPick < 0)
-        nextPick += psize;
+    pendingCommands = reduceCommands(std::move(pendingCommands), opts.treadleThreading);
 }
 
 void
-View::advancePick(bool forward)
+View::sendToLoom(std::string_view msg, bool waitReady, std::function<void()> onReady,
+                 std::function<void()> onWritten)
 {
-    switch (mode) {
-        case Mode::Weave:
-                                    //   VV     logical XNOR
-            setPick(nextPick + ((forward == weaveForward) ? 1 : -1));
-            break;
-        case Mode::Tabby:
-            nextPick = nextPick == TabbyA ? TabbyB : TabbyA;
-            break;
-        default:
-            break;
-    }
+    outbound.push_back({std::string(msg), waitReady && opts.compuDobbyGen == 4,
+                        std::move(onReady), std::move(onWritten)});
+    flushToLoom();
 }
 
+// Writes as much of the outbound queue as the loom will take without
+// blocking. The rest is written when the event loop sees the loom is writable.
 void
-View::sendToLoom(std::string_view msg, bool waitReady)
+View::flushToLoom()
 {
-    while (!msg.empty())
-    {
-        auto result = writeLoom(msg);
-        if (result >= 0) {
-            if (result == 0) std::putchar('>');
-            // sent partial or all the remaining data
-            msg.remove_prefix((size_t)result);
-        } else {
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-                timeval tv = {};
-                fd_set wrfds = {};
-                fd_set rdfds = {};
-                int selectresult;
-                
-                tv.tv_sec = term.pendingEvent() ? 0 : 1;
-                FD_ZERO(&wrfds);
-                FD_ZERO(&rdfds);
-                std::putchar('>');
-                std::fflush(stdout);
-                FD_SET(opts.loomDeviceFD, &wrfds);
-                FD_SET(STDIN_FILENO, &rdfds);
-                selectresult = ::select(opts.loomDeviceFD + 1, &rdfds, &wrfds, nullptr, &tv);
-                if (selectresult == -1 && errno != EINTR)
-                    throw make_system_error("loom select failed");
-                if (FD_ISSET(STDIN_FILENO, &rdfds) || term.pendingEvent()) {
-                    Term::Event ev = term.getEvent();
-                    if (ev.type != Term::EventType::None)
-                        handleEvent(ev);
+    while (!outbound.empty() && !awaitingReady) {
+        LoomMessage& msg = outbound.front();
+        std::string_view remaining(msg.text);
+        remaining.remove_prefix(outboundSent);
+        if (!remaining.empty()) {
+            auto result = writeLoom(remaining);
+            if (result < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    eventTrace.instant("loom write blocked", "loom", "bytes", (int64_t)remaining.size());
+                    std::putchar('>');
+                    std::fflush(stdout);
+                    return;
                 }
-            } else {
-                // from the write
                 throw make_system_error("loom write failed");
             }
-        }
-    }
-    if (opts.compuDobbyGen == 4 && waitReady) {
-        while (mode != Mode::Quit) {
-            listenToLoom();
-            if (loomOutput.contains("<ready>")) {
-                return;
-            }
-            if (loomOutput.contains("<what>")) {
-                std::print("\nloom protocol confusion\n");
+            if (result == 0) std::putchar('>');
+            // sent partial or all the remaining data
+            outboundSent += (size_t)result;
+            if (outboundSent < msg.text.length())
                 return;
-            }
         }
+        
+        outboundSent = 0;
+        if (msg.onWritten)
+            msg.onWritten();
+        if (msg.waitReady) {
+            awaitingReady = true;
+            readyWaitStart = Jitter::clock::now();
+            readyContinuation = std::move(msg.onReady);
+        } else if (msg.onReady) {
+            auto then = std::move(msg.onReady);
+            outbound.pop_front();
+            then();
+            continue;
+        }
+        outbound.pop_front();
+    }
+}
+
+void
+View::readyReceived()
+{
+    if (!awaitingReady)
+        return;
+    awaitingReady = false;
+    eventTrace.complete("wait for ready", "loom", readyWaitStart, Jitter::clock::now());
+    if (readyContinuation) {
+        auto then = std::move(readyContinuation);
+        readyContinuation = nullptr;
+        then();
+    }
+    flushToLoom();
+}
+
+// Runs the event loop without user input until everything queued for the
+// loom has been written and acknowledged, or the loom stops responding.
+void
+View::drainToLoom()
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    draining = true;
+    while (!loomIdle() && std::chrono::steady_clock::now() < deadline) {
+        listenToLoom();
+        processLoomOutput();
     }
+    draining = false;
 }
 
 void
 View::sendPick()
 {
-    auto [lift, weftColor] = calculateLift(nextPick);
+    uint64_t lift;
+    std::string command;
+    {
+        HotPath::Scope measured(HotPath::Section::Lift);
+        lift = calculateLift(nextPick).first;
+        command = encodePick(lift);
+    }
+    pickStats.mark(PickStats::Step::Lift);
+
+    if (opts.compuDobbyGen == 4) {
+        if (pickSent)
+            sendToLoom("clear\r", true);
+        if (lift == 0)
+            return;
+        pickSent = true;
+    }
+
+    std::function<void()> onReady;
+    if (opts.compuDobbyGen == 4)
+        onReady = [this]{ if (pickStats.mark(PickStats::Step::Ready)) requestPrompt(); };
+    sendToLoom(command, true, std::move(onReady),
+               [this]{ if (pickStats.mark(PickStats::Step::Written)) requestPrompt(); });
+}
+
+// The loom command that raises the shafts in lift
+std::string
+View::encodePick(uint64_t lift) const
+{
     std::string command;
 
     if (opts.compuDobbyGen < 4) {
@@ -733,11 +863,7 @@ View::sendPick()
         }
         command.push_back('\x07');
     } else {
-        if (pickSent)
-            sendToLoom("clear\r", true);
         bool first = true;
-        if (lift == 0)
-            return;
         command = "pick ";
         for (int shaft = 1; lift; lift >>= 1, ++shaft)
             if (lift & 1) {
@@ -746,37 +872,74 @@ View::sendPick()
                 first = false;
             }
         command.push_back('\r');
-        pickSent = true;
     }
-    sendToLoom(command, true);
+    return command;
+}
+
+int
+View::selectLoom(fd_set& rdset, fd_set& wrset, Jitter::clock::duration timeout)
+{
+    auto deadline = Jitter::clock::now() + timeout;
+    while (true) {
+        FD_ZERO(&rdset);
+        FD_ZERO(&wrset);
+        if (!draining)
+            FD_SET(term.inputFD(), &rdset);
+        FD_SET(opts.loom->readFD(), &rdset);
+        if (!outbound.empty() && !awaitingReady)
+            FD_SET(opts.loom->writeFD(), &wrset);
+
+        auto start = Jitter::clock::now();
+        auto wait = std::max(deadline - start, Jitter::clock::duration::zero());
+        if (opts.realtime && wait > JitterTick)
+            wait = JitterTick;
+        auto usecs = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+        timeval tv{(time_t)(usecs / 1000000), (suseconds_t)(usecs % 1000000)};
+
+        int maxFD = std::max({opts.loom->readFD(), opts.loom->writeFD(), term.inputFD()});
+        int nfds = ::select(maxFD + 1, &rdset, &wrset, nullptr, &tv);
+        if (nfds != 0 || !opts.realtime)
+            return nfds;
+
+        auto end = Jitter::clock::now();
+        if (wait > Jitter::clock::duration::zero())
+            jitter.record(wait, end - start);
+        if (end >= deadline)
+            return 0;
+    }
 }
 
 int
 View::listenToLoom()
 {
-    fd_set rdset;
-    char c;
-    FD_SET(STDIN_FILENO, &rdset);
-    FD_SET(opts.loomDeviceFD, &rdset);
-    timeval threesec{term.pendingEvent() || !loomOutput.empty() ? 0 : 3, 0};
-    
-    int nfds = ::select(opts.loomDeviceFD + 1, &rdset, nullptr, nullptr, &threesec);
+    fd_set rdset, wrset;
+    Jitter::clock::duration timeout = LoomTimeout;
+    if (term.pendingEvent() && !draining)
+        timeout = Jitter::clock::duration::zero();
+    else if (promptPending && !draining)    // held back by the redraw interval
+        timeout = std::min(timeout, std::max(Jitter::clock::duration::zero(),
+            lastRedraw + std::chrono::milliseconds(opts.redrawInterval) - Jitter::clock::now()));
+    int nfds = selectLoom(rdset, wrset, timeout);
     
     if (nfds == -1 && errno != EINTR)
         throw make_system_error("select failed");
 
-    if (FD_ISSET(STDIN_FILENO, &rdset) || term.pendingEvent() || nfds == -1) {
-        Term::Event ev = term.getEvent();
-        if (ev.type != Term::EventType::None)
-            handleEvent(ev);
+    if (nfds > 0 && FD_ISSET(opts.loom->writeFD(), &wrset))
+        flushToLoom();
+
+    if (!draining && (FD_ISSET(term.inputFD(), &rdset) || term.pendingEvent() || nfds == -1)) {
+        handleEvents();
         if (mode == Mode::Quit)
             return nfds;
     }
+    if (!draining)
+        applyUpdates();
     
-    if (FD_ISSET(opts.loomDeviceFD, &rdset)) {
-        int count = 0;
+    if (nfds > 0 && FD_ISSET(opts.loom->readFD(), &rdset)) {
+        char buf[256];
+        ssize_t count = 0;
         while (true) {
-            auto n = readLoom(c);
+            auto n = readLoom(buf, sizeof(buf));
             if (n < 0) {
                 if (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK)
                     break;
@@ -788,33 +951,29 @@ View::listenToLoom()
                     throw std::runtime_error("\r\nLoom connection was closed.");
                 break;
             }
-            if (opts.compuDobbyGen == 4) {
-                if (c == '\r' || c == '\n')
-                    continue;
-                c = (char)std::tolower((int)c);
+            for (ssize_t i = 0; i < n; ++i) {
+                char c = buf[i];
+                if (opts.compuDobbyGen == 4) {
+                    if (c == '\r' || c == '\n')
+                        continue;
+                    c = (char)std::tolower((int)c);
+                }
+                loomOutput.push_back(c);
             }
-            loomOutput.push_back(c);
-            ++count;
+            count += n;
         };
     }
     
-    if (opts.compuDobbyGen == 4 && loomOutput.starts_with("<error"))
-        make_system_error({loomOutput});
     return nfds;
 }
 
 ssize_t
-View::readLoom(char &c)
+View::readLoom(char* buf, size_t len)
 {
-    ssize_t n = ::read(opts.loomDeviceFD, &c, 1);
+    ssize_t n = opts.loom->read(buf, len);
     
-    if (n == 1 && opts.logFile) {
-        if (logdirn != LogDirection::Reading) {
-            std::fputs("\nloom: ", opts.logFile);
-            logdirn = LogDirection::Reading;
-        }
-        prettyPrint(c);
-    }
+    if (n > 0 && opts.loomLog)
+        opts.loomLog->record(LoomLogRecord::Read, buf, (size_t)n);
 
     return n;
 }
@@ -822,60 +981,185 @@ View::readLoom(char &c)
 ssize_t
 View::writeLoom(std::string_view msg)
 {
-    ssize_t n = ::write(opts.loomDeviceFD, msg.data(), msg.length());
+    TraceScope traced("loom write", "loom", "bytes", (int64_t)msg.length());
+    ssize_t n = opts.loom->write(msg.data(), msg.length());
     
-    if (n > 0 && opts.logFile) {
-        if (logdirn != LogDirection::Writing) {
-            std::fputs("\ndrawboy: ", opts.logFile);
-            logdirn = LogDirection::Writing;
-        }
-        for (size_t i = 0; i < (size_t)n; ++i)
-            prettyPrint(msg[i]);
-    }
+    if (n > 0 && opts.loomLog)
+        opts.loomLog->record(LoomLogRecord::Write, msg.data(), (size_t)n);
 
     return n;
 }
 
+// Hands the pick just woven to the journal, which writes it in the background
 void
-View::prettyPrint(char c)
+View::journalPick()
 {
-    if (opts.compuDobbyGen < 4) {
-        std::print(opts.logFile, "{:#04x}", (int)c);
-    } else {
-        if (std::isprint((int)c) && c != '\\') {
-            std::fputc((int)c, opts.logFile);
-        } else {
-            switch (c) {
-                case '\r':
-                    std::fputs("\\r", opts.logFile);
-                    break;
-                case '\n':
-                    std::fputs("\\n", opts.logFile);
-                    break;
-                case '\\':
-                    std::fputs("\\\\", opts.logFile);
-                    break;
-                default:
-                    std::print(opts.logFile, "\\x{:02x}", (int)c);
-                    break;
-            }
-        }
-    }
+    if (!opts.journal)
+        return;
+    JournalRecord rec{};
+    rec.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    rec.draftHash = opts.draftHash;
+    rec.resumePick = resumePick();
+    rec.pickIndex = currentPick;
+    rec.draftPick = currentPick < 0 ? currentPick : opts.picks[(size_t)currentPick % opts.picks.size()];
+    rec.forward = weaveForward;
+    rec.mode = (uint8_t)mode;
+    opts.journal->record(rec);
 }
 
 void
-View::run()
+View::processLoomOutput()
 {
-    // Drain input queue
-    char c;
     char termChar = opts.compuDobbyGen < 4 ? '\x03' : '>';
+    for (auto termPos = loomOutput.find(termChar); termPos != std::string::npos;
+         termPos = loomOutput.find(termChar))
+    {
+        std::string loomLine(loomOutput.begin(), loomOutput.begin() + (ssize_t)termPos + 1);
+        loomOutput.erase(0, termPos + 1);
+        processLoomLine(loomLine);
+        std::fflush(stdout);
+    }
+}
+
+void
+View::processLoomLine(const std::string& loomLine)
+{
     const char* armsDown = opts.compuDobbyGen < 4 ? "\x62\x03" : "<down>";
     const char* armsUp = opts.compuDobbyGen < 4 ? "\x61\x03" : "<up>";
     const char* armsNeutral = "<arm null>";    // CD IV only
+
+    if (opts.compuDobbyGen == 4) {
+        if (loomLine == "<ready>") {
+            readyReceived();
+            return;
+        }
+        if (loomLine == "<what>") {
+            std::print("\nloom protocol confusion\n");
+            readyReceived();
+            return;
+        }
+        // The loom refused the last command but is still listening, so
+        // carry on as after <what>
+        if (loomLine.starts_with("<error")) {
+            std::print("\r\nLoom reported an error: {}\r\n", loomLine);
+            readyReceived();
+            return;
+        }
+    }
+    if (draining)
+        return;
+
+    switch (AVLstate) {
+        case 1:
+            // waiting for reset, sending first pick
+            if (opts.compuDobbyGen < 4 && loomLine == "\x7f\x03") {
+                opts.tabbyA &= ((1ull << opts.maxShafts) - 1);
+                opts.tabbyB &= ((1ull << opts.maxShafts) - 1);
+                setAVLstate(3);
+            } else if (opts.compuDobbyGen == 4 && loomLine.starts_with("<compu-dobby iv,")) {
+                static const std::set<int> legalShafts = {4, 8, 12, 16, 20, 24, 28, 32, 36, 40};
+                if (loomLine.contains("neg dobby"))
+                    HWdobbyType = DobbyType::Negative;
+                if (loomLine.contains("pos dobby"))
+                    HWdobbyType = DobbyType::Positive;
+                if (opts.virtualPositive) {
+                    opts.dobbyType = DobbyType::Positive;
+                    if (HWdobbyType == DobbyType::Positive)
+                        std::puts("User specifies virtual positive dobby, but the loom claims to be actually positive dobby.\r\n");
+                } else {
+                    if (opts.dobbyType != DobbyType::Unspecified && opts.dobbyType != HWdobbyType)
+                        std::print("\r\nUser says this is a {} dobby, but the loom claims to be a {} dobby.\r\n",
+                                   dobbyName[opts.dobbyType], dobbyName[HWdobbyType]);
+                    opts.dobbyType = HWdobbyType;
+                }
+                auto fcres = std::from_chars(loomLine.data() + 17, loomLine.data() + 19, opts.maxShafts, 10);
+                if (fcres.ec != std::errc() || !legalShafts.contains(opts.maxShafts))
+                    throw std::runtime_error("Illegal shaft count in loom greeting.");
+                if (opts.draftContents->maxShafts > opts.maxShafts)
+                    throw std::runtime_error("Draft file requires more shafts than the loom possesses.");
+                opts.tabbyA &= ((1ull << opts.maxShafts) - 1);
+                opts.tabbyB &= ((1ull << opts.maxShafts) - 1);
+                std::print("\r\nGreeting received: {} shafts, {} dobby\r\n",
+                    opts.maxShafts,
+                    opts.virtualPositive ? dobbyName[DobbyType::Virtual] :
+                           dobbyName[opts.dobbyType]);
+                setAVLstate(2);
+            } else {
+                //std::fputs(" ?", stdout);
+                std::print("\r\n??{}\r\n", loomLine);
+            }
+            break;
+        case 2:
+            if (loomLine == "<password:>") {
+                // Handshake is done once the loom accepts the password
+                sendToLoom("chico\r", true, [this]{ setAVLstate(3); });
+                std::putchar('\n');
+            } else {
+                std::fputs(" ?", stdout);
+            }
+            break;
+        case 3:
+            // process switch (5 or nothing), arm up (4) or arm down (7)
+            if (loomLine == armsDown && loomState != Arms::Down) {
+                // Shed is open, OK to send to solenoids
+                pickStats.mark(PickStats::Step::Down);
+                armsDownAt = Jitter::clock::now();
+                loomState = Arms::Down;
+                pickSent = false;
+                if (pendingCommands.empty() && doAdvancePick)
+                    advancePick(true);
+                reducePendingCommands();
+                for (auto& cmd: pendingCommands)
+                    doCommand(std::move(cmd), true);
+                pendingCommands.clear();
+                sendPick();
+                displayPrompt();
+                doAdvancePick = true;
+                atLeastOnce = true;
+            }
+            if (loomLine == armsUp && loomState != Arms::Up) {
+                // Shed is closed, next shed is fixed
+                pickStats.mark(PickStats::Step::Up);
+                if (loomState == Arms::Down)
+                    eventTrace.complete("shed open", "loom", armsDownAt, Jitter::clock::now(),
+                                        "pickIndex", nextPick);
+                loomState = Arms::Up;
+                currentPick = nextPick;
+                colorCheck(displayPick());
+                displayPrompt();
+                pickStats.mark(PickStats::Step::Shown);
+                journalPick();
+            }
+            if (loomLine == armsNeutral) {
+                loomState = Arms::Unknown;
+                displayPrompt();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Moves the handshake along. Once it is done the loom is ready to weave.
+void
+View::setAVLstate(int state)
+{
+    AVLstate = state;
+    eventTrace.instant("handshake state", "handshake", "state", state);
+    if (state == 3)
+        startupProfile.finish();
+}
+
+void
+View::weave()
+{
+    // Drain input queue
+    char buf[256];
     const char* loomReset = opts.compuDobbyGen < 4 ? "\x0f\x03" : "\r";
 
     while (true) {
-        auto n = readLoom(c);
+        auto n = readLoom(buf, sizeof(buf));
         if (n < 0) {
             if (errno == EINTR)
                 continue;
@@ -889,111 +1173,21 @@ View::run()
     }
     
     sendToLoom(loomReset, false);
-    
-    int AVLstate = 1;
-    bool atLeastOnce = false;
-    bool doAdvancePick = false;
 
     while (mode != Mode::Quit) {
         int nfds = listenToLoom();
 
         if (nfds == 0 && AVLstate == 1) {
-            sendToLoom(loomReset, false);
+            if (loomIdle())
+                sendToLoom(loomReset, false);
             std::putchar('.');
         }
 
-        if (loomOutput.empty())
-            continue;
-        
-        if (auto termPos = loomOutput.find(termChar); termPos != std::string::npos) {
-            std::string loomLine(loomOutput.begin(), loomOutput.begin() + (ssize_t)termPos + 1);
-            loomOutput.erase(0, termPos + 1);
-            switch (AVLstate) {
-                case 1:
-                    // waiting for reset, sending first pick
-                    if (opts.compuDobbyGen < 4 && loomLine == "\x7f\x03") {
-                        opts.tabbyA &= ((1ull << opts.maxShafts) - 1);
-                        opts.tabbyB &= ((1ull << opts.maxShafts) - 1);
-                        AVLstate = 3;
-                    } else if (opts.compuDobbyGen == 4 && loomLine.starts_with("<compu-dobby iv,")) {
-                        static const std::set<int> legalShafts = {4, 8, 12, 16, 20, 24, 28, 32, 36, 40};
-                        if (loomLine.contains("neg dobby"))
-                            HWdobbyType = DobbyType::Negative;
-                        if (loomLine.contains("pos dobby"))
-                            HWdobbyType = DobbyType::Positive;
-                        if (opts.virtualPositive) {
-                            opts.dobbyType = DobbyType::Positive;
-                            if (HWdobbyType == DobbyType::Positive)
-                                std::puts("User specifies virtual positive dobby, but the loom claims to be actually positive dobby.\r\n");
-                        } else {
-                            if (opts.dobbyType != DobbyType::Unspecified && opts.dobbyType != HWdobbyType)
-                                std::print("\r\nUser says this is a {} dobby, but the loom claims to be a {} dobby.\r\n",
-                                           dobbyName[opts.dobbyType], dobbyName[HWdobbyType]);
-                            opts.dobbyType = HWdobbyType;
-                        }
-                        auto fcres = std::from_chars(loomLine.data() + 17, loomLine.data() + 19, opts.maxShafts, 10);
-                        if (fcres.ec != std::errc() || !legalShafts.contains(opts.maxShafts))
-                            throw std::runtime_error("Illegal shaft count in loom greeting.");
-                        if (opts.draftContents->maxShafts > opts.maxShafts)
-                            throw std::runtime_error("Draft file requires more shafts than the loom possesses.");
-                        opts.tabbyA &= ((1ull << opts.maxShafts) - 1);
-                        opts.tabbyB &= ((1ull << opts.maxShafts) - 1);
-                        std::print("\r\nGreeting received: {} shafts, {} dobby\r\n",
-                            opts.maxShafts,
-                            opts.virtualPositive ? dobbyName[DobbyType::Virtual] :
-                                   dobbyName[opts.dobbyType]);
-                        AVLstate = 2;
-                    } else {
-                        //std::fputs(" ?", stdout);
-                        std::print("\r\n??{}\r\n", loomLine);
-                    }
-                    break;
-                case 2:
-                    if (loomLine == "<password:>") {
-                        sendToLoom("chico\r", true);
-                        std::putchar('\n');
-                        AVLstate = 3;
-                    } else {
-                        std::fputs(" ?", stdout);
-                    }
-                    break;
-                case 3:
-                    // process switch (5 or nothing), arm up (4) or arm down (7)
-                    if (loomLine == armsDown && loomState != Arms::Down) {
-                        // Shed is open, OK to send to solenoids
-                        loomState = Arms::Down;
-                        pickSent = false;
-                        if (pendingCommands.empty() && doAdvancePick)
-                            advancePick(true);
-                        while (!pendingCommands.empty()) {
-                            doCommand(pendingCommands.back(), true);
-                            pendingCommands.pop_back();
-                        }
-                        sendPick();
-                        displayPrompt();
-                        doAdvancePick = true;
-                        atLeastOnce = true;
-                    }
-                    if (loomLine == armsUp && loomState != Arms::Up) {
-                        // Shed is closed, next shed is fixed
-                        loomState = Arms::Up;
-                        currentPick = nextPick;
-                        colorCheck(displayPick());
-                        displayPrompt();
-                    }
-                    if (loomLine == armsNeutral) {
-                        loomState = Arms::Unknown;
-                        displayPrompt();
-                    }
-                    break;
-                default:
-                    break;
-            }
-            std::fflush(stdout);
-        }
+        processLoomOutput();
     }
-    if (atLeastOnce) {
-        int cpick = currentPick >= 0 ? currentPick + 1 : oldPick + 1;
+    if (atLeastOnce && !opts.replay && !opts.dryRun) {
+        int cpick = resumePick();
+        journalPick();
         bool success = false;
         if (std::FILE* pickf{std::fopen(opts.pickFile.c_str(), "w")}) {
             try {
@@ -1018,16 +1212,113 @@ View::run()
         }
         sendToLoom("close\r", false);
     }
-    sleep(1);
+    drainToLoom();
+}
+
+// What was measured during the session, however it ended
+void
+View::reportSession()
+{
+    reportFolding();
+    if (opts.stats) {
+        pickStats.report();
+        hotPath.report();
+        opts.loom->report();
+    }
+    if (opts.realtime)
+        jitter.report();
+    startupProfile.finish();        // if the handshake never finished
+    if (opts.profileStartup)
+        startupProfile.report();
+    if (!opts.profileStartupJSON.empty())
+        startupProfile.writeJSON(opts.profileStartupJSON);
+    eventTrace.write();
+}
+
+void
+View::run()
+{
+    try {
+        weave();
+    } catch (...) {
+        // A closed connection or failed handshake is the session most worth
+        // reporting on. Report what can be, then pass the error on.
+        try {
+            reportSession();
+        } catch (...) { }
+        throw;
+    }
+    reportSession();
+    if (!opts.replay && !opts.dryRun)
+        sleep(1);
 }
 
 void driver(Options& opts)
 {
-    Term term(opts.ansi != ANSIsupport::no);
+    startupProfile.phase("terminal");
+    bool ansi = opts.ansi != ANSIsupport::no;
+    std::unique_ptr<Term> termOwner;
+    if (opts.replay)
+        termOwner = std::make_unique<Term>(ansi, opts.replay->inputFD());
+    else if (opts.dryRun)
+        termOwner = std::make_unique<Term>(ansi, opts.dryRun->inputFD());
+    else if (opts.script)
+        termOwner = std::make_unique<Term>(ansi, opts.script->inputFD());
+    else
+        termOwner = std::make_unique<Term>(ansi);
+    Term& term = *termOwner;
     
     if (!term.good())
         throw std::runtime_error("Could not open terminal.");
     
+    if (opts.loomLog) {
+        LoomLog* log = opts.loomLog.get();
+        term.inputTap = [log](const char* data, std::size_t length) {
+            log->record(LoomLogRecord::Input, data, length);
+        };
+    }
+    
+    if (opts.realtime)
+        enableRealtime(opts.realtimeCPU);
+    
     View view(term, opts);
+    startupProfile.phase("handshake");
+    if (opts.replay)
+        opts.replay->start();
+    if (opts.dryRun)
+        opts.dryRun->start();
+    if (opts.script)
+        opts.script->start();
     view.run();
+    if (opts.script)
+        opts.script->finish();
+    if (opts.replay)
+        opts.replay->finish();
+    if (opts.dryRun)
+        opts.dryRun->finish();
+}
+
+PickPath::PickPath(Term& term, Options& opts)
+: _view(std::make_unique<View>(term, opts))
+{ }
+
+PickPath::~PickPath() = default;
+
+uint64_t
+PickPath::lift(int pick)
+{
+    return _view->calculateLift(pick).first;
+}
+
+std::string
+PickPath::encode(int pick)
+{
+    return _view->encodePick(_view->calculateLift(pick).first);
+}
+
+void
+PickPath::display(int pick)
+{
+    _view->currentPick = pick;
+    _view->displayPick();
 }
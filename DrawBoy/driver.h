@@ -4,7 +4,29 @@
  */
 
 
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
 struct Options;
+class Term;
+struct View;
 
 void driver(Options& opts);
 
+// The work the driver does for each pick, outside of its event loop, for
+// drawboy-bench
+class PickPath {
+  public:
+    PickPath(Term& term, Options& opts);
+    ~PickPath();
+
+    uint64_t lift(int pick);            // lift calculation
+    std::string encode(int pick);       // the loom command for a pick
+    void display(int pick);             // draws the pick line on stdout
+
+  private:
+    std::unique_ptr<View> _view;
+};
@@ -0,0 +1,211 @@
+/*
+ *  dryrun.cpp
+ *  DrawBoy
+ */
+
+
+#include "dryrun.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <format>
+#include <functional>
+#include <print>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+// A loom that lives inside the driver's process and thread. Everything the
+// driver writes is answered immediately, and a new shed event is produced
+// each time the driver comes back to read after having caught up, so the
+// loom never makes the driver wait. Its descriptors are /dev/null, which
+// always selects as readable and writable.
+class SimulatedLoom : public LoomTransport {
+  public:
+    SimulatedLoom(int compuDobbyGen, int shafts, DobbyType dobbyType, uint64_t picks,
+                  std::function<void(uint64_t)> onDone);
+    ~SimulatedLoom() override;
+
+    int readFD() const override { return _fd; }
+    int writeFD() const override { return _fd; }
+
+  protected:
+    ssize_t doRead(char* buf, std::size_t len) override;
+    ssize_t doWrite(const char* buf, std::size_t len) override;
+
+  private:
+    void command(const std::string& cmd);
+    void nextEvent();
+
+    int _fd;
+    int _compuDobbyGen;
+    int _shafts;
+    DobbyType _dobbyType;
+    uint64_t _picks;
+    std::function<void(uint64_t)> _onDone;
+
+    std::string _received;          // partial command from the driver
+    std::string _output;            // waiting for the driver to read
+    bool _weaving = false;
+    bool _shedOpen = false;
+    bool _caughtUp = false;         // driver read everything since the last event
+    uint64_t _woven = 0;
+};
+
+SimulatedLoom::SimulatedLoom(int compuDobbyGen, int shafts, DobbyType dobbyType, uint64_t picks,
+                             std::function<void(uint64_t)> onDone)
+: LoomTransport("simulated"), _fd(::open("/dev/null", O_RDWR | O_CLOEXEC)),
+  _compuDobbyGen(compuDobbyGen), _shafts(shafts), _dobbyType(dobbyType), _picks(picks),
+  _onDone(std::move(onDone))
+{
+    if (_fd < 0)
+        throw make_system_error("Cannot open /dev/null for the simulated loom");
+}
+
+SimulatedLoom::~SimulatedLoom()
+{
+    ::close(_fd);
+}
+
+ssize_t
+SimulatedLoom::doRead(char* buf, std::size_t len)
+{
+    if (_output.empty()) {
+        if (_weaving && _caughtUp)
+            nextEvent();
+        if (_output.empty()) {
+            _caughtUp = true;
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    std::size_t n = std::min(len, _output.size());
+    _output.copy(buf, n);
+    _output.erase(0, n);
+    return (ssize_t)n;
+}
+
+ssize_t
+SimulatedLoom::doWrite(const char* buf, std::size_t len)
+{
+    for (std::size_t i = 0; i < len; ++i) {
+        _received.push_back(buf[i]);
+        bool end = _compuDobbyGen < 4 ? buf[i] == '\x03' || buf[i] == '\x07' : buf[i] == '\r';
+        if (end) {
+            command(_received);
+            _received.clear();
+        }
+    }
+    return (ssize_t)len;
+}
+
+void
+SimulatedLoom::command(const std::string& cmd)
+{
+    if (_compuDobbyGen < 4) {
+        if (cmd == "\x0f\x03") {            // solenoid reset
+            _output.append("\x7f\x03");
+            _weaving = true;
+        }
+        return;                             // picks and close are not answered
+    }
+
+    if (cmd == "\r") {
+        _output.append(std::format("<Compu-Dobby IV, {}H, {} Dobby, HW A.1, FW 0.1.0>\n\r<Password:>",
+                                   _shafts, _dobbyType == DobbyType::Negative ? "Neg" : "Pos"));
+    } else {
+        _output.append("<ready>");
+        if (cmd == "chico\r")
+            _weaving = true;
+    }
+}
+
+void
+SimulatedLoom::nextEvent()
+{
+    _caughtUp = false;
+    if (_woven == _picks) {
+        _weaving = false;
+        _onDone(_woven);
+        return;
+    }
+    if (_shedOpen) {
+        _output.append(_compuDobbyGen < 4 ? "\x61\x03" : "<up>");
+        ++_woven;
+    } else {
+        _output.append(_compuDobbyGen < 4 ? "\x62\x03" : "<down>");
+    }
+    _shedOpen = !_shedOpen;
+}
+
+}
+
+DryRun::DryRun(int compuDobbyGen, int shafts, DobbyType dobbyType, int passes, bool nullOutput)
+: _compuDobbyGen(compuDobbyGen), _shafts(shafts), _dobbyType(dobbyType), _passes(passes),
+  _nullOutput(nullOutput)
+{
+    if (::pipe(_input) != 0)
+        throw make_system_error("Cannot create dry run input");
+    ::fcntl(_input[0], F_SETFL, ::fcntl(_input[0], F_GETFL) | O_NONBLOCK);
+}
+
+DryRun::~DryRun()
+{
+    if (_savedStdout >= 0) {
+        std::fflush(stdout);
+        ::dup2(_savedStdout, STDOUT_FILENO);
+        ::close(_savedStdout);
+    }
+    for (int fd: _input)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+std::unique_ptr<LoomTransport>
+DryRun::loomTransport(std::size_t picksPerPass)
+{
+    return std::make_unique<SimulatedLoom>(_compuDobbyGen, _shafts, _dobbyType,
+                                           (uint64_t)_passes * picksPerPass,
+                                           [this](uint64_t picks) { _picks = picks; stop(); });
+}
+
+void
+DryRun::start()
+{
+    if (_nullOutput) {
+        std::fflush(stdout);
+        _savedStdout = ::dup(STDOUT_FILENO);
+        int null = ::open("/dev/null", O_WRONLY);
+        if (_savedStdout < 0 || null < 0)
+            throw make_system_error("Cannot discard dry run output");
+        ::dup2(null, STDOUT_FILENO);
+        ::close(null);
+    }
+    _start = clock::now();
+}
+
+void
+DryRun::stop()
+{
+    _end = clock::now();
+    _stopped = true;
+    if (_savedStdout >= 0) {
+        std::fflush(stdout);
+        ::dup2(_savedStdout, STDOUT_FILENO);
+        ::close(_savedStdout);
+        _savedStdout = -1;
+    }
+    // Quit as if the weaver had typed control-c
+    [[maybe_unused]] auto n = ::write(_input[1], "\x03", 1);
+}
+
+void
+DryRun::finish()
+{
+    if (!_stopped)
+        return;
+    double secs = std::chrono::duration<double>(_end - _start).count();
+    std::print("\r\nDry run: {} picks in {:.3f}s, {:.0f} picks/s{}\r\n", _picks, secs,
+               secs > 0.0 ? (double)_picks / secs : 0.0, _nullOutput ? ", screen output discarded" : "");
+}
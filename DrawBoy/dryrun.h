@@ -0,0 +1,48 @@
+/*
+ *  dryrun.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include "argscommon.h"
+#include "loomtransport.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Weaves the pick list a number of times against a simulated loom that
+// answers the handshake and every command at once and opens and closes the
+// shed as soon as the driver has handled the previous event, so the driver's
+// own work is all that is timed. Screen output can be discarded to measure
+// the driver without the cost of drawing.
+class DryRun {
+  public:
+    DryRun(int compuDobbyGen, int shafts, DobbyType dobbyType, int passes, bool nullOutput);
+    ~DryRun();
+
+    std::unique_ptr<LoomTransport> loomTransport(std::size_t picksPerPass);
+    int inputFD() const { return _input[0]; }
+
+    void start();
+    void finish();
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    void stop();                    // the last pick is done
+
+    int _compuDobbyGen;
+    int _shafts;
+    DobbyType _dobbyType;
+    int _passes;
+    bool _nullOutput;
+    int _input[2] = {-1, -1};       // driver reads, simulated weaver writes
+    int _savedStdout = -1;
+
+    uint64_t _picks = 0;
+    clock::time_point _start;
+    clock::time_point _end;
+    bool _stopped = false;
+};
@@ -27,7 +27,7 @@ std::string_view currentline(std::string& line)
 }
 
 bool
-seekSection(std::ifstream& dtxstream, const char* name)
+seekSection(std::istream& dtxstream, const char* name)
 {
     dtxstream.clear();
     dtxstream.seekg(0);
@@ -46,7 +46,7 @@ seekSection(std::ifstream& dtxstream, const char* name)
 }
 
 std::set<std::string>
-readContentsToSet(std::ifstream& dtxstream)
+readContentsToSet(std::istream& dtxstream)
 {
     std::set<std::string> contents;
     if (!seekSection(dtxstream, "Contents"))
@@ -63,7 +63,7 @@ readContentsToSet(std::ifstream& dtxstream)
 }
 
 std::map<std::string, int>
-readInfoToMap(std::ifstream& dtxstream)
+readInfoToMap(std::istream& dtxstream)
 {
     std::map<std::string, int> infomap;
     if (!seekSection(dtxstream, "Info"))
@@ -86,7 +86,7 @@ readInfoToMap(std::ifstream& dtxstream)
 }
 
 std::vector<color>
-ReadColorPalettte(std::ifstream& dtxstream)
+ReadColorPalettte(std::istream& dtxstream)
 {
     std::vector<color> palette;
     if (seekSection(dtxstream, "Color Palet")) {
@@ -116,7 +116,7 @@ ReadColorPalettte(std::ifstream& dtxstream)
 }
 
 std::vector<color>
-readColorSection(std::ifstream& dtxstream, const char* name, const std::vector<color>& palette)
+readColorSection(std::istream& dtxstream, const char* name, const std::vector<color>& palette)
 {
     std::vector<color> colors;
     if (!seekSection(dtxstream, name))
@@ -144,7 +144,7 @@ readColorSection(std::ifstream& dtxstream, const char* name, const std::vector<c
 }
 
 std::vector<uint64_t>
-readSectiontoVector(std::ifstream& dtxstream, const char* name)
+readSectiontoVector(std::istream& dtxstream, const char* name)
 {
     std::vector<uint64_t> ret;
     if (!seekSection(dtxstream, name))
@@ -180,7 +180,7 @@ readSectiontoVector(std::ifstream& dtxstream, const char* name)
 }
 
 std::vector<uint64_t>
-readTieup(std::ifstream& dtxstream, bool& rising)
+readTieup(std::istream& dtxstream, bool& rising)
 {
     std::vector<uint64_t> tieup;
     if (!seekSection(dtxstream, "Tieup"))
@@ -211,7 +211,7 @@ readTieup(std::ifstream& dtxstream, bool& rising)
 }
 
 std::vector<uint64_t>
-readLiftplan(std::ifstream& dtxstream, bool& rising)
+readLiftplan(std::istream& dtxstream, bool& rising)
 {
     std::vector<uint64_t> liftplan;
     if (!seekSection(dtxstream, "Liftplan"))
@@ -241,7 +241,7 @@ readLiftplan(std::ifstream& dtxstream, bool& rising)
 }
 }
 
-dtx::dtx(std::ifstream& dtxstream)
+dtx::dtx(std::istream& dtxstream)
 {
     if (!seekSection(dtxstream, "StartDTX"))
         throw std::runtime_error("Error in dtx file: no StartDTX section.");
@@ -12,5 +12,5 @@
 
 class dtx : public draft {
 public:
-    dtx(std::ifstream& _dtxstream);
+    dtx(std::istream& _dtxstream);
 };
@@ -7,13 +7,33 @@
 
 #include "fakeargs.h"
 #include "args.hxx"
+#include "picklist.h"
+#include "fakefaults.h"
+#include <algorithm>
+#include <charconv>
+#include <format>
 #include <cstdlib>
+#include <fstream>
+#include <sstream>
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
 #include <exception>
 #include <system_error>
+#include <tuple>
+#include <unordered_map>
 
+namespace {
+std::unordered_map<std::string, JitterShape> jitterShapeMap{
+    {"normal", JitterShape::Normal},
+    {"uniform", JitterShape::Uniform},
+};
+
+std::unordered_map<std::string, SerialSpeed> serialMap{
+    {"1200", SerialSpeed::Baud1200},
+    {"9600", SerialSpeed::Baud9600},
+};
+}
     
 
 Options::Options(int argc, const char * argv[])
@@ -30,17 +50,70 @@ Options::Options(int argc, const char * argv[])
 
     args::ArgumentParser parser("AVL CompuDobby loom simulator.", "Report errors to John Horigan <john@glyphic.com>.");
     args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
-    args::ValueFlag<std::string> _socketPath(parser, "SOCKET PATH", "Path for the socket", {"socket"}, envSocket, *envSocket ? args::Options::None : args::Options::Required);
+    args::ValueFlag<std::string> _socketPath(parser, "SOCKET PATH", "Path for the socket", {"socket"}, envSocket);
+    args::ValueFlag<std::string> _tcp(parser, "HOST:PORT",
+        "Listens for a networked Compu-Dobby IV connection on this TCP address instead of the socket", {"tcp"}, "");
+    args::Flag _noDelay(parser, "no delay",
+        "With --tcp, sends each reply at once instead of letting TCP coalesce small writes", {"nodelay"});
+    args::Flag _pty(parser, "pseudo-terminal",
+        "Creates a pseudo-terminal and prints its path, for drawboy --loomDevice to use as a serial port", {"pty"});
     args::MapFlag<std::string, int> _maxShafts(parser, "SHAFT COUNT",
         "Number of shafts on the loom", {"shafts"}, shaftMap, defShaft,
         defShaft ? args::Options::None : args::Options::Required);
-    args::MapFlag<std::string, DobbyType, ToLowerReader> _dobbyType(parser, "DOBBY TYPE", "Is the loom a positive or negative dobby (+ and - are also accepted)", {"dobbyType"}, dobbyMap, defDobby);
+    args::MapFlag<std::string, DobbyType, ToLowerReader> _dobbyType(parser, "DOBBY TYPE", "Is the loom a positive or negative dobby (+ and - are also accepted), or a negative Compu-Dobby IV that DrawBoy weaves as a virtual positive dobby", {"dobbyType"}, dobbyMap, defDobby);
     args::Flag _ascii(parser, "ASCII only", "Restricts output to ASCII", {"ascii"});
     args::Flag _cd4(parser, "Compu-Dobby IV", "Use Compu-Dobby IV protocol", {"cd4"});
     args::ValueFlag<std::string> _autoInput(parser, "INPUT STREAM",
         "Automatically sent input stream", {"auto"}, "");
+    args::ValueFlag<std::string> _scenario(parser, "SCENARIO",
+        "Runs a scripted session, given as text or as @PATH to a file", {"scenario"}, "");
+    args::ValueFlag<uint64_t> _seed(parser, "SEED",
+        "Seeds the arm clock jitter and the scenario's random waits (defaults to 1)", {"seed"}, 1);
+    args::ValueFlag<int> _looms(parser, "LOOM COUNT",
+        "Simulates this many looms at once, on sockets PATH.1, PATH.2 and so on", {"looms"}, 0);
+    args::ValueFlagList<std::string> _loom(parser, "LOOM SETTINGS",
+        "Settings for the next of several looms, e.g. socket=PATH,tcp=HOST:PORT,shafts=16,dobbyType=-,cd4,ppm=60,"
+        "jitter=10,jitterShape=uniform,serial=9600,cycles=500,report=PATH,seed=N", {"loom"});
+    args::Flag _headless(parser, "headless",
+        "Runs without a terminal, reading no keys, and quits when DrawBoy closes", {"headless"});
     args::Flag _autoReset(parser, "Automatic reset", "Automatically respond to solenoid reset",
         {"autoreset"});
+    args::ValueFlag<int> _cycles(parser, "CYCLE COUNT",
+        "Lowers and raises the arms this many times and times the picks, as fast as DrawBoy answers or at the --ppm rate",
+        {"cycles"}, 0);
+    args::ValueFlag<std::string> _report(parser, "REPORT PATH",
+        "Writes the timings of the arm cycles to a JSON file", {"report"}, "");
+    args::ValueFlag<int> _ppm(parser, "PICKS PER MINUTE",
+        "Lowers and raises the arms on a clock at this rate, instead of as fast as DrawBoy answers", {"ppm"}, 0);
+    args::ValueFlag<int> _shedWindow(parser, "MS",
+        "With --ppm, how long the shed stays open (defaults to half the arm cycle)", {"shedWindow"}, 0);
+    args::ValueFlag<int> _jitter(parser, "MS", "With --ppm, how much the arm cycle timing varies", {"jitter"}, 0);
+    args::MapFlag<std::string, JitterShape, ToLowerReader> _jitterShape(parser, "SHAPE",
+        "The distribution of the jitter: normal or uniform (defaults to normal)", {"jitterShape"},
+        jitterShapeMap, JitterShape::Normal);
+    args::MapFlag<std::string, SerialSpeed> _serial(parser, "BAUD",
+        "Carries bytes at the speed of a serial line: 1200 (7E2, CD I) or 9600 (8N1, CD II-IV)",
+        {"serial"}, serialMap, SerialSpeed::None);
+    args::ValueFlag<std::string> _faults(parser, "FAULTS",
+        "Injects faults once weaving starts, as name=rate: drop and corrupt (per byte to DrawBoy), "
+        "delay, what, error and armNull (CD IV), halfOpen and disconnect; delayMs sets the delay",
+        {"faults"}, "");
+    args::ValueFlag<std::string> _verify(parser, "DRAFT PATH",
+        "Checks every lift received against this WIF or DTX draft, woven straight on from the start "
+        "pick without changes of pick or tabby; with dobbyType virtual, the closing pick that "
+        "raises every shaft is expected", {"verify"}, "");
+    args::ValueFlag<int> _pick(parser, "PICK",
+        "With --verify, the pick DrawBoy starts weaving at (defaults to 1)", {'p', "pick"}, 1);
+    args::ValueFlag<std::string> _picks(parser, "PICK LIST",
+        "With --verify, the pick list DrawBoy is weaving", {'P', "picks"}, "");
+    args::ValueFlag<std::string, ToLowerReader> _tabby(parser, "TABBY SPEC",
+        "With --verify, which shafts DrawBoy raises for tabby A and tabby B", {"tabby"},
+        "abababababababababababababababababababab");
+    args::MapFlag<std::string, TabbyPattern, ToLowerReader> _tabbyPattern(parser, "TABBY PATTERN",
+        "With --verify, the pattern DrawBoy uses for inserted tabby picks", {"tabbyPattern"},
+        tabbyMap, TabbyPattern::xAyB);
+    args::Flag _threading(parser, "treadle the threading",
+        "With --verify, DrawBoy is treadling the threading instead of the picks", {"threading"});
 
     try
     {
@@ -63,11 +136,155 @@ Options::Options(int argc, const char * argv[])
     }
 
     socketPath = args::get(_socketPath);
+    tcpAddress = args::get(_tcp);
+    noDelay = _noDelay;
+    pty = _pty;
+    if (socketPath.empty() && tcpAddress.empty() && !pty)
+        throw std::runtime_error("One of --socket, --tcp or --pty is required.");
+    if (pty && !tcpAddress.empty())
+        throw std::runtime_error("Use either --pty or --tcp, not both.");
+    if (!tcpAddress.empty() && tcpAddress.rfind(':') == std::string::npos)
+        throw std::runtime_error("--tcp needs a port, e.g. 127.0.0.1:2323.");
     ascii = args::get(_ascii) || envASCII != nullptr;
     cd4 = _cd4;
-    autoInput = args::get(_autoInput);
-    autoReset = args::get(_autoReset);
+    headless = _headless;
+    seed = args::get(_seed);
+    if (!args::get(_scenario).empty() && !args::get(_autoInput).empty())
+        throw std::runtime_error("Use either --scenario or --auto, not both.");
+    if (auto text = args::get(_scenario); text.starts_with('@')) {
+        std::ifstream in(text.substr(1));
+        if (!in)
+            throw make_system_error("Cannot read the scenario file");
+        std::stringstream buf;
+        buf << in.rdbuf();
+        scenario.emplace(buf.str());
+    } else if (!text.empty()) {
+        scenario.emplace(text);
+    } else if (!args::get(_autoInput).empty()) {
+        scenario = Scenario::fromAuto(args::get(_autoInput));
+    }
+    autoReset = args::get(_autoReset) || args::get(_cycles) > 0 || args::get(_ppm) > 0;
+    cycles = std::max(0, args::get(_cycles));
+    reportPath = args::get(_report);
+    picksPerMinute = std::max(0, args::get(_ppm));
+    shedWindow = std::max(0, args::get(_shedWindow));
+    jitter = std::max(0, args::get(_jitter));
+    jitterShape = args::get(_jitterShape);
+    serial = args::get(_serial);
+    faults = parseFaults(args::get(_faults));
+    if (picksPerMinute && shedWindow >= 60000 / picksPerMinute)
+        throw std::runtime_error("The shed window must be shorter than the arm cycle.");
+    verifyPath = args::get(_verify);
+    pick = args::get(_pick);
+    picks = args::get(_picks);
+    std::tie(tabbyA, tabbyB) = parseTabby(args::get(_tabby));
+    tabbyPattern = args::get(_tabbyPattern);
+    treadleThreading = _threading;
     maxShafts = args::get(_maxShafts);
     dobbyType = args::get(_dobbyType);
+    loomSpecs = args::get(_loom);
+    looms = std::max(args::get(_looms), (int)loomSpecs.size());
+    if (dobbyType == DobbyType::Virtual && !cd4 && !looms)
+        throw std::runtime_error("Only a Compu-Dobby IV can be a virtual positive dobby.");
+    if (pty && looms)
+        throw std::runtime_error("--pty simulates a single loom.");
+    if (pty && faults.rate[(size_t)Fault::Disconnect] > 0.0)
+        throw std::runtime_error("A pseudo-terminal cannot be disconnected, use halfOpen instead.");
+    for (size_t i = 0; i < (size_t)looms; ++i)
+        (void)forLoom(i);   // report bad settings now
     fakeLoom = true;
 }
+
+// The settings for one loom of a multi-loom server: the command line
+// settings, changed by its --loom settings
+Options
+Options::forLoom(size_t index) const
+{
+    Options loom = *this;
+    loom.looms = 0;
+    loom.loomSpecs.clear();
+    loom.socketPath = socketPath.empty() ? "" : std::format("{}.{}", socketPath, index + 1);
+    if (!tcpAddress.empty()) {
+        // Loom n listens on the port after loom n-1's
+        auto colon = tcpAddress.rfind(':');
+        int port = 0;
+        auto first = tcpAddress.data() + colon + 1, last = tcpAddress.data() + tcpAddress.size();
+        auto res = std::from_chars(first, last, port);
+        if (res.ec != std::errc() || res.ptr != last)
+            throw std::runtime_error("With --looms, the --tcp port must be a number.");
+        loom.tcpAddress = std::format("{}:{}", tcpAddress.substr(0, colon), port + (int)index);
+    }
+    loom.seed = seed + index;
+    loom.label = std::format("Loom {}", index + 1);
+    loom.headless = loom.quiet = true;
+    if (!reportPath.empty())
+        loom.reportPath = std::format("{}.{}", reportPath, index + 1);
+
+    std::string_view spec = index < loomSpecs.size() ? std::string_view(loomSpecs[index]) : "";
+    ToLowerReader tlr;
+    while (!spec.empty()) {
+        auto comma = spec.find(',');
+        auto item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        auto equals = item.find('=');
+        std::string key(item.substr(0, equals));
+        std::string value(equals == std::string_view::npos ? "" : item.substr(equals + 1));
+        auto bad = [&]() {
+            return std::runtime_error(std::format("Loom {}: bad setting '{}'.", index + 1, item));
+        };
+        auto number = [&]() {
+            int n = 0;
+            auto res = std::from_chars(value.data(), value.data() + value.size(), n);
+            if (res.ec != std::errc() || res.ptr != value.data() + value.size() || n < 0)
+                throw bad();
+            return n;
+        };
+        auto lookup = [&](const auto& map, const std::string& str) {
+            auto found = map.find(str);
+            if (found == map.end())
+                throw bad();
+            return found->second;
+        };
+
+        if (key == "socket" && !value.empty()) {
+            loom.socketPath = value;
+            loom.tcpAddress.clear();
+        } else if (key == "tcp" && value.rfind(':') != std::string::npos) {
+            loom.tcpAddress = value;
+        } else if (key == "shafts") {
+            loom.maxShafts = lookup(shaftMap, value);
+        } else if (key == "dobbyType") {
+            loom.dobbyType = lookup(dobbyMap, tlr(value.c_str()));
+        } else if (key == "cd4" && value.empty()) {
+            loom.cd4 = true;
+        } else if (key == "cd1" && value.empty()) {
+            loom.cd4 = false;
+        } else if (key == "ppm") {
+            loom.picksPerMinute = number();
+        } else if (key == "shedWindow") {
+            loom.shedWindow = number();
+        } else if (key == "jitter") {
+            loom.jitter = number();
+        } else if (key == "jitterShape") {
+            loom.jitterShape = lookup(jitterShapeMap, tlr(value.c_str()));
+        } else if (key == "serial") {
+            loom.serial = lookup(serialMap, value);
+        } else if (key == "cycles") {
+            loom.cycles = number();
+        } else if (key == "report") {
+            loom.reportPath = value;
+        } else if (key == "seed") {
+            loom.seed = (uint64_t)number();
+        } else {
+            throw bad();
+        }
+    }
+    loom.autoReset = loom.autoReset || loom.cycles > 0 || loom.picksPerMinute > 0;
+    if (loom.dobbyType == DobbyType::Virtual && !loom.cd4)
+        throw std::runtime_error(std::format("Loom {}: only a Compu-Dobby IV can be a virtual "
+                                             "positive dobby.", index + 1));
+    if (loom.picksPerMinute && loom.shedWindow >= 60000 / loom.picksPerMinute)
+        throw std::runtime_error(std::format("Loom {}: the shed window must be shorter than the arm cycle.",
+                                             index + 1));
+    return loom;
+}
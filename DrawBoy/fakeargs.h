@@ -9,17 +9,46 @@
 #define fakeargs_h
 
 #include "argscommon.h"
+#include "faketiming.h"
+#include "fakescenario.h"
+#include "fakefaults.h"
+#include <optional>
 #include <string>
+#include <vector>
 
 struct Options {
     Options(int argc, const char * argv[]);
+    Options forLoom(size_t index) const;    // one of the looms of a multi-loom server
     std::string socketPath;
-    std::string autoInput;
+    std::string tcpAddress;     // host:port to listen on instead of the socket
+    bool noDelay = false;       // turn off Nagle's algorithm on TCP connections
+    bool pty = false;           // be the master of a pseudo-terminal instead
+    std::optional<Scenario> scenario;  // --scenario, or --auto turned into one
     bool autoReset;
+    bool headless = false;      // no terminal, quit when DrawBoy closes
+    uint64_t seed = 1;          // for the arm clock jitter and the scenario's random waits
+    int cycles = 0;             // paced arm cycles to time, 0 for none
+    std::string reportPath;     // where to write the timings of the cycles
+    int picksPerMinute = 0;     // arm cycles on a clock instead of paced by DrawBoy
+    int shedWindow = 0;         // milliseconds the shed is open, 0 for half the cycle
+    int jitter = 0;             // milliseconds
+    JitterShape jitterShape = JitterShape::Normal;
+    SerialSpeed serial = SerialSpeed::None;
+    FaultRates faults;          // --faults
+    std::string verifyPath;     // draft that received lifts are checked against
+    std::string picks;          // pick list, tabbies and start pick as given to DrawBoy
+    int pick = 1;
+    uint64_t tabbyA = 0, tabbyB = 0;
+    TabbyPattern tabbyPattern = TabbyPattern::xAyB;
+    bool treadleThreading = false;
     int maxShafts;
-    DobbyType dobbyType = DobbyType::Positive;
+    DobbyType dobbyType = DobbyType::Positive;   // Virtual greets DrawBoy as a negative dobby
     bool ascii;
     bool fakeLoom = false;
+    int looms = 0;              // simulated at once, 0 for the usual single loom
+    std::vector<std::string> loomSpecs;     // settings for each of them
+    std::string label;          // names the loom in multi-loom output
+    bool quiet = false;         // no output for each pick
     bool cd4 = false;
 };
 
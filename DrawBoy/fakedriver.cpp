@@ -7,14 +7,33 @@
 
 #include "driver.h"
 #include "fakeargs.h"
+#include "fakeverify.h"
+#include "faketiming.h"
+#include "fakescenario.h"
+#include "fakefaults.h"
+#include "fakepoller.h"
+#include "fakepty.h"
+#include "faketelnet.h"
 #include "term.h"
+#include <fcntl.h>
 #include <sys/select.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <csignal>
 #include "ipc.h"
 #include <cstring>
 #include <chrono>
 #include <charconv>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
 
 enum class Shed {
     Up,
@@ -38,12 +57,17 @@ enum class LoopingState {
     ShouldWait,
 };
 
+// With --faults, how long paced arm cycles wait for a pick before moving
+// the arms again
+const std::chrono::steady_clock::duration StallTimeout = std::chrono::seconds(1);
+
 struct View
 {
     Term& term;
     Options& opts;
     
     int socketFD = -1;
+    std::string outbound;               // to DrawBoy, waiting for the socket to take it
     
     Mode mode = Mode::Run;
     
@@ -51,22 +75,90 @@ struct View
     Shed loomState = Shed::Unknown;
     Solenoid solenoidState = Solenoid::Normal;
     
-    std::string autoInput;
     bool autoReset;
-    std::chrono::time_point<std::chrono::system_clock> autoDelay;
+    std::unique_ptr<ScenarioRunner> scenario;   // --scenario or --auto
+
+    // Paced arm cycles (--cycles): the arms are lowered, raised as soon as
+    // the pick arrives, and lowered again, timing each pick.
+    int cyclesLeft;
+    bool cycling = false;
+    bool cyclesDone = false;
+    std::chrono::steady_clock::time_point cyclesStart;
+    std::chrono::steady_clock::time_point downSentAt;
+    std::vector<double> latencies;      // milliseconds from arms down to pick
+
+    struct {
+        size_t picks = 0;
+        double picksPerSecond = 0.0;
+        double p50 = 0.0, p99 = 0.0;
+    } cycleTotals;                      // from the last report
+
+    // With --ppm the arms move on a clock instead, and the picks are
+    // checked against the shed
+    std::unique_ptr<ArmClock> armClock;
+    bool shedOpen = false;
+    bool shedPicked = false;            // this arm cycle's pick has arrived
+    int cyclesRun = 0;
+    int latePicks = 0;                  // arrived after the shed closed
+    int missedPicks = 0;                // never arrived
+    double leastSlack = std::numeric_limits<double>::infinity();   // ms from pick to shed closing
 
-    View(Term& t, Options& o)
-    : term(t), opts(o), autoInput(o.autoInput), autoReset(opts.autoReset),
-      autoDelay(std::chrono::system_clock::now())
-    {}
+    std::unique_ptr<SerialLink> link;   // --serial
+    std::unique_ptr<TelnetFilter> telnet;       // --tcp
+
+    std::unique_ptr<FaultInjector> faults;      // --faults
+    bool readyHeld = false;             // a delayed <ready> is waiting
+    std::chrono::steady_clock::time_point readyAt;
+    int stalls = 0;                     // paced arm cycles retried after a fault
+    int mostWaiting = 0;                // bytes from DrawBoy waiting for the line
+
+    LiftVerifier* verifier;             // --verify
+
+    View(Term& t, Options& o, LiftVerifier* v)
+    : term(t), opts(o), autoReset(opts.autoReset), cyclesLeft(o.cycles), verifier(v)
+    {
+        if (opts.picksPerMinute)
+            armClock = std::make_unique<ArmClock>(opts.picksPerMinute, opts.shedWindow,
+                                                  opts.jitter, opts.jitterShape, opts.seed);
+        if (opts.scenario)
+            scenario = std::make_unique<ScenarioRunner>(*opts.scenario, opts.seed);
+        if (opts.faults.any())
+            faults = std::make_unique<FaultInjector>(opts.faults, opts.seed);
+        if (opts.serial != SerialSpeed::None)
+            link = std::make_unique<SerialLink>(opts.serial);
+        if (!opts.tcpAddress.empty())
+            telnet = std::make_unique<TelnetFilter>();
+    }
     
     void handleEvent(const Term::Event& ev);
+    void moveArms(Term::Key key);
+    
+    void ready();
+    void startCycles();
+    void tick();
+    void pickReceived();
+    void finishCycles();
+    void reportCycles();
+
+    void runScenario();
+    bool reportScenario();
     
+    std::chrono::steady_clock::duration waitTime();
+    void receive(char c);
     void sendToDrawBoy(const char *msg);
+    void answerPick();
+    void writeToDrawBoy(std::string_view bytes);
+    void flushToDrawBoy();
     
     void displayPrompt();
+    void accepted(int fd);
+    bool wantsInput() const { return !link || !link->holding(); }
+    bool wantsOutput() const { return !outbound.empty(); }
+    std::optional<LoopingState> service(bool readable, bool writable);
+    void finish(bool& verified, bool& scripted);
     LoopingState connect();
     LoopingState run(IPC::Server& server);
+    LoopingState run(PseudoTerminal& pty);
 };
 
 void
@@ -118,7 +210,7 @@ View::handleEvent(const Term::Event &ev)
                 case Term::Key::Up:
                     if (loomState == Shed::Up)
                         std::fputs("\r\nArms were already raised.\r\n", stdout);
-                    else
+                    else if (!opts.quiet)
                         std::fputs(opts.ascii ? "^" : "\xE2\x86\x91", stdout);
                     std::fflush(stdout);
                     sendToDrawBoy(armsUp);
@@ -128,7 +220,7 @@ View::handleEvent(const Term::Event &ev)
                 case Term::Key::Down:
                     if (loomState == Shed::Down)
                         std::fputs("\r\nArms were already lowered.\r\n", stdout);
-                    else
+                    else if (!opts.quiet)
                         std::fputs(opts.ascii ? "v" : "\xE2\x86\x93", stdout);
                     std::fflush(stdout);
                     sendToDrawBoy(armsDown);
@@ -154,200 +246,624 @@ View::handleEvent(const Term::Event &ev)
 void
 View::displayPrompt()
 {
+    if (opts.headless || opts.quiet)
+        return;
     std::fputs("\r\ns)end solenoid reset   up/down arrows raise/lower arms   q)uit", stdout);
     std::fflush(stdout);
 }
 
 void
-View::sendToDrawBoy(const char *msg)
+View::moveArms(Term::Key key)
 {
-    size_t remaining = std::strlen(msg);
-    size_t sent = 0;
-    
-    while (remaining > 0  &&  mode != Mode::Quit)
-    {
-        auto result = ::write(socketFD, msg + sent, remaining);
-        if (result >= 0) {
-            // sent partial or all the remaining data
-            sent += (size_t)result;
-            remaining -= (size_t)result;
-        } else {
-            int err = errno;
-            if (err == EPIPE) {
-                mode = Mode::Closed;
-                return;
-            }
-            if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) {
-                timeval tv = {};
-                fd_set fds = {};
-                int selectresult;
-                
-                tv.tv_sec = 1;
-                FD_ZERO(&fds);
-                FD_SET(socketFD, &fds);
-                selectresult = ::select(socketFD + 1, nullptr, &fds, nullptr, &tv);
-                if (selectresult == -1 && errno != EINTR)
-                    throw make_system_error("loom select failed");
-            } else {
-                throw make_system_error("loom write failed");
-            }
-        }
+    if (opts.cd4 && faults && faults->inject(Fault::ArmNull, std::chrono::steady_clock::now())) {
+        std::fputs("\r\nFault: spurious <arm null>.\r\n", stdout);
+        sendToDrawBoy("<arm null>");
     }
+    Term::Event ev{
+        Term::EventType::Key,
+        ' ',
+        key,
+        false, false, false, false, "", ""
+    };
+    handleEvent(ev);
 }
 
-LoopingState
-View::connect()
+// The loom has answered DrawBoy's reset, weaving can start
+void
+View::ready()
 {
-    const char* shaftChar = opts.ascii ? "*" : "\xE2\x96\xA0";
-    char termChar = opts.cd4 ? '\r' : '\x07';
-    const char* loomReset = opts.cd4 ? "\r" : "\x0f\x03";
+    autoReset = false;
+    if (faults)
+        faults->arm();
+    startCycles();
+    if (scenario && !scenario->started())
+        scenario->start(std::chrono::steady_clock::now());
+}
 
+void
+View::runScenario()
+{
+    if (!scenario || !scenario->started() || scenario->done())
+        return;
     while (mode == Mode::Run) {
-        fd_set rdset;
-        FD_SET(STDIN_FILENO, &rdset);
-        FD_SET(socketFD, &rdset);
-        timeval onesec{term.pendingEvent() ? 0 : 1, 0};
-        if (!autoInput.empty() && !autoReset && std::isdigit((unsigned char)autoInput.front())) {
-            size_t pos = 0;
-            int delay = std::stoi(autoInput, &pos);
-            autoDelay = std::chrono::system_clock::now() + std::chrono::seconds(delay);
-            autoInput.erase(0, pos);
-            std::printf("\r\nInserting %d second delay. ", (int)onesec.tv_sec);
-        }
-
-        int nfds = ::select(socketFD + 1, &rdset, nullptr, nullptr, &onesec);
-        
-        if (nfds == -1 && errno != EINTR)
-            throw make_system_error("select failed");
-
-        if (!autoInput.empty() && !autoReset &&
-            std::chrono::system_clock::now() > autoDelay &&
-            std::isalpha((unsigned char)autoInput.front()))
-        {
-            auto c = autoInput.front();
-            autoInput.erase(0, 1);
-            switch (c) {
-                case 'u':
-                case 'd': {
-                    Term::Event ev{
-                        Term::EventType::Key,
-                        ' ',
-                        c == 'u' ? Term::Key::Up : Term::Key::Down,
-                        false, false, false, false, ""
-                    };
-                    std::printf("\r\nInserting %s event. ", c == 'u' ? "UP" : "DOWN");
-                    handleEvent(ev);
-                    break;
-                }
-                default: {
+        auto step = scenario->next(std::chrono::steady_clock::now());
+        if (!step)
+            break;
+        switch (step->op) {
+            case Scenario::Op::Down:
+                moveArms(Term::Key::Down);
+                break;
+            case Scenario::Op::Up:
+                moveArms(Term::Key::Up);
+                break;
+            case Scenario::Op::Neutral:
+            case Scenario::Op::Keys: {
+                std::string keys = step->op == Scenario::Op::Keys ? step->keys : " ";
+                for (char c: keys) {
                     Term::Event ev{
                         Term::EventType::Char,
                         c,
                         Term::Key::Up,
-                        false, false, false, false, ""
+                        false, false, false, false, "", ""
                     };
-                    std::printf("\r\nInserting '%c' event. ", c);
                     handleEvent(ev);
-                    break;
                 }
+                break;
             }
+            default:
+                break;
         }
+    }
+    if (scenario->done()) {
+        std::printf("\r\nScenario done: %d expectations, %d not met.\r\n",
+                    scenario->expectations(), scenario->failures());
+        std::fflush(stdout);
+    }
+}
 
-        if (FD_ISSET(STDIN_FILENO, &rdset) || term.pendingEvent() || nfds == -1) {
-            Term::Event ev = term.getEvent();
-            if (ev.type == Term::EventType::None) continue;
-            handleEvent(ev);
+// Whether every expectation of the scenario was met
+bool
+View::reportScenario()
+{
+    if (!scenario || !scenario->started())
+        return true;
+    if (!scenario->done()) {
+        std::printf("\r\nScenario stopped at line %d: %d expectations, %d not met.\r\n",
+                    scenario->line(), scenario->expectations(), scenario->failures());
+        std::fflush(stdout);
+        return false;
+    }
+    return scenario->failures() == 0;
+}
+
+void
+View::startCycles()
+{
+    if (cycling || cyclesDone || (cyclesLeft <= 0 && !armClock))
+        return;
+    if (armClock)
+        std::printf("\r\nWeaving at %d picks per minute.\r\n", opts.picksPerMinute);
+    else
+        std::printf("\r\nRunning %d arm cycles.\r\n", cyclesLeft);
+    latencies.reserve((size_t)std::max(cyclesLeft, 0));
+    cycling = true;
+    cyclesStart = downSentAt = std::chrono::steady_clock::now();
+    if (armClock)
+        armClock->start(cyclesStart);      // tick() lowers the arms
+    else
+        moveArms(Term::Key::Down);
+}
+
+// Moves the arms when the arm clock says so
+void
+View::tick()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (readyHeld && now >= readyAt) {
+        readyHeld = false;
+        sendToDrawBoy("<ready>");
+    }
+    if (!cycling || (faults && faults->silent()))
+        return;
+    if (!armClock) {
+        // A fault can leave DrawBoy waiting for an arm movement it never saw
+        if (faults && now - downSentAt >= StallTimeout) {
+            ++stalls;
+            std::fputs("\r\nNo pick, moving the arms again.\r\n", stdout);
+            moveArms(Term::Key::Up);
+            downSentAt = now;
+            moveArms(Term::Key::Down);
         }
-        
-        if (FD_ISSET(socketFD, &rdset)) {
-            char c;
-            auto n = ::read(socketFD, &c, 1);
-            if (n < 0) {
-                if (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK)
-                    continue;
-                else
-                    throw make_system_error("error in read");
+        return;
+    }
+    if (shedOpen && now >= armClock->upAt()) {
+        moveArms(Term::Key::Up);
+        shedOpen = false;
+        armClock->next();
+    }
+    if (!shedOpen && now >= armClock->downAt()) {
+        if (cyclesRun > 0 && !shedPicked)
+            ++missedPicks;
+        if (opts.cycles > 0 && cyclesRun >= opts.cycles) {
+            finishCycles();
+            return;
+        }
+        ++cyclesRun;
+        shedOpen = true;
+        shedPicked = false;
+        downSentAt = now;
+        moveArms(Term::Key::Down);
+    }
+}
+
+void
+View::pickReceived()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (armClock) {
+        // Only the first pick of each arm cycle counts
+        if (cyclesRun == 0 || shedPicked)
+            return;
+        shedPicked = true;
+        latencies.push_back(std::chrono::duration<double, std::milli>(now - downSentAt).count());
+        if (shedOpen)
+            leastSlack = std::min(leastSlack, std::chrono::duration<double, std::milli>(
+                                                  armClock->upAt() - now).count());
+        else
+            ++latePicks;
+        return;
+    }
+    latencies.push_back(std::chrono::duration<double, std::milli>(now - downSentAt).count());
+    moveArms(Term::Key::Up);
+    if (--cyclesLeft > 0) {
+        downSentAt = std::chrono::steady_clock::now();
+        moveArms(Term::Key::Down);
+        return;
+    }
+    finishCycles();
+}
+
+void
+View::finishCycles()
+{
+    cycling = false;
+    cyclesDone = true;
+    reportCycles();
+}
+
+void
+View::reportCycles()
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   cyclesStart).count();
+    double rate = seconds > 0.0 ? (double)latencies.size() / seconds : 0.0;
+    std::vector<double> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        if (sorted.empty())
+            return 0.0;
+        // nearest rank
+        size_t rank = (size_t)std::ceil(p / 100.0 * (double)sorted.size());
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    };
+
+    cycleTotals.picks = sorted.size();
+    cycleTotals.picksPerSecond = rate;
+    cycleTotals.p50 = percentile(50);
+    cycleTotals.p99 = percentile(99);
+
+    std::printf("\r\n%s%sArm cycles done: %zu picks in %.3f s, %.1f picks/s, "
+                "down to pick median %.3f ms, 99th percentile %.3f ms, max %.3f ms\r\n",
+                opts.label.c_str(), opts.label.empty() ? "" : ": ",
+                sorted.size(), seconds, rate, percentile(50), percentile(99), percentile(100));
+    if (armClock) {
+        std::printf("At %d picks per minute: %d late, %d missed", opts.picksPerMinute,
+                    latePicks, missedPicks);
+        if (std::isfinite(leastSlack))
+            std::printf(", least slack %.3f ms", leastSlack);
+        std::printf("\r\n");
+    }
+    if (link)
+        std::printf("Serial link: at most %d bytes from DrawBoy waiting\r\n", mostWaiting);
+    if (stalls)
+        std::printf("%d arm cycles moved again after no pick came\r\n", stalls);
+    std::fflush(stdout);
+
+    if (opts.reportPath.empty())
+        return;
+    std::FILE* out = std::fopen(opts.reportPath.c_str(), "w");
+    if (!out)
+        throw make_system_error("Cannot write the arm cycle report");
+    std::fprintf(out, "{\n  \"protocol\": \"%s\",\n  \"shafts\": %d,\n  \"mode\": \"%s\",\n"
+                 "  \"picks\": %zu,\n  \"seconds\": %.6f,\n  \"picksPerSecond\": %.3f,\n"
+                 "  \"latencyMs\": {\"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, "
+                 "\"max\": %.4f},\n",
+                 opts.cd4 ? "cd4" : "cd1-3", opts.maxShafts, armClock ? "timed" : "fast",
+                 sorted.size(), seconds, rate, percentile(0), percentile(50), percentile(90),
+                 percentile(99), percentile(100));
+    if (armClock) {
+        std::fprintf(out, "  \"picksPerMinute\": %d,\n  \"cycles\": %d,\n  \"late\": %d,\n"
+                     "  \"missed\": %d,\n", opts.picksPerMinute, cyclesRun, latePicks, missedPicks);
+        if (std::isfinite(leastSlack))
+            std::fprintf(out, "  \"leastSlackMs\": %.4f,\n", leastSlack);
+        else
+            std::fprintf(out, "  \"leastSlackMs\": null,\n");
+    }
+    if (faults) {
+        std::fprintf(out, "  \"stalls\": %d,\n", stalls);
+        faults->writeJSON(out);
+    }
+    std::fprintf(out, "  \"serialBaud\": %s,\n  \"mostWaitingBytes\": %d\n}\n",
+                 opts.serial == SerialSpeed::Baud1200 ? "1200" :
+                 opts.serial == SerialSpeed::Baud9600 ? "9600" : "null", mostWaiting);
+    std::fclose(out);
+}
+
+void
+View::sendToDrawBoy(const char *msg)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::string_view bytes = msg;
+    std::string mangled;
+    if (faults) {
+        if (faults->silent())
+            return;
+        mangled = faults->mangle(bytes, now);
+        if (mangled != bytes)
+            std::fputs("\r\nFault: damaged bytes to DrawBoy.\r\n", stdout);
+        bytes = mangled;
+    }
+    std::string escaped;
+    if (telnet) {
+        escaped = TelnetFilter::escape(bytes);
+        bytes = escaped;
+    }
+    if (link)
+        link->queue(bytes, now);
+    else
+        writeToDrawBoy(bytes);
+}
+
+// What a Compu-Dobby IV says after a pick, usually <ready>
+void
+View::answerPick()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (faults && faults->inject(Fault::Delay, now)) {
+        std::printf("\r\nFault: holding <ready> for %d ms.\r\n", faults->delayMs());
+        readyHeld = true;
+        readyAt = now + std::chrono::milliseconds(faults->delayMs());
+    } else if (faults && faults->inject(Fault::What, now)) {
+        std::fputs("\r\nFault: answering <what>.\r\n", stdout);
+        sendToDrawBoy("<what>");
+    } else if (faults && faults->inject(Fault::Error, now)) {
+        std::fputs("\r\nFault: answering <error>.\r\n", stdout);
+        sendToDrawBoy("<Error 2>");
+    } else {
+        sendToDrawBoy("<ready>");
+    }
+}
+
+// Queues bytes for DrawBoy and writes what the socket will take now. The
+// rest goes when the event loop sees the socket writable, so a DrawBoy that
+// is slow to read holds up nobody else.
+void
+View::writeToDrawBoy(std::string_view bytes)
+{
+    outbound.append(bytes);
+    flushToDrawBoy();
+}
+
+void
+View::flushToDrawBoy()
+{
+    size_t sent = 0;
+    while (sent < outbound.size() && mode != Mode::Quit) {
+        auto result = ::write(socketFD, outbound.data() + sent, outbound.size() - sent);
+        if (result >= 0) {
+            sent += (size_t)result;
+            continue;
+        }
+        int err = errno;
+        if (err == EINTR)
+            continue;
+        if (err == EAGAIN || err == EWOULDBLOCK)
+            break;
+        if (err == EPIPE || err == EIO || err == ECONNRESET) {
+            mode = Mode::Closed;
+            outbound.clear();
+            return;
+        }
+        throw make_system_error("loom write failed");
+    }
+    outbound.erase(0, sent);
+}
+
+void
+View::receive(char c)
+{
+    const char* shaftChar = opts.ascii ? "*" : "\xE2\x96\xA0";
+    char termChar = opts.cd4 ? '\r' : '\x07';
+    const char* loomReset = opts.cd4 ? "\r" : "\x0f\x03";
+
+    if (faults && faults->silent())
+        return;                         // the loom is gone
+    DrawBoyOutput.push_back(c);
+    
+    // The CD I-III solenoid reset ends with 0x03, not the 0x07 of picks
+    if (!DrawBoyOutput.empty() &&
+        (DrawBoyOutput.back() == termChar || DrawBoyOutput == loomReset)) {
+        if (DrawBoyOutput == loomReset) {
+            if (autoReset && !opts.cd4) {
+                std::fputs("\r\nResponding to solenoid reset command.\r\n", stdout);
+                sendToDrawBoy("\x7f\03");
+                ready();
+            } else if (autoReset && opts.cd4) {
+                std::fputs("\r\nSending loom greeting.\r\n", stdout);
+                std::string greeting = std::format("<Compu-Dobby IV, {}H, {} Dobby, HW A.1, FW 0.1.0>\n\r<Password:>",
+                                                   opts.maxShafts, opts.dobbyType == DobbyType::Positive ? "Pos" : "Neg");
+                sendToDrawBoy(greeting.c_str());
+            } else {
+                std::fputs("\r\nSolenoid reset command received.\r\n", stdout);
+                solenoidState = Solenoid::Reset;
             }
-            if (n == 0) return LoopingState::ShouldWait;
-            DrawBoyOutput.push_back(c);
-            
-            if (!DrawBoyOutput.empty() && DrawBoyOutput.back() == termChar) {
-                if (DrawBoyOutput == loomReset) {
-                    if (autoReset && !opts.cd4) {
-                        std::fputs("\r\nResponding to solenoid reset command.\r\n", stdout);
-                        sendToDrawBoy("\x7f\03");
-                        autoReset = false;
-                    } else if (autoReset && opts.cd4) {
-                        std::fputs("\r\nSending loom greeting.\r\n", stdout);
-                        std::string greeting = std::format("<Compu-Dobby IV, {}H, {} Dobby, HW A.1, FW 0.1.0>\n\r<Password:>",
-                                                           opts.maxShafts, opts.dobbyType == DobbyType::Positive ? "Pos" : "Neg");
-                        sendToDrawBoy(greeting.c_str());
+            if (scenario)
+                scenario->observed(Scenario::Event::Reset, 0);
+        } else if (DrawBoyOutput == "chico\r") {
+            sendToDrawBoy("<ready>");
+            std::fputs("\r\nPassword received.\r\n", stdout);
+            ready();
+            if (scenario)
+                scenario->observed(Scenario::Event::Password, 0);
+        } else if (!opts.cd4 && DrawBoyOutput == "\x0f\x07") {
+            std::fputs("\r\nclose\r\n", stdout);
+            if (scenario)
+                scenario->observed(Scenario::Event::Close, 0);
+        } else if (!opts.cd4 || DrawBoyOutput.starts_with("pick ")) {
+            uint64_t lift = 0;
+            bool unexpected = false;
+            uint64_t shafts = 0;
+            if (opts.cd4) {
+                auto str = DrawBoyOutput.c_str() + 5;
+                uint64_t shaft;
+                while (*str != '\r') {
+                    auto res = std::from_chars(str, DrawBoyOutput.c_str() + DrawBoyOutput.size(), shaft, 10);
+                    if (res.ec != std::errc()) {
+                        unexpected = true;
+                        str = "\r";
                     } else {
-                        std::fputs("\r\nSolenoid reset command received.\r\n", stdout);
-                        solenoidState = Solenoid::Reset;
+                        str = *(res.ptr) == ',' ? res.ptr + 1 : res.ptr;
+                        lift |= 1ull << (shaft - 1);
+                        if (shaft > shafts) shafts = shaft;
                     }
-                } else if (DrawBoyOutput == "chico\r") {
-                    sendToDrawBoy("<ready>");
-                    std::fputs("\r\nPassword received.\r\n", stdout);
-                } else if (!opts.cd4 || DrawBoyOutput.starts_with("pick ")) {
-                    std::fputs(loomState == Shed::Down ? "\x1b[42;30m" : "\x1b[41;30m", stdout);
-                    uint64_t lift = 0;
-                    bool unexpected = false;
-                    uint64_t shafts = 0;
-                    std::fputs("\r\n", stdout);
-                    if (opts.cd4) {
-                        auto str = DrawBoyOutput.c_str() + 5;
-                        uint64_t shaft;
-                        while (*str != '\r') {
-                            auto res = std::from_chars(str, DrawBoyOutput.c_str() + DrawBoyOutput.size(), shaft, 10);
-                            if (res.ec != std::errc()) {
-                                unexpected = true;
-                                str = "\r";
-                            } else {
-                                str = *(res.ptr) == ',' ? res.ptr + 1 : res.ptr;
-                                lift |= 1ull << (shaft - 1);
-                                if (shaft > shafts) shafts = shaft;
-                            }
-                        }
-                    } else {
-                        for (size_t i = 0; i < DrawBoyOutput.length(); ++i) {
-                            uint64_t uc = (unsigned char)DrawBoyOutput[i];
-                            std::printf("0x%02x ", (int)uc);
-                            if (uc >= 0x10 && uc <= 0xaf) {
-                                lift |= (uc & 0xf) << (((uc >> 4) - 1) << 2);
-                                uint64_t shaft = (uc & 0xf0) >> 2;
-                                if (shaft > shafts) shafts = shaft;
-                            } else if (uc != 0x07) {
-                                unexpected = true;
-                            }
-                        }
+                }
+            } else {
+                for (size_t i = 0; i < DrawBoyOutput.length(); ++i) {
+                    uint64_t uc = (unsigned char)DrawBoyOutput[i];
+                    if (uc >= 0x10 && uc <= 0xaf) {
+                        lift |= (uc & 0xf) << (((uc >> 4) - 1) << 2);
+                        uint64_t shaft = (uc & 0xf0) >> 2;
+                        if (shaft > shafts) shafts = shaft;
+                    } else if (uc != 0x07) {
+                        unexpected = true;
                     }
-                    std::putchar('|');
-                    bool tooMany = shafts > (uint64_t)opts.maxShafts;
-                    shafts = (uint64_t)opts.maxShafts;
-                    for (uint64_t shaft = 0; shaft < shafts; ++shaft)
-                        std::fputs((lift & (1ull << shaft)) ? shaftChar : " ", stdout);
-                    std::putchar('|');
-                    std::printf("%s%s %s %s%s\r\n", Term::Style::reset, opts.ascii ? "" : Term::Style::bold,
-                                tooMany ? "too many shafts!" : "",
-                                unexpected ? "unexpected character!" : "",
-                                opts.ascii ? "" : Term::Style::reset);
-                    if (opts.cd4)
-                        sendToDrawBoy("<ready>");
-                } else if (DrawBoyOutput == "clear\r" || DrawBoyOutput == "close\r") {
-                    std::printf("\r\n%s\n", DrawBoyOutput.c_str());
-                    sendToDrawBoy("<ready>");
-                } else {
-                    DrawBoyOutput.pop_back();
-                    std::printf("\r\n%s%sUnexpected input from driver: %s%s",
-                                Term::Style::reset, opts.ascii ? "" : Term::Style::bold,
-                                DrawBoyOutput.c_str(),
-                                opts.ascii ? "" : Term::Style::reset);
                 }
-                DrawBoyOutput.clear();
-                displayPrompt();
             }
+            bool tooMany = shafts > (uint64_t)opts.maxShafts;
+            if (!opts.quiet) {
+                std::fputs(loomState == Shed::Down ? "\x1b[42;30m" : "\x1b[41;30m", stdout);
+                std::fputs("\r\n", stdout);
+                if (!opts.cd4)
+                    for (char uc: DrawBoyOutput)
+                        std::printf("0x%02x ", (int)(unsigned char)uc);
+                std::putchar('|');
+                for (uint64_t shaft = 0; shaft < (uint64_t)opts.maxShafts; ++shaft)
+                    std::fputs((lift & (1ull << shaft)) ? shaftChar : " ", stdout);
+                std::putchar('|');
+                std::printf("%s%s %s %s%s\r\n", Term::Style::reset, opts.ascii ? "" : Term::Style::bold,
+                            tooMany ? "too many shafts!" : "",
+                            unexpected ? "unexpected character!" : "",
+                            opts.ascii ? "" : Term::Style::reset);
+            }
+            if (faults)
+                faults->picked(std::chrono::steady_clock::now());
+            if (opts.cd4)
+                answerPick();
+            if (verifier)
+                verifier->received(lift);
+            if (scenario)
+                scenario->observed(Scenario::Event::Pick, lift);
+            if (cycling)
+                pickReceived();
+        } else if (DrawBoyOutput == "clear\r" || DrawBoyOutput == "close\r") {
+            std::printf("\r\n%s\n", DrawBoyOutput.c_str());
+            sendToDrawBoy("<ready>");
+            if (verifier && DrawBoyOutput == "close\r")
+                verifier->closed();
+            if (scenario && DrawBoyOutput == "close\r")
+                scenario->observed(Scenario::Event::Close, 0);
+        } else {
+            DrawBoyOutput.pop_back();
+            std::printf("\r\n%s%sUnexpected input from driver: %s%s",
+                        Term::Style::reset, opts.ascii ? "" : Term::Style::bold,
+                        DrawBoyOutput.c_str(),
+                        opts.ascii ? "" : Term::Style::reset);
+        }
+        DrawBoyOutput.clear();
+        displayPrompt();
+
+        auto now = std::chrono::steady_clock::now();
+        if (faults && faults->inject(Fault::Disconnect, now)) {
+            std::fputs("\r\nFault: closing the connection.\r\n", stdout);
+            // see how long DrawBoy takes to close its end
+            if (::shutdown(socketFD, SHUT_WR) != 0 && errno != ENOTCONN)
+                throw make_system_error("Cannot close the connection to DrawBoy");
+        } else if (faults && faults->inject(Fault::HalfOpen, now)) {
+            std::fputs("\r\nFault: going silent.\r\n", stdout);
+        }
+        std::fflush(stdout);
+    }
+}
+
+// How long select() may wait before the arms or the serial link need attention
+std::chrono::steady_clock::duration
+View::waitTime()
+{
+    if (term.pendingEvent())
+        return std::chrono::steady_clock::duration::zero();
+    auto now = std::chrono::steady_clock::now();
+    auto wait = std::chrono::steady_clock::duration(std::chrono::seconds(1));
+    auto until = [&](std::chrono::steady_clock::time_point t) {
+        wait = std::min(wait, std::max(t - now, std::chrono::steady_clock::duration::zero()));
+    };
+    if (cycling && armClock)
+        until(shedOpen ? armClock->upAt() : armClock->downAt());
+    if (scenario && scenario->pending())
+        until(scenario->wakeAt());
+    if (readyHeld)
+        until(readyAt);
+    if (cycling && !armClock && faults && !faults->silent())
+        until(downSentAt + StallTimeout);
+    if (link && link->sending())
+        until(link->nextSendAt());
+    if (link && link->holding())
+        until(link->nextReceiveAt());
+    return wait;
+}
+
+// DrawBoy has connected
+void
+View::accepted(int fd)
+{
+    socketFD = fd;
+    outbound.clear();
+    // Writes must never wait for DrawBoy; accepted sockets do not inherit
+    // O_NONBLOCK everywhere
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        throw make_system_error("Could not set connection flags");
+    if (opts.noDelay && telnet) {
+        int on = 1;
+        if (::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1)
+            throw make_system_error("Could not set TCP_NODELAY");
+    }
+    if (verifier)
+        verifier->restart();
+    if (scenario && !autoReset)
+        scenario->start(std::chrono::steady_clock::now());
+}
+
+// Does whatever has come due, writes what is waiting for DrawBoy if
+// writable, and reads from DrawBoy if readable. Once DrawBoy closes the
+// connection, returns how to go on.
+std::optional<LoopingState>
+View::service(bool readable, bool writable)
+{
+    tick();
+    if (writable)
+        flushToDrawBoy();
+    if (link && link->sending())
+        writeToDrawBoy(link->due(std::chrono::steady_clock::now()));
+
+    runScenario();
+
+    if (link) {
+        char c;
+        if (link->received(std::chrono::steady_clock::now(), c))
+            receive(c);
+    }
+
+    if (!readable)
+        return {};
+    // A serial link takes a byte at a time, to time each one on the line
+    char buf[4096];
+    auto n = ::read(socketFD, buf, link ? 1 : sizeof(buf));
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK)
+            return {};
+        // DrawBoy closed without reading the last <ready>, or closed the
+        // pseudo-terminal
+        else if (errno != ECONNRESET && errno != EIO)
+            throw make_system_error("error in read");
+    }
+    if (n <= 0) {
+        if (faults)
+            faults->closed(std::chrono::steady_clock::now());
+        if (cycling) {
+            // DrawBoy left before the cycles were done
+            cycling = false;
+            reportCycles();
         }
+        // Nobody is there to quit a headless fakeloom
+        return cyclesDone || opts.headless ? LoopingState::ShouldQuit : LoopingState::ShouldWait;
+    }
+    for (char c: std::string_view(buf, (size_t)n)) {
+        if (telnet) {
+            // Telnet commands never reach the loom; refusals go straight back
+            std::string reply;
+            bool data = telnet->filter(c, reply);
+            if (!reply.empty())
+                writeToDrawBoy(reply);
+            if (!data)
+                continue;
+        }
+        if (link) {
+            link->arrived(c, std::chrono::steady_clock::now());
+            int waiting = 0;
+            if (::ioctl(socketFD, FIONREAD, &waiting) == 0)
+                mostWaiting = std::max(mostWaiting, waiting + 1);
+        } else {
+            receive(c);
+        }
+    }
+    return {};
+}
+
+// Reports on the session once DrawBoy has gone
+void
+View::finish(bool& verified, bool& scripted)
+{
+    if (socketFD == -1)
+        return;
+    if (verifier)
+        verified = verifier->report() && verified;
+    if (faults)
+        faults->report();
+    scripted = reportScenario() && scripted;
+}
+
+LoopingState
+View::connect()
+{
+    while (mode == Mode::Run) {
+        fd_set rdset, wrset;
+        FD_ZERO(&rdset);
+        FD_ZERO(&wrset);
+        if (term.inputFD() >= 0)
+            FD_SET(term.inputFD(), &rdset);
+        if (wantsInput())
+            FD_SET(socketFD, &rdset);
+        if (wantsOutput())
+            FD_SET(socketFD, &wrset);
+        auto usec = std::chrono::duration_cast<std::chrono::microseconds>(waitTime()).count();
+        timeval timeout{(time_t)(usec / 1000000), (suseconds_t)(usec % 1000000)};
+
+        int nfds = ::select(std::max(socketFD, term.inputFD()) + 1, &rdset, &wrset, nullptr, &timeout);
+        
+        if (nfds == -1 && errno != EINTR)
+            throw make_system_error("select failed");
+
+        if ((term.inputFD() >= 0 && FD_ISSET(term.inputFD(), &rdset)) ||
+            term.pendingEvent() || nfds == -1)
+        {
+            Term::Event ev = term.getEvent();
+            if (ev.type != Term::EventType::None)
+                handleEvent(ev);
+        }
+
+        if (auto state = service(nfds > 0 && FD_ISSET(socketFD, &rdset),
+                                 nfds > 0 && FD_ISSET(socketFD, &wrset)))
+            return *state;
     }
     
     return mode == Mode::Quit ? LoopingState::ShouldQuit : LoopingState::ShouldWait;
@@ -356,12 +872,14 @@ View::connect()
 LoopingState
 View::run(IPC::Server& server)
 {
-    std::fputs("\r\n\n\nWaiting for DrawBoy   q)uit", stdout);
+    std::fputs(opts.headless ? "\r\n\n\nWaiting for DrawBoy" : "\r\n\n\nWaiting for DrawBoy   q)uit", stdout);
     std::fflush(stdout);
 
     while (true) {
         fd_set rdset;
-        FD_SET(STDIN_FILENO, &rdset);
+        FD_ZERO(&rdset);
+        if (term.inputFD() >= 0)
+            FD_SET(term.inputFD(), &rdset);
         FD_SET(server.fd(), &rdset);
         timeval onesec{term.pendingEvent() ? 0 : 1, 0};
         
@@ -370,7 +888,9 @@ View::run(IPC::Server& server)
         if (nfds == -1 && errno != EINTR)
             throw make_system_error("select failed");
 
-        if (FD_ISSET(STDIN_FILENO, &rdset) || term.pendingEvent() || nfds == -1) {
+        if ((term.inputFD() >= 0 && FD_ISSET(term.inputFD(), &rdset)) ||
+            term.pendingEvent() || nfds == -1)
+        {
             Term::Event ev = term.getEvent();
             if (ev.type == Term::EventType::Char) {
                 if (ev.character == '\x03' || ev.character == 'q' || ev.character == 'Q')
@@ -382,7 +902,7 @@ View::run(IPC::Server& server)
             try {
                 auto ac = server.accept();
                 if (!ac.has_value()) continue;
-                socketFD = ac->fd();
+                accepted(ac->fd());
                 return connect();
             } catch (IPC::SocketError& se) {
                 std::printf("\r\nClient connection failed: %s, ignoring\r\n", se.what());
@@ -392,21 +912,242 @@ View::run(IPC::Server& server)
     }
 }
 
+// Waits for DrawBoy to open the pseudo-terminal. Polls, as the master only
+// shows a hangup, which cannot be selected for.
+LoopingState
+View::run(PseudoTerminal& pty)
+{
+    std::printf(opts.headless ? "\r\n\n\nWaiting for DrawBoy on %s" : "\r\n\n\nWaiting for DrawBoy on %s   q)uit",
+                pty.slavePath().c_str());
+    std::fflush(stdout);
+
+    while (!pty.slaveOpen()) {
+        fd_set rdset;
+        FD_ZERO(&rdset);
+        if (term.inputFD() >= 0)
+            FD_SET(term.inputFD(), &rdset);
+        timeval wait{0, term.pendingEvent() ? 0 : 20000};
+
+        int nfds = select(term.inputFD() + 1, &rdset, nullptr, nullptr, &wait);
+
+        if (nfds == -1 && errno != EINTR)
+            throw make_system_error("select failed");
+
+        if ((term.inputFD() >= 0 && FD_ISSET(term.inputFD(), &rdset)) ||
+            term.pendingEvent() || nfds == -1)
+        {
+            Term::Event ev = term.getEvent();
+            if (ev.type == Term::EventType::Char) {
+                if (ev.character == '\x03' || ev.character == 'q' || ev.character == 'Q')
+                    return LoopingState::ShouldQuit;
+            }
+        }
+    }
+    accepted(pty.fd());
+    return connect();
+}
+
+namespace {
+volatile std::sig_atomic_t interrupted = 0;
+
+void
+interruptHandler(int)
+{
+    interrupted = 1;
+}
+
+std::unique_ptr<IPC::Server>
+makeServer(const Options& opts)
+{
+    if (opts.tcpAddress.empty())
+        return std::make_unique<IPC::Server>(opts.socketPath);
+    auto colon = opts.tcpAddress.rfind(':');
+    return std::make_unique<IPC::Server>(opts.tcpAddress.substr(0, colon),
+                                         opts.tcpAddress.substr(colon + 1));
+}
+
+// One loom of a multi-loom server
+struct Loom
+{
+    Options opts;
+    std::unique_ptr<IPC::Server> server;
+    std::unique_ptr<LiftVerifier> verifier;
+    std::optional<IPC::Connection> connection;
+    std::unique_ptr<View> view;
+    bool done = false;
+    bool verified = true;
+    bool scripted = true;
+
+    // What the last session wove
+    decltype(View::cycleTotals) totals;
+    int late = 0, missed = 0, stalls = 0;
+
+    explicit Loom(Options o) : opts(std::move(o))
+    {
+        server = makeServer(opts);
+        if (!opts.verifyPath.empty())
+            verifier = std::make_unique<LiftVerifier>(opts);
+    }
+
+    void close()
+    {
+        if (view->cycling) {
+            view->cycling = false;
+            view->reportCycles();
+        }
+        view->finish(verified, scripted);
+        totals = view->cycleTotals;
+        late = view->latePicks;
+        missed = view->missedPicks;
+        stalls = view->stalls;
+        view.reset();
+        connection.reset();
+        done = true;
+    }
+};
+
+// Simulates many looms at once (--looms, --loom), each with its own socket
+// and settings, all served from one event loop until every DrawBoy is done
+void
+serveLooms(Options& opts)
+{
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, interruptHandler);
+    std::signal(SIGTERM, interruptHandler);
+
+    Term term(true, -1);
+    std::vector<std::unique_ptr<Loom>> looms;
+    for (size_t i = 0; i < (size_t)opts.looms; ++i) {
+        looms.push_back(std::make_unique<Loom>(opts.forLoom(i)));
+        std::printf("%s: %s, %d shafts, %s\r\n", looms.back()->opts.label.c_str(),
+                    looms.back()->opts.tcpAddress.empty() ? looms.back()->opts.socketPath.c_str()
+                                                          : looms.back()->opts.tcpAddress.c_str(),
+                    looms.back()->opts.maxShafts,
+                    looms.back()->opts.cd4 ? "CD IV" : "CD I-III");
+    }
+    std::fflush(stdout);
+
+    Poller poller;
+    std::vector<Poller::Ready> ready;
+    auto readyFor = [&ready](int fd) {
+        auto found = std::find_if(ready.begin(), ready.end(), [fd](auto& r) { return r.fd == fd; });
+        return found == ready.end() ? Poller::Ready{fd, false, false} : *found;
+    };
+    while (!interrupted) {
+        auto wait = std::chrono::steady_clock::duration(std::chrono::seconds(1));
+        bool waiting = false;
+        for (auto& loom: looms) {
+            if (loom->done)
+                continue;
+            waiting = true;
+            poller.watch(loom->server->fd(), !loom->view);
+            if (loom->view) {
+                poller.watch(loom->view->socketFD, loom->view->wantsInput(),
+                             loom->view->wantsOutput());
+                wait = std::min(wait, loom->view->waitTime());
+            }
+        }
+        if (!waiting)
+            break;
+        if (!poller.wait(wait, ready))
+            continue;
+
+        for (auto& loom: looms) {
+            if (loom->done)
+                continue;
+            if (!loom->view) {
+                if (!readyFor(loom->server->fd()).readable)
+                    continue;
+                try {
+                    loom->connection = loom->server->accept();
+                    if (!loom->connection)
+                        continue;
+                    poller.forget(loom->server->fd());
+                    loom->view = std::make_unique<View>(term, loom->opts, loom->verifier.get());
+                    loom->view->accepted(loom->connection->fd());
+                    std::printf("%s: DrawBoy connected.\r\n", loom->opts.label.c_str());
+                    std::fflush(stdout);
+                } catch (IPC::SocketError& se) {
+                    std::printf("\r\n%s: client connection failed: %s, ignoring\r\n",
+                                loom->opts.label.c_str(), se.what());
+                }
+                continue;
+            }
+            int fd = loom->view->socketFD;
+            auto io = readyFor(fd);
+            auto state = loom->view->service(io.readable, io.writable);
+            if (state || loom->view->mode != Mode::Run) {
+                poller.forget(fd);
+                loom->close();
+                std::printf("%s: DrawBoy closed.\r\n", loom->opts.label.c_str());
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    for (auto& loom: looms)
+        if (loom->view)
+            loom->close();
+
+    std::printf("\r\nLoom  protocol shafts    picks   picks/s  median ms     p99 ms   late missed stalls\r\n");
+    bool verified = true, scripted = true;
+    for (size_t i = 0; i < looms.size(); ++i) {
+        auto& loom = looms[i];
+        auto& t = loom->totals;
+        std::printf("%4zu  %-8s %6d %8zu %9.1f %10.3f %10.3f %6d %6d %6d\r\n",
+                    i + 1, loom->opts.cd4 ? "cd4" : "cd1-3",
+                    loom->opts.maxShafts, t.picks, t.picksPerSecond, t.p50, t.p99,
+                    loom->late, loom->missed, loom->stalls);
+        verified = verified && loom->verified;
+        scripted = scripted && loom->scripted;
+    }
+    std::fflush(stdout);
+    if (!verified)
+        throw std::runtime_error("DrawBoy sent lifts that do not match the draft.");
+    if (!scripted)
+        throw std::runtime_error("The scenario did not go as expected.");
+}
+}
+
 void
 driver(Options& opts)
 {
-    IPC::Server server(opts.socketPath);
+    if (opts.looms > 0) {
+        serveLooms(opts);
+        return;
+    }
+
+    std::unique_ptr<IPC::Server> server;
+    std::unique_ptr<PseudoTerminal> pty;
+    if (opts.pty) {
+        pty = std::make_unique<PseudoTerminal>();
+        // Scripts wait for this line to learn where to point DrawBoy
+        std::printf("Loom device: %s\n", pty->slavePath().c_str());
+        std::fflush(stdout);
+    } else {
+        server = makeServer(opts);
+    }
     LoopingState loop = LoopingState::ShouldWait;
     std::signal(SIGPIPE, SIG_IGN);
+    std::unique_ptr<LiftVerifier> verifier;
+    if (!opts.verifyPath.empty())
+        verifier = std::make_unique<LiftVerifier>(opts);
+    bool verified = true;
+    bool scripted = true;
     
     do {
-        Term term;
+        auto term = opts.headless ? std::make_unique<Term>(true, -1) : std::make_unique<Term>();
         
-        if (!term.good())
+        if (!term->good())
             throw std::runtime_error("Could not open terminal.");
         
-        View view(term, opts);
-        loop = view.run(server);
+        View view(*term, opts, verifier.get());
+        loop = pty ? view.run(*pty) : view.run(*server);
+        view.finish(verified, scripted);
         std::fputs("\r\n\nDrawBoy closed.\r\n", stdout);
     } while (loop != LoopingState::ShouldQuit);
+    if (!verified)
+        throw std::runtime_error("DrawBoy sent lifts that do not match the draft.");
+    if (!scripted)
+        throw std::runtime_error("The scenario did not go as expected.");
 }
@@ -0,0 +1,182 @@
+//
+//  fakefaults.cpp
+//  FakeLoom
+//
+
+#include "fakefaults.h"
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+namespace {
+const std::array<const char*, FaultCount> FaultNames{
+    "drop", "corrupt", "delay", "what", "error", "armNull", "halfOpen", "disconnect",
+};
+
+double
+median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+}
+
+bool
+FaultRates::any() const
+{
+    return std::any_of(rate.begin(), rate.end(), [](double r) { return r > 0.0; });
+}
+
+// A comma separated list of name=rate, e.g. drop=0.001,what=0.01,delayMs=250
+FaultRates
+parseFaults(std::string_view spec)
+{
+    FaultRates rates;
+    while (!spec.empty()) {
+        auto comma = spec.find(',');
+        auto item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        auto equals = item.find('=');
+        if (equals == std::string_view::npos)
+            throw std::runtime_error(std::format("Fault '{}' needs a rate, e.g. {}=0.01.", item, item));
+        auto name = item.substr(0, equals);
+        auto value = item.substr(equals + 1);
+        if (name == "delayMs") {
+            auto res = std::from_chars(value.data(), value.data() + value.size(), rates.delayMs);
+            if (res.ec != std::errc() || res.ptr != value.data() + value.size() || rates.delayMs < 0)
+                throw std::runtime_error(std::format("Bad fault delay '{}'.", value));
+            continue;
+        }
+        auto known = std::find(FaultNames.begin(), FaultNames.end(), name);
+        if (known == FaultNames.end())
+            throw std::runtime_error(std::format("Unknown fault '{}'.", name));
+        double& rate = rates.rate[(size_t)(known - FaultNames.begin())];
+        auto res = std::from_chars(value.data(), value.data() + value.size(), rate);
+        if (res.ec != std::errc() || res.ptr != value.data() + value.size() || rate < 0.0 || rate > 1.0)
+            throw std::runtime_error(std::format("Fault rate '{}' must be from 0 to 1.", value));
+    }
+    return rates;
+}
+
+
+FaultInjector::FaultInjector(const FaultRates& rates, uint64_t seed)
+: _rates(rates), _rng(seed)
+{ }
+
+bool
+FaultInjector::roll(Fault fault)
+{
+    double rate = _rates.rate[(size_t)fault];
+    return _armed && !_silent && rate > 0.0 &&
+           std::uniform_real_distribution<double>(0.0, 1.0)(_rng) < rate;
+}
+
+void
+FaultInjector::record(Fault fault, clock::time_point now)
+{
+    ++_stats[(size_t)fault].injected;
+    _open.push_back({fault, now});
+    if (fault == Fault::HalfOpen || fault == Fault::Disconnect)
+        _silent = true;
+}
+
+std::string
+FaultInjector::mangle(std::string_view bytes, clock::time_point now)
+{
+    std::string out;
+    out.reserve(bytes.size());
+    for (char c: bytes) {
+        if (roll(Fault::Drop)) {
+            record(Fault::Drop, now);
+            continue;
+        }
+        if (roll(Fault::Corrupt)) {
+            record(Fault::Corrupt, now);
+            c ^= (char)(1 << std::uniform_int_distribution<int>(0, 7)(_rng));
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+bool
+FaultInjector::inject(Fault fault, clock::time_point now)
+{
+    if (!roll(fault))
+        return false;
+    record(fault, now);
+    return true;
+}
+
+// DrawBoy has woven a pick since these faults
+void
+FaultInjector::picked(clock::time_point now)
+{
+    std::erase_if(_open, [this, now](const Open& open) {
+        if (open.fault == Fault::HalfOpen || open.fault == Fault::Disconnect)
+            return false;
+        _stats[(size_t)open.fault].recoveryMs.push_back(
+            std::chrono::duration<double, std::milli>(now - open.at).count());
+        return true;
+    });
+}
+
+void
+FaultInjector::closed(clock::time_point now)
+{
+    for (auto& open: _open) {
+        auto& stats = _stats[(size_t)open.fault];
+        ++stats.closed;
+        stats.recoveryMs.push_back(std::chrono::duration<double, std::milli>(now - open.at).count());
+    }
+    _open.clear();
+}
+
+void
+FaultInjector::report()
+{
+    std::printf("\r\nFault        injected  recovered  closed  median ms     max ms\r\n");
+    for (size_t i = 0; i < FaultCount; ++i) {
+        auto& stats = _stats[i];
+        if (_rates.rate[i] <= 0.0)
+            continue;
+        int recovered = (int)stats.recoveryMs.size() - stats.closed;
+        if (stats.recoveryMs.empty()) {
+            std::printf("%-12s %8d %10d %7d %10s %10s\r\n", FaultNames[i], stats.injected,
+                        recovered, stats.closed, "-", "-");
+        } else {
+            std::printf("%-12s %8d %10d %7d %10.3f %10.3f\r\n", FaultNames[i], stats.injected,
+                        recovered, stats.closed, median(stats.recoveryMs),
+                        *std::max_element(stats.recoveryMs.begin(), stats.recoveryMs.end()));
+        }
+    }
+    if (!_open.empty())
+        std::printf("%zu faults never noticed by DrawBoy\r\n", _open.size());
+    std::fflush(stdout);
+}
+
+void
+FaultInjector::writeJSON(std::FILE* out)
+{
+    std::fprintf(out, "  \"faults\": {");
+    const char* sep = "\n";
+    for (size_t i = 0; i < FaultCount; ++i) {
+        auto& stats = _stats[i];
+        if (_rates.rate[i] <= 0.0)
+            continue;
+        auto unnoticed = std::count_if(_open.begin(), _open.end(),
+                                       [i](const Open& open) { return (size_t)open.fault == i; });
+        std::fprintf(out, "%s    \"%s\": {\"rate\": %g, \"injected\": %d, \"recovered\": %d, "
+                     "\"closed\": %d, \"unnoticed\": %td", sep, FaultNames[i], _rates.rate[i],
+                     stats.injected, (int)stats.recoveryMs.size() - stats.closed, stats.closed,
+                     unnoticed);
+        if (!stats.recoveryMs.empty())
+            std::fprintf(out, ", \"medianRecoveryMs\": %.4f, \"maxRecoveryMs\": %.4f",
+                         median(stats.recoveryMs),
+                         *std::max_element(stats.recoveryMs.begin(), stats.recoveryMs.end()));
+        std::fprintf(out, "}");
+        sep = ",\n";
+    }
+    std::fprintf(out, "\n  },\n");
+}
@@ -0,0 +1,84 @@
+//
+//  fakefaults.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class Fault {
+    Drop,           // a byte to DrawBoy is lost
+    Corrupt,        // a byte to DrawBoy has a bit flipped
+    Delay,          // <ready> is held back (CD IV)
+    What,           // <what> instead of <ready> (CD IV)
+    Error,          // <error ...> instead of <ready> (CD IV)
+    ArmNull,        // <arm null> before the arms move (CD IV)
+    HalfOpen,       // the loom goes silent but keeps the connection open
+    Disconnect,     // the loom closes its side of the connection
+};
+
+constexpr size_t FaultCount = 8;
+
+// How often each fault happens (--faults). Drops and corruption are per
+// byte sent to DrawBoy, <arm null> is per arm movement, and the rest are
+// per message received from DrawBoy.
+struct FaultRates {
+    std::array<double, FaultCount> rate{};
+    int delayMs = 500;
+
+    bool any() const;
+};
+
+FaultRates parseFaults(std::string_view spec);
+
+// Injects faults and times how long DrawBoy takes to get over each one:
+// until the next pick arrives, or until DrawBoy closes the connection.
+class FaultInjector {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    FaultInjector(const FaultRates& rates, uint64_t seed);
+
+    void arm() { _armed = true; }                 // weaving has started
+    bool silent() const { return _silent; }       // after a half-open or disconnect
+
+    std::string mangle(std::string_view bytes, clock::time_point now);
+    bool inject(Fault fault, clock::time_point now);
+    int delayMs() const { return _rates.delayMs; }
+
+    void picked(clock::time_point now);
+    void closed(clock::time_point now);
+
+    void report();
+    void writeJSON(std::FILE* out);
+
+  private:
+    struct Stats {
+        int injected = 0;
+        int closed = 0;                 // DrawBoy closed the connection instead
+        std::vector<double> recoveryMs;
+    };
+
+    struct Open {
+        Fault fault;
+        clock::time_point at;
+    };
+
+    bool roll(Fault fault);
+    void record(Fault fault, clock::time_point now);
+
+    FaultRates _rates;
+    std::mt19937_64 _rng;
+    bool _armed = false;
+    bool _silent = false;
+    std::array<Stats, FaultCount> _stats;
+    std::vector<Open> _open;            // not recovered from yet
+};
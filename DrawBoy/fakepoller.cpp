@@ -0,0 +1,130 @@
+//
+//  fakepoller.cpp
+//  FakeLoom
+//
+
+#include "fakepoller.h"
+#include "argscommon.h"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+namespace {
+int
+timeoutMs(std::chrono::steady_clock::duration timeout)
+{
+    // Round up, or a wait of less than a millisecond would spin
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+    return (int)std::clamp<decltype(ms)>(ms, 0, 60000);
+}
+}
+
+#ifdef __linux__
+
+Poller::Poller()
+{
+    _epollFD = ::epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFD == -1)
+        throw make_system_error("Could not create epoll descriptor");
+}
+
+Poller::~Poller()
+{
+    ::close(_epollFD);
+}
+
+void
+Poller::watch(int fd, bool readable, bool writable)
+{
+    int interest = (readable ? Read : 0) | (writable ? Write : 0);
+    auto found = _watched.find(fd);
+    int op = EPOLL_CTL_MOD;
+    if (found == _watched.end()) {
+        if (!interest)
+            return;
+        op = EPOLL_CTL_ADD;
+    } else if (found->second == interest) {
+        return;
+    } else if (!interest) {
+        op = EPOLL_CTL_DEL;
+    }
+    epoll_event ev{};
+    ev.events = (readable ? EPOLLIN : 0u) | (writable ? EPOLLOUT : 0u);
+    ev.data.fd = fd;
+    if (::epoll_ctl(_epollFD, op, fd, &ev) == -1)
+        throw make_system_error("Could not change the epoll set");
+    if (interest)
+        _watched[fd] = interest;
+    else
+        _watched.erase(found);
+}
+
+bool
+Poller::wait(std::chrono::steady_clock::duration timeout, std::vector<Ready>& ready)
+{
+    ready.clear();
+    epoll_event events[64];
+    int n = ::epoll_wait(_epollFD, events, 64, timeoutMs(timeout));
+    if (n == -1) {
+        if (errno == EINTR)
+            return false;
+        throw make_system_error("epoll_wait failed");
+    }
+    for (int i = 0; i < n; ++i) {
+        // Errors and hangups are reported whatever was asked for
+        auto watched = _watched.find(events[i].data.fd);
+        int interest = watched == _watched.end() ? 0 : watched->second;
+        bool failed = events[i].events & (EPOLLERR | EPOLLHUP);
+        ready.push_back({events[i].data.fd,
+                         (interest & Read) && ((events[i].events & EPOLLIN) || failed),
+                         (interest & Write) && ((events[i].events & EPOLLOUT) || failed)});
+    }
+    return true;
+}
+
+#else
+
+Poller::Poller() { }
+Poller::~Poller() { }
+
+void
+Poller::watch(int fd, bool readable, bool writable)
+{
+    int interest = (readable ? Read : 0) | (writable ? Write : 0);
+    if (interest)
+        _watched[fd] = interest;
+    else
+        _watched.erase(fd);
+}
+
+bool
+Poller::wait(std::chrono::steady_clock::duration timeout, std::vector<Ready>& ready)
+{
+    ready.clear();
+    std::vector<pollfd> fds;
+    fds.reserve(_watched.size());
+    for (auto [fd, interest]: _watched)
+        fds.push_back({fd, (short)(((interest & Read) ? POLLIN : 0) | ((interest & Write) ? POLLOUT : 0)),
+                       0});
+    int n = ::poll(fds.data(), (nfds_t)fds.size(), timeoutMs(timeout));
+    if (n == -1) {
+        if (errno == EINTR)
+            return false;
+        throw make_system_error("poll failed");
+    }
+    for (auto& pfd: fds) {
+        // Errors and hangups are reported whatever was asked for
+        bool failed = pfd.revents & (POLLERR | POLLHUP | POLLNVAL);
+        if (pfd.revents)
+            ready.push_back({pfd.fd, (pfd.events & POLLIN) && ((pfd.revents & POLLIN) || failed),
+                             (pfd.events & POLLOUT) && ((pfd.revents & POLLOUT) || failed)});
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,44 @@
+//
+//  fakepoller.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Waits for any of many descriptors to become readable or writable. Uses
+// epoll on Linux and poll(2) elsewhere. The set of descriptors is kept
+// between waits, so only changes cost anything.
+class Poller {
+  public:
+    Poller();
+    ~Poller();
+
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    struct Ready {
+        int fd;
+        bool readable;                      // or hung up
+        bool writable;
+    };
+
+    // Adds, changes or, wanting neither, removes fd
+    void watch(int fd, bool readable, bool writable = false);
+    void forget(int fd) { watch(fd, false); }
+
+    // Fills ready with the descriptors that can be read or written as
+    // watched, returns false if a signal interrupted the wait
+    bool wait(std::chrono::steady_clock::duration timeout, std::vector<Ready>& ready);
+
+  private:
+    enum Interest { Read = 1, Write = 2 };
+
+    std::map<int, int> _watched;            // fd to Interest bits
+#ifdef __linux__
+    int _epollFD = -1;
+#endif
+};
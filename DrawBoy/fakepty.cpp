@@ -0,0 +1,59 @@
+//
+//  fakepty.cpp
+//  FakeLoom
+//
+
+#include "fakepty.h"
+#include "argscommon.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+PseudoTerminal::PseudoTerminal()
+{
+    _masterFD = ::posix_openpt(O_RDWR | O_NOCTTY);
+    if (_masterFD == -1)
+        throw make_system_error("Could not create a pseudo-terminal");
+    const char* name = nullptr;
+    int flags = -1;
+    if (::grantpt(_masterFD) == 0 && ::unlockpt(_masterFD) == 0)
+        name = ::ptsname(_masterFD);
+    if (name)
+        flags = ::fcntl(_masterFD, F_GETFL);
+    if (flags == -1 || ::fcntl(_masterFD, F_SETFL, flags | O_NONBLOCK) == -1 ||
+        ::fcntl(_masterFD, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        ::close(_masterFD);
+        throw make_system_error("Could not set up the pseudo-terminal");
+    }
+    _slavePath = name;
+
+    // Until DrawBoy sets up the port, the slave would echo what the loom
+    // sends back to it. Make it raw now; closing it again also leaves the
+    // master hung up until DrawBoy opens the slave.
+    int slaveFD = ::open(name, O_RDWR | O_NOCTTY);
+    termios term;
+    if (slaveFD == -1 || ::tcgetattr(slaveFD, &term) == -1) {
+        if (slaveFD != -1)
+            ::close(slaveFD);
+        ::close(_masterFD);
+        throw make_system_error("Could not open the pseudo-terminal");
+    }
+    ::cfmakeraw(&term);
+    ::tcsetattr(slaveFD, TCSANOW, &term);
+    ::close(slaveFD);
+}
+
+PseudoTerminal::~PseudoTerminal()
+{
+    ::close(_masterFD);
+}
+
+bool
+PseudoTerminal::slaveOpen() const
+{
+    pollfd pfd{_masterFD, POLLIN, 0};
+    return ::poll(&pfd, 1, 0) >= 0 && !(pfd.revents & POLLHUP);
+}
@@ -0,0 +1,30 @@
+//
+//  fakepty.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include <string>
+
+// The loom end of a pseudo-terminal pair (--pty). DrawBoy opens the slave
+// as its loom device and goes through its serial port code; fakeloom reads
+// and writes the master. A serial line has no connections, so DrawBoy is
+// taken to be there while it holds the slave open.
+class PseudoTerminal {
+  public:
+    PseudoTerminal();
+    ~PseudoTerminal();
+
+    PseudoTerminal(const PseudoTerminal&) = delete;
+    PseudoTerminal& operator=(const PseudoTerminal&) = delete;
+
+    int fd() const { return _masterFD; }
+    const std::string& slavePath() const { return _slavePath; }
+
+    bool slaveOpen() const;     // has DrawBoy opened the slave?
+
+  private:
+    int _masterFD = -1;
+    std::string _slavePath;
+};
@@ -0,0 +1,417 @@
+//
+//  fakescenario.cpp
+//  FakeLoom
+//
+
+#include "fakescenario.h"
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <format>
+#include <stdexcept>
+
+namespace {
+class Parser {
+  public:
+    Parser(std::string_view text, std::vector<Scenario::Step>& steps)
+    : _text(text), _steps(steps) {}
+
+    void parse()
+    {
+        sequence();
+        if (_pos < _text.size())
+            error(std::format("unexpected '{}'", _text[_pos]));
+    }
+
+  private:
+    std::string_view _text;
+    std::vector<Scenario::Step>& _steps;
+    size_t _pos = 0;
+    int _line = 1;
+
+    [[noreturn]] void error(const std::string& msg)
+    {
+        throw std::runtime_error(std::format("Scenario line {}: {}.", _line, msg));
+    }
+
+    // Skips white space, commas and comments
+    void skip(bool commas = true)
+    {
+        while (_pos < _text.size()) {
+            char c = _text[_pos];
+            if (c == '\n') {
+                ++_line;
+            } else if (c == '#') {
+                while (_pos < _text.size() && _text[_pos] != '\n')
+                    ++_pos;
+                continue;
+            } else if (!std::isspace((unsigned char)c) && !(commas && c == ',')) {
+                return;
+            }
+            ++_pos;
+        }
+    }
+
+    bool peek(char c)
+    {
+        return _pos < _text.size() && _text[_pos] == c;
+    }
+
+    void expect(char c)
+    {
+        skip(false);
+        if (!peek(c))
+            error(std::format("'{}' expected", c));
+        ++_pos;
+    }
+
+    std::string word()
+    {
+        size_t start = _pos;
+        while (_pos < _text.size() && std::isalpha((unsigned char)_text[_pos]))
+            ++_pos;
+        return std::string(_text.substr(start, _pos - start));
+    }
+
+    uint64_t number()
+    {
+        uint64_t n = 0;
+        auto res = std::from_chars(_text.data() + _pos, _text.data() + _text.size(), n);
+        if (res.ec != std::errc())
+            error("number expected");
+        _pos = (size_t)(res.ptr - _text.data());
+        return n;
+    }
+
+    int duration()
+    {
+        skip(false);
+        uint64_t n = number();
+        return durationUnit(n);
+    }
+
+    int durationUnit(uint64_t n)
+    {
+        std::string unit = word();
+        if (unit == "ms" && n <= 86400000)
+            return (int)n;
+        if (unit == "s" && n <= 86400)
+            return (int)n * 1000;
+        if (unit == "ms" || unit == "s")
+            error("waits are limited to a day");
+        error("ms or s expected after a number");
+    }
+
+    Scenario::Step& add(Scenario::Op op)
+    {
+        auto& step = _steps.emplace_back();
+        step.op = op;
+        step.line = _line;
+        return step;
+    }
+
+    void sequence()
+    {
+        for (skip(); _pos < _text.size() && !peek(')'); skip())
+            item();
+    }
+
+    void item()
+    {
+        char c = _text[_pos];
+        if (std::isdigit((unsigned char)c)) {
+            uint64_t n = number();
+            if (peek('x')) {
+                ++_pos;
+                expect('(');
+                size_t repeat = _steps.size();
+                add(Scenario::Op::Repeat).count = n;
+                sequence();
+                expect(')');
+                auto& next = add(Scenario::Op::Next);
+                next.target = repeat;
+                _steps[repeat].target = _steps.size() - 1;
+                return;
+            }
+            auto& wait = add(Scenario::Op::Wait);
+            wait.ms = durationUnit(n);
+            if (peek('~')) {
+                ++_pos;
+                wait.jitterMs = std::min(duration(), wait.ms);
+            }
+            return;
+        }
+        if (c == '"') {
+            keys();
+            return;
+        }
+        std::string name = word();
+        if (name == "d" || name == "down") {
+            add(Scenario::Op::Down);
+        } else if (name == "u" || name == "up") {
+            add(Scenario::Op::Up);
+        } else if (name == "n" || name == "neutral") {
+            add(Scenario::Op::Neutral);
+        } else if (name == "seed") {
+            expect('(');
+            skip(false);
+            add(Scenario::Op::Seed).count = number();
+            expect(')');
+        } else if (name == "expect") {
+            expectation();
+        } else if (name.empty()) {
+            error(std::format("unexpected '{}'", c));
+        } else {
+            error(std::format("unknown step '{}'", name));
+        }
+    }
+
+    void keys()
+    {
+        auto& step = add(Scenario::Op::Keys);
+        ++_pos;
+        while (true) {
+            if (_pos >= _text.size() || _text[_pos] == '\n')
+                error("unterminated keys");
+            char c = _text[_pos++];
+            if (c == '"')
+                break;
+            if (c != '\\') {
+                step.keys.push_back(c);
+                continue;
+            }
+            if (_pos >= _text.size())
+                error("unterminated keys");
+            switch (char e = _text[_pos++]) {
+                case 'r':  step.keys.push_back('\r'); break;
+                case 'n':  step.keys.push_back('\n'); break;
+                case 't':  step.keys.push_back('\t'); break;
+                case '\\':
+                case '"':  step.keys.push_back(e); break;
+                case 'x': {
+                    unsigned value = 0;
+                    auto res = std::from_chars(_text.data() + _pos,
+                                               _text.data() + std::min(_pos + 2, _text.size()),
+                                               value, 16);
+                    if (res.ec != std::errc() || res.ptr != _text.data() + _pos + 2)
+                        error("two hex digits expected after \\x");
+                    _pos += 2;
+                    step.keys.push_back((char)value);
+                    break;
+                }
+                default:
+                    error(std::format("unknown escape '\\{}'", e));
+            }
+        }
+        if (step.keys.empty())
+            error("no keys between the quotes");
+    }
+
+    void expectation()
+    {
+        expect('(');
+        skip(false);
+        auto& step = add(Scenario::Op::Expect);
+        step.ms = 1000;
+        std::string name = word();
+        if (name == "pick") {
+            step.event = Scenario::Event::Pick;
+        } else if (name == "lift") {
+            step.event = Scenario::Event::Pick;
+            step.anyLift = false;
+            for (skip(false); _pos < _text.size() && std::isdigit((unsigned char)_text[_pos]); skip(false)) {
+                uint64_t shaft = number();
+                if (shaft < 1 || shaft > 64)
+                    error("shafts are 1 to 64");
+                step.lift |= 1ull << (shaft - 1);
+            }
+        } else if (name == "reset") {
+            step.event = Scenario::Event::Reset;
+        } else if (name == "password") {
+            step.event = Scenario::Event::Password;
+        } else if (name == "close") {
+            step.event = Scenario::Event::Close;
+        } else {
+            error("pick, lift, reset, password or close expected");
+        }
+        skip(false);
+        if (peek(',')) {
+            ++_pos;
+            step.ms = duration();
+        }
+        expect(')');
+    }
+};
+
+const char*
+eventName(Scenario::Event event)
+{
+    switch (event) {
+        case Scenario::Event::Pick:     return "pick";
+        case Scenario::Event::Reset:    return "solenoid reset";
+        case Scenario::Event::Password: return "password";
+        case Scenario::Event::Close:    return "close";
+    }
+    return "";
+}
+
+const size_t MaxSeen = 64;
+}
+
+Scenario::Scenario(std::string_view text)
+{
+    Parser(text, steps).parse();
+}
+
+Scenario
+Scenario::fromAuto(std::string_view autoInput)
+{
+    Scenario scenario;
+    for (size_t i = 0; i < autoInput.size(); ++i) {
+        char c = autoInput[i];
+        Step step;
+        step.line = 1;
+        if (std::isdigit((unsigned char)c)) {
+            auto res = std::from_chars(autoInput.data() + i, autoInput.data() + autoInput.size(),
+                                       step.ms);
+            i = (size_t)(res.ptr - autoInput.data()) - 1;
+            step.op = Op::Wait;
+            step.ms = std::min(step.ms, 86400) * 1000;
+        } else if (c == 'u' || c == 'd') {
+            step.op = c == 'u' ? Op::Up : Op::Down;
+        } else if (std::isalpha((unsigned char)c)) {
+            step.op = Op::Keys;
+            step.keys.push_back(c);
+        } else {
+            continue;
+        }
+        scenario.steps.push_back(std::move(step));
+    }
+    return scenario;
+}
+
+
+ScenarioRunner::ScenarioRunner(const Scenario& scenario, uint64_t seed)
+: _scenario(scenario), _rng(seed)
+{ }
+
+void
+ScenarioRunner::start(clock::time_point now)
+{
+    _started = true;
+    _wakeAt = now;
+}
+
+int
+ScenarioRunner::line() const
+{
+    if (_scenario.steps.empty())
+        return 0;
+    return _scenario.steps[std::min(_pc, _scenario.steps.size() - 1)].line;
+}
+
+const Scenario::Step*
+ScenarioRunner::next(clock::time_point now)
+{
+    if (!_started)
+        return nullptr;
+    while (_pc < _scenario.steps.size()) {
+        const auto& step = _scenario.steps[_pc];
+        switch (step.op) {
+            case Scenario::Op::Down:
+            case Scenario::Op::Up:
+            case Scenario::Op::Neutral:
+            case Scenario::Op::Keys:
+                ++_pc;
+                return &step;
+
+            case Scenario::Op::Wait:
+                if (!_pending) {
+                    int ms = step.ms;
+                    if (step.jitterMs)
+                        ms += std::uniform_int_distribution<int>(-step.jitterMs, step.jitterMs)(_rng);
+                    _wakeAt = now + std::chrono::milliseconds(ms);
+                    _pending = true;
+                }
+                if (now < _wakeAt)
+                    return nullptr;
+                _pending = false;
+                ++_pc;
+                break;
+
+            case Scenario::Op::Seed:
+                _rng.seed(step.count);
+                ++_pc;
+                break;
+
+            case Scenario::Op::Expect:
+                if (!_pending) {
+                    ++_expectations;
+                    _wakeAt = _deadline = now + std::chrono::milliseconds(step.ms);
+                    _pending = true;
+                }
+                if (!consume(step)) {
+                    if (now < _deadline)
+                        return nullptr;
+                    ++_failures;
+                    std::printf("\r\nScenario line %d: no %s within %d ms.\r\n", step.line,
+                                step.anyLift ? eventName(step.event) : "matching lift", step.ms);
+                    std::fflush(stdout);
+                }
+                _pending = false;
+                ++_pc;
+                break;
+
+            case Scenario::Op::Repeat:
+                if (step.count == 0) {
+                    _pc = step.target + 1;
+                } else {
+                    _loops.push_back(step.count);
+                    ++_pc;
+                }
+                break;
+
+            case Scenario::Op::Next:
+                if (--_loops.back() > 0) {
+                    _pc = step.target + 1;
+                } else {
+                    _loops.pop_back();
+                    ++_pc;
+                }
+                break;
+        }
+    }
+    return nullptr;
+}
+
+void
+ScenarioRunner::observed(Scenario::Event event, uint64_t lift)
+{
+    if (!_started || done())
+        return;
+    if (_seen.size() >= MaxSeen)
+        _seen.pop_front();
+    _seen.push_back({event, lift});
+    // Check a waiting expectation right away
+    if (_pending && _scenario.steps[_pc].op == Scenario::Op::Expect)
+        _wakeAt = clock::time_point();
+}
+
+bool
+ScenarioRunner::matches(const Scenario::Step& step, const Seen& seen) const
+{
+    return seen.event == step.event && (step.anyLift || seen.lift == step.lift);
+}
+
+// Uses up what DrawBoy has sent, up to and including the first match
+bool
+ScenarioRunner::consume(const Scenario::Step& step)
+{
+    while (!_seen.empty()) {
+        Seen seen = _seen.front();
+        _seen.pop_front();
+        if (matches(step, seen))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,116 @@
+//
+//  fakescenario.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A scripted weaving session (--scenario). The text is a list of steps,
+// separated by commas or white space, with # starting a comment:
+//
+//   d  u  n              lower, raise or center the arms
+//   "s"                  type these keys (\r, \n, \t, \\, \" and \xHH escapes)
+//   250ms  2s            wait
+//   100ms~20ms           wait 80 to 120 ms, picked at random
+//   seed(42)             restart the random waits from this seed
+//   expect(pick)         wait for DrawBoy to send a pick
+//   expect(lift 1 3 5)   wait for a pick that lifts exactly these shafts
+//   expect(reset)  expect(password)  expect(close)
+//   expect(pick, 50ms)   fail if it takes longer than 50 ms (1 s by default)
+//   100x(d, expect(pick), u)
+//                        do the steps in the parentheses 100 times
+class Scenario {
+  public:
+    enum class Op {
+        Down,
+        Up,
+        Neutral,
+        Keys,
+        Wait,
+        Seed,
+        Expect,
+        Repeat,         // start of a loop, count times
+        Next,           // end of a loop, jumps back to target
+    };
+
+    enum class Event {
+        Pick,
+        Reset,
+        Password,
+        Close,
+    };
+
+    struct Step {
+        Op op;
+        int line;
+        std::string keys;
+        int ms = 0;                 // wait, or expect timeout
+        int jitterMs = 0;
+        uint64_t count = 0;         // repeat count or seed
+        Event event = Event::Pick;
+        bool anyLift = true;
+        uint64_t lift = 0;
+        size_t target = 0;          // index of the matching Repeat or Next
+    };
+
+    explicit Scenario(std::string_view text);
+    static Scenario fromAuto(std::string_view autoInput);   // the old --auto strings
+
+    std::vector<Step> steps;
+
+  private:
+    Scenario() = default;
+};
+
+// Steps through a scenario as time passes and DrawBoy answers
+class ScenarioRunner {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    ScenarioRunner(const Scenario& scenario, uint64_t seed);
+
+    void start(clock::time_point now);
+    bool started() const { return _started; }
+
+    // The next step for the loom to act on (arms or keys), or nullptr
+    // when the scenario is waiting or done
+    const Scenario::Step* next(clock::time_point now);
+
+    void observed(Scenario::Event event, uint64_t lift);
+
+    bool pending() const { return _pending; }     // on a wait or an expectation
+    clock::time_point wakeAt() const { return _wakeAt; }
+    bool done() const { return _pc >= _scenario.steps.size(); }
+    int expectations() const { return _expectations; }
+    int failures() const { return _failures; }
+    int line() const;
+
+  private:
+    struct Seen {
+        Scenario::Event event;
+        uint64_t lift;
+    };
+
+    bool matches(const Scenario::Step& step, const Seen& seen) const;
+    bool consume(const Scenario::Step& step);
+
+    const Scenario& _scenario;
+    std::mt19937_64 _rng;
+    size_t _pc = 0;
+    std::vector<uint64_t> _loops;   // iterations left, innermost last
+    bool _started = false;
+    bool _pending = false;
+    clock::time_point _wakeAt;
+    clock::time_point _deadline;    // for the expectation
+    std::deque<Seen> _seen;         // since the last expectation was met
+    int _expectations = 0;
+    int _failures = 0;
+};
@@ -0,0 +1,78 @@
+//
+//  faketelnet.cpp
+//  FakeLoom
+//
+
+#include "faketelnet.h"
+
+namespace {
+const uint8_t SE = 240;
+const uint8_t SB = 250;
+const uint8_t WILL = 251;
+const uint8_t WONT = 252;
+const uint8_t DO = 253;
+const uint8_t DONT = 254;
+const uint8_t IAC = 255;
+}
+
+bool
+TelnetFilter::filter(char c, std::string& reply)
+{
+    auto b = (uint8_t)c;
+    switch (_state) {
+        case State::Data:
+            if (b != IAC)
+                return true;
+            _state = State::IAC;
+            return false;
+
+        case State::IAC:
+            if (b == IAC) {             // an escaped 0xff
+                _state = State::Data;
+                return true;
+            }
+            ++_commands;
+            if (b == WILL || b == WONT || b == DO || b == DONT) {
+                _verb = b;
+                _state = State::Option;
+            } else if (b == SB) {
+                _state = State::Sub;
+            } else {
+                _state = State::Data;   // NOP, AYT, GA and the like are ignored
+            }
+            return false;
+
+        case State::Option:
+            // Refuse whatever is offered or asked for; don't answer refusals
+            if (_verb == WILL || _verb == DO) {
+                reply.push_back((char)IAC);
+                reply.push_back((char)(_verb == WILL ? DONT : WONT));
+                reply.push_back(c);
+            }
+            _state = State::Data;
+            return false;
+
+        case State::Sub:
+            if (b == IAC)
+                _state = State::SubIAC;
+            return false;
+
+        case State::SubIAC:
+            _state = b == SE ? State::Data : State::Sub;
+            return false;
+    }
+    return false;
+}
+
+std::string
+TelnetFilter::escape(std::string_view data)
+{
+    std::string out;
+    out.reserve(data.size());
+    for (char c: data) {
+        out.push_back(c);
+        if ((uint8_t)c == IAC)
+            out.push_back(c);
+    }
+    return out;
+}
@@ -0,0 +1,37 @@
+//
+//  faketelnet.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// The telnet side of a networked Compu-Dobby IV (--tcp). The loom never
+// starts a negotiation; it strips telnet commands from what it receives
+// and refuses every option the other end asks for.
+class TelnetFilter {
+  public:
+    // Returns whether c is data. Anything to send back is added to reply.
+    bool filter(char c, std::string& reply);
+
+    // Doubles any IAC bytes in data going out
+    static std::string escape(std::string_view data);
+
+    int commands() const { return _commands; }
+
+  private:
+    enum class State {
+        Data,
+        IAC,            // after IAC
+        Option,         // after IAC WILL, WONT, DO or DONT
+        Sub,            // in a subnegotiation
+        SubIAC,         // after IAC in a subnegotiation
+    };
+
+    State _state = State::Data;
+    uint8_t _verb = 0;
+    int _commands = 0;
+};
@@ -0,0 +1,114 @@
+//
+//  faketiming.cpp
+//  FakeLoom
+//
+
+#include "faketiming.h"
+#include <algorithm>
+
+ArmClock::ArmClock(int picksPerMinute, int shedWindowMs, int jitterMs, JitterShape shape,
+                   uint64_t seed)
+: _period(std::chrono::duration_cast<clock::duration>(std::chrono::minutes(1)) / picksPerMinute),
+  _window(std::chrono::milliseconds(shedWindowMs)),
+  _jitterMs(jitterMs), _shape(shape), _rng(seed)
+{
+    if (_window <= clock::duration::zero() || _window >= _period)
+        _window = _period / 2;
+}
+
+void
+ArmClock::start(clock::time_point now)
+{
+    _start = _down = now;
+    _cycle = 0;
+}
+
+void
+ArmClock::next()
+{
+    ++_cycle;
+    auto down = _start + _period * (int64_t)_cycle + jitter();
+    // Arms cannot come down again before they are up
+    _down = std::max(down, upAt() + std::chrono::milliseconds(1));
+}
+
+ArmClock::clock::duration
+ArmClock::jitter()
+{
+    if (_jitterMs <= 0.0)
+        return clock::duration::zero();
+    double ms;
+    if (_shape == JitterShape::Uniform) {
+        ms = std::uniform_real_distribution<double>(-_jitterMs, _jitterMs)(_rng);
+    } else {
+        ms = std::normal_distribution<double>(0.0, _jitterMs)(_rng);
+    }
+    // Never so far that the cycles would run into each other
+    auto limit = std::chrono::duration<double, std::milli>(_period - _window).count() / 2.0;
+    ms = std::clamp(ms, -limit, limit);
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+
+namespace {
+// Start bit, data bits, parity bit and stop bits of each byte
+int
+bitsPerByte(SerialSpeed speed)
+{
+    return speed == SerialSpeed::Baud1200 ? 1 + 7 + 1 + 2 : 1 + 8 + 1;
+}
+
+int
+baud(SerialSpeed speed)
+{
+    return speed == SerialSpeed::Baud1200 ? 1200 : 9600;
+}
+}
+
+SerialLink::SerialLink(SerialSpeed speed)
+: _byteTime(std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) *
+            bitsPerByte(speed) / baud(speed))
+{ }
+
+void
+SerialLink::queue(std::string_view bytes, clock::time_point now)
+{
+    if (bytes.empty())
+        return;
+    if (_out.empty())
+        _outAt = std::max(now, _outFree) + _byteTime;
+    _out.append(bytes);
+}
+
+std::string
+SerialLink::due(clock::time_point now)
+{
+    size_t count = 0;
+    while (count < _out.size() && _outAt <= now) {
+        _outFree = _outAt;
+        _outAt += _byteTime;
+        ++count;
+    }
+    std::string bytes = _out.substr(0, count);
+    _out.erase(0, count);
+    return bytes;
+}
+
+void
+SerialLink::arrived(char c, clock::time_point now)
+{
+    _in = c;
+    _holding = true;
+    _inAt = std::max(now, _inFree) + _byteTime;
+}
+
+bool
+SerialLink::received(clock::time_point now, char& c)
+{
+    if (!_holding || now < _inAt)
+        return false;
+    c = _in;
+    _holding = false;
+    _inFree = _inAt;
+    return true;
+}
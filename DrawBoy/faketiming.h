@@ -0,0 +1,85 @@
+//
+//  faketiming.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+
+enum class JitterShape {
+    Normal,         // the jitter is the standard deviation
+    Uniform,        // the jitter is the most the timing moves either way
+};
+
+enum class SerialSpeed {
+    None,           // bytes arrive as fast as the socket carries them
+    Baud1200,       // Compu-Dobby I: 1200 baud, 7 data bits, even parity, 2 stop bits
+    Baud9600,       // Compu-Dobby II-IV: 9600 baud, 8 data bits, no parity, 1 stop bit
+};
+
+// When the arms go down and up for a loom weaving at a steady rate. Each
+// cycle starts one period after the last, moved by the jitter, and the
+// shed stays open for the shed window.
+class ArmClock {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    ArmClock(int picksPerMinute, int shedWindowMs, int jitterMs, JitterShape shape,
+             uint64_t seed);
+
+    void start(clock::time_point now);
+    void next();                    // on to the next cycle
+
+    clock::time_point downAt() const { return _down; }
+    clock::time_point upAt() const { return _down + _window; }
+
+  private:
+    clock::duration jitter();
+
+    clock::duration _period;
+    clock::duration _window;
+    double _jitterMs;
+    JitterShape _shape;
+    std::mt19937_64 _rng;           // the same jitter every run with the same seed
+    clock::time_point _start;
+    clock::time_point _down;
+    uint64_t _cycle = 0;
+};
+
+// A serial link between DrawBoy and the loom, which carries one byte at a
+// time at the speed of the line. Bytes sent to DrawBoy are queued and let
+// out as the line would carry them. Bytes from DrawBoy are read from the
+// socket one at a time and held until they would have arrived.
+class SerialLink {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    explicit SerialLink(SerialSpeed speed);
+
+    void queue(std::string_view bytes, clock::time_point now);
+    bool sending() const { return !_out.empty(); }
+    clock::time_point nextSendAt() const { return _outAt; }
+    std::string due(clock::time_point now);     // bytes the line has carried by now
+
+    bool holding() const { return _holding; }
+    void arrived(char c, clock::time_point now);
+    clock::time_point nextReceiveAt() const { return _inAt; }
+    bool received(clock::time_point now, char& c);
+
+    clock::duration byteTime() const { return _byteTime; }
+
+  private:
+    clock::duration _byteTime;
+    std::string _out;
+    clock::time_point _outAt;       // when the first queued byte is through
+    clock::time_point _outFree;     // when the line to DrawBoy is next free
+    char _in = 0;
+    bool _holding = false;
+    clock::time_point _inAt;        // when the held byte is through
+    clock::time_point _inFree;
+};
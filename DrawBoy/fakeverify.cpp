@@ -0,0 +1,191 @@
+//
+//  fakeverify.cpp
+//  FakeLoom
+//
+
+#include "fakeverify.h"
+#include "draft.h"
+#include "dtx.h"
+#include "picklist.h"
+#include "wif.h"
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+// How far ahead a lift is looked for before it is called wrong
+constexpr uint64_t SkipWindow = 8;
+constexpr size_t ProblemsShown = 20;
+
+std::string
+shaftList(uint64_t lift)
+{
+    std::string list;
+    for (int shaft = 1; lift; lift >>= 1, ++shaft)
+        if (lift & 1) {
+            if (!list.empty()) list.push_back(',');
+            list.append(std::to_string(shaft));
+        }
+    return list.empty() ? "none" : list;
+}
+
+}
+
+LiftVerifier::LiftVerifier(const Options& opts)
+: _draftPath(opts.verifyPath), _threading(opts.treadleThreading)
+{
+    std::unique_ptr<draft> draftContents;
+    if (auto draftFile = std::ifstream(_draftPath)) {
+        if (_draftPath.ends_with(".wif"))
+            draftContents = std::make_unique<wif>(draftFile);
+        else if (_draftPath.ends_with(".dtx"))
+            draftContents = std::make_unique<dtx>(draftFile);
+        else
+            throw std::runtime_error("Unknown draft file type (not wif or dtx).");
+    } else {
+        throw make_system_error("Cannot open draft file");
+    }
+    const draft& d = *draftContents;
+    // DrawBoy rejects the same pick lists, although it weaves the threading
+    // without one
+    std::vector<int> picks = parsePickList(opts.picks, d.picks, opts.tabbyPattern, _threading);
+    if (opts.pick < 1 || (!_threading && (size_t)opts.pick > picks.size()))
+        throw std::runtime_error("The start pick is not in the pick list.");
+    if (_threading && d.ends < 1)
+        throw std::runtime_error("The draft has no threading to treadle.");
+
+    // DrawBoy inverts the liftplan when the dobby type and the draft's shed
+    // disagree, weaving a virtual positive dobby as a positive one, limits
+    // the tabbies to the loom's shafts and, for CD I-III, only sends whole
+    // groups of four shafts. The threading is sent as it is.
+    uint64_t draftMask = (1ull << d.maxShafts) - 1;
+    uint64_t loomMask = (1ull << opts.maxShafts) - 1;
+    uint64_t sentMask = opts.cd4 ? ~0ull : (1ull << ((d.maxShafts + 3) / 4 * 4)) - 1;
+    bool invert = (opts.dobbyType == DobbyType::Negative) == d.risingShed;
+    if (opts.dobbyType == DobbyType::Virtual)
+        _clearLift = loomMask;
+
+    size_t count = _threading ? (size_t)d.ends : picks.size();
+    _expected.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = (i + (size_t)opts.pick - 1) % count;
+        int wifPick;
+        uint64_t lift;
+        if (_threading) {
+            wifPick = (int)index + 1;
+            lift = d.threading[index + 1];
+        } else if ((wifPick = picks[index]) < 0) {
+            lift = (wifPick == TabbyA ? opts.tabbyA : opts.tabbyB) & loomMask;
+        } else {
+            lift = d.liftplan[(size_t)wifPick];
+            if (invert)
+                lift ^= draftMask;
+        }
+        lift &= sentMask;
+        // A CD IV is sent nothing for a pick that raises no shafts
+        if (opts.cd4 && lift == 0)
+            continue;
+        _expected.push_back({lift, wifPick});
+    }
+    if (_expected.empty())
+        throw std::runtime_error("No pick in the pick list raises any shafts.");
+}
+
+void
+LiftVerifier::restart()
+{
+    _next = _received = _right = _wrong = _repeated = _skipped = _problemCount = 0;
+    _problems.clear();
+    _clearPending = false;
+}
+
+std::string
+LiftVerifier::pickName(int draftPick) const
+{
+    if (_threading)
+        return std::format("end {}", draftPick);
+    if (draftPick == TabbyA)
+        return "tabby A";
+    if (draftPick == TabbyB)
+        return "tabby B";
+    return std::format("pick {}", draftPick);
+}
+
+void
+LiftVerifier::problem(uint64_t lift, const std::string& what)
+{
+    if (_problemCount++ < ProblemsShown)
+        _problems.push_back(std::format("lift {}: shafts {} {}", _received, shaftList(lift), what));
+}
+
+void
+LiftVerifier::received(uint64_t lift)
+{
+    if (_clearPending) {
+        _clearPending = false;
+        check(_clearLift);
+    }
+    if (_clearLift && lift == _clearLift)
+        _clearPending = true;
+    else
+        check(lift);
+}
+
+void
+LiftVerifier::closed()
+{
+    _clearPending = false;
+}
+
+void
+LiftVerifier::check(uint64_t lift)
+{
+    ++_received;
+    if (lift == at(_next).lift) {
+        ++_right;
+        ++_next;
+        return;
+    }
+    if (_next > 0 && lift == at(_next - 1).lift) {
+        ++_repeated;
+        problem(lift, "repeated");
+        return;
+    }
+    for (uint64_t ahead = 1; ahead <= SkipWindow && ahead < _expected.size(); ++ahead) {
+        if (lift == at(_next + ahead).lift) {
+            _skipped += ahead;
+            problem(lift, ahead == 1 ? std::format("after skipping {}", pickName(at(_next).draftPick)) :
+                std::format("after skipping {} picks from {}", ahead, pickName(at(_next).draftPick)));
+            ++_right;
+            _next += ahead + 1;
+            return;
+        }
+    }
+    ++_wrong;
+    problem(lift, std::format("instead of {} with shafts {}", pickName(at(_next).draftPick),
+                              shaftList(at(_next).lift)));
+    ++_next;
+}
+
+bool
+LiftVerifier::report()
+{
+    // DrawBoy went away without closing after the last lift
+    if (_clearPending) {
+        _clearPending = false;
+        check(_clearLift);
+    }
+    bool good = _wrong == 0 && _repeated == 0 && _skipped == 0;
+    std::printf("\r\nVerified %llu lifts against %s: %llu right, %llu wrong, %llu repeated, "
+                "%llu picks skipped\r\n", (unsigned long long)_received, _draftPath.c_str(),
+                (unsigned long long)_right, (unsigned long long)_wrong,
+                (unsigned long long)_repeated, (unsigned long long)_skipped);
+    for (auto& text: _problems)
+        std::printf("  %s\r\n", text.c_str());
+    if (_problemCount > _problems.size())
+        std::printf("  ...\r\n");
+    std::fflush(stdout);
+    return good;
+}
@@ -0,0 +1,60 @@
+//
+//  fakeverify.h
+//  FakeLoom
+//
+
+#pragma once
+
+#include "fakeargs.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Checks the lifts DrawBoy sends against the lifts it should send, worked
+// out from the same draft, pick list and tabbies. Each lift received is
+// matched against the next expected one; a lift that matches the one before
+// is counted as repeated and one that matches a little further on as having
+// skipped the picks in between.
+//
+// Only weaving straight on from the start pick is modelled: DrawBoy must not
+// be told to change the pick, the direction or tabby mode. With --threading
+// the lifts are the threading's, end by end. When DrawBoy weaves a negative
+// Compu-Dobby IV as a virtual positive dobby it raises every shaft just
+// before it closes, and that lift is expected.
+class LiftVerifier {
+  public:
+    explicit LiftVerifier(const Options& opts);
+
+    void restart();                 // DrawBoy has connected again
+    void received(uint64_t lift);
+    void closed();                  // DrawBoy sent close
+    bool report();                  // prints the results, true if all was well
+
+  private:
+    struct Expected {
+        uint64_t lift;
+        int draftPick;              // or TabbyA or TabbyB, or the end when threading
+    };
+    const Expected& at(uint64_t index) const { return _expected[index % _expected.size()]; }
+    void check(uint64_t lift);
+    void problem(uint64_t lift, const std::string& what);
+    std::string pickName(int draftPick) const;
+
+    std::string _draftPath;
+    bool _threading;
+    std::vector<Expected> _expected;        // in weaving order, from the start pick
+
+    // Virtual positive only: raising every loom shaft may be the closing lift,
+    // which only the close that follows tells apart from a pick
+    uint64_t _clearLift = 0;
+    bool _clearPending = false;
+
+    uint64_t _next = 0;             // index of the next expected lift
+    uint64_t _received = 0;
+    uint64_t _right = 0;
+    uint64_t _wrong = 0;
+    uint64_t _repeated = 0;
+    uint64_t _skipped = 0;
+    uint64_t _problemCount = 0;
+    std::vector<std::string> _problems;     // the first few, described
+};
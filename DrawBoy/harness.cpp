@@ -0,0 +1,442 @@
+/*
+ *  harness.cpp
+ *  DrawBoy
+ */
+
+
+#include "argscommon.h"
+#include "args.hxx"
+#include "results.h"
+#include "synthetic.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <poll.h>
+#include <print>
+#include <regex>
+#include <string>
+#include <sys/wait.h>
+#include <unordered_map>
+#include <unistd.h>
+#include <vector>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+// End-to-end timing of drawboy driving fakeloom. Both run on pseudo-terminals
+// of their own, so no display is needed, and talk over DRAWBOY_SOCKET.
+// fakeloom lowers and raises the arms as fast as drawboy answers (--cycles),
+// times each pick from arms down to the pick arriving and checks each lift
+// against the draft (--verify). `make harness` runs it for the Compu-Dobby
+// I-III and the Compu-Dobby IV protocols.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// A program running on a pseudo-terminal
+class Child {
+  public:
+    Child(const std::string& name, const std::vector<std::string>& argv,
+          const std::vector<std::pair<std::string, std::string>>& env);
+    ~Child();
+    Child(const Child&) = delete;
+    Child& operator=(const Child&) = delete;
+
+    void drain();                       // reads whatever it has written
+    void send(const char* text);        // as if typed
+    bool running();
+    void kill();
+
+    int fd() const { return _master; }
+    const std::string& output() const { return _output; }
+    std::string tail() const;
+    int status() const { return _status; }
+    const std::string& name() const { return _name; }
+
+  private:
+    std::string _name;
+    pid_t _pid = -1;
+    int _master = -1;
+    int _status = 0;
+    std::string _output;
+};
+
+Child::Child(const std::string& name, const std::vector<std::string>& argv,
+             const std::vector<std::pair<std::string, std::string>>& env)
+: _name(name)
+{
+    winsize size{};
+    size.ws_row = 40;
+    size.ws_col = 120;
+    _pid = ::forkpty(&_master, nullptr, nullptr, &size);
+    if (_pid == -1)
+        throw make_system_error({"Cannot start ", name});
+    if (_pid == 0) {
+        for (auto& [var, value]: env)
+            ::setenv(var.c_str(), value.c_str(), 1);
+        std::vector<char*> args;
+        for (auto& arg: argv)
+            args.push_back(const_cast<char*>(arg.c_str()));
+        args.push_back(nullptr);
+        ::execv(args[0], args.data());
+        std::fprintf(stderr, "Cannot run %s: %s\n", args[0], std::strerror(errno));
+        ::_exit(127);
+    }
+    // Later children must not hold this terminal open
+    int flags = ::fcntl(_master, F_GETFL);
+    if (flags == -1 || ::fcntl(_master, F_SETFL, flags | O_NONBLOCK) == -1 ||
+        ::fcntl(_master, F_SETFD, FD_CLOEXEC) == -1)
+        throw make_system_error("Cannot set pseudo-terminal flags");
+}
+
+Child::~Child()
+{
+    kill();
+    if (_master != -1)
+        ::close(_master);
+}
+
+void
+Child::drain()
+{
+    char buf[4096];
+    while (_master != -1) {
+        auto n = ::read(_master, buf, sizeof(buf));
+        if (n > 0) {
+            _output.append(buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        break;      // EAGAIN, or EIO once the program has exited
+    }
+    // Only the end is shown if something goes wrong
+    if (_output.size() > 1 << 20)
+        _output.erase(0, _output.size() - (1 << 16));
+}
+
+void
+Child::send(const char* text)
+{
+    if (::write(_master, text, std::strlen(text)) < 0)
+        throw make_system_error({"Cannot write to ", _name});
+}
+
+bool
+Child::running()
+{
+    if (_pid == -1)
+        return false;
+    pid_t done = ::waitpid(_pid, &_status, WNOHANG);
+    if (done == 0)
+        return true;
+    _pid = -1;
+    return false;
+}
+
+void
+Child::kill()
+{
+    if (!running())
+        return;
+    ::kill(_pid, SIGKILL);
+    ::waitpid(_pid, &_status, 0);
+    _pid = -1;
+}
+
+std::string
+Child::tail() const
+{
+    std::string text = _output.size() > 2000 ? _output.substr(_output.size() - 2000) : _output;
+    // Strip escape sequences and carriage returns so the tail is readable
+    static const std::regex escapes("\x1b\\[[0-9;?]*[A-Za-z]|\r");
+    return std::regex_replace(text, escapes, "");
+}
+
+struct Settings {
+    std::filesystem::path drawboy;
+    std::filesystem::path fakeloom;
+    std::filesystem::path dir;          // scratch directory
+    std::filesystem::path draft;
+    int shafts;
+    int cycles;
+    std::chrono::seconds timeout;
+};
+
+struct Result {
+    std::string name;
+    uint64_t picks = 0;
+    double seconds = 0.0;
+    double picksPerSecond = 0.0;
+    double p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;      // milliseconds
+};
+
+// Weaves settings.cycles picks with drawboy driving fakeloom
+Result
+runProtocol(const Settings& settings, bool cd4)
+{
+    Result result;
+    result.name = cd4 ? "cd4" : "cd1-3";
+    auto socket = settings.dir / "loom.socket";
+    auto reportPath = settings.dir / (result.name + ".json");
+    std::filesystem::remove(reportPath);
+    std::filesystem::remove(socket);
+
+    std::vector<std::string> loomArgs{
+        settings.fakeloom.string(), "--socket=" + socket.string(),
+        std::format("--shafts={}", settings.shafts), std::format("--cycles={}", settings.cycles),
+        "--report=" + reportPath.string(), "--verify=" + settings.draft.string(), "--ascii"
+    };
+    if (cd4)
+        loomArgs.push_back("--cd4");
+    Child loom("fakeloom", loomArgs, {});
+
+    auto deadline = clock_type::now() + settings.timeout;
+    auto failed = [&](const std::string& why, std::initializer_list<const Child*> children) {
+        std::string message = std::format("{}: {}", result.name, why);
+        for (auto child: children)
+            message.append(std::format("\n\nLast output of {}:\n{}", child->name(), child->tail()));
+        return std::runtime_error(message);
+    };
+
+    while (!std::filesystem::exists(socket)) {
+        loom.drain();
+        if (!loom.running())
+            throw failed("fakeloom exited before listening", {&loom});
+        if (clock_type::now() > deadline)
+            throw failed("fakeloom did not start listening", {&loom});
+        ::usleep(10000);
+    }
+
+    std::vector<std::string> drawboyArgs{
+        settings.drawboy.string(), cd4 ? "--cd4" : "--cd3",
+        std::format("--shafts={}", settings.shafts), settings.draft.string()
+    };
+    // HOME keeps the pick file and journal out of the user's own
+    Child drawboy("drawboy", drawboyArgs,
+                  {{"DRAWBOY_SOCKET", socket.string()}, {"HOME", settings.dir.string()}});
+
+    bool quitSent = false;
+    while (loom.running() || drawboy.running()) {
+        std::vector<pollfd> fds;
+        for (Child* child: {&loom, &drawboy})
+            if (child->running())
+                fds.push_back({child->fd(), POLLIN, 0});
+        ::poll(fds.data(), (nfds_t)fds.size(), 20);
+        loom.drain();
+        drawboy.drain();
+        if (!quitSent && loom.output().contains("Arm cycles done")) {
+            drawboy.send("\x03");       // control-c
+            quitSent = true;
+        }
+        if (!quitSent && !drawboy.running())
+            throw failed("drawboy exited before the arm cycles were done", {&drawboy});
+        if (!quitSent && !loom.running())
+            throw failed("fakeloom exited before the arm cycles were done", {&loom});
+        if (clock_type::now() > deadline)
+            throw failed(std::format("timed out after {}", settings.timeout),
+                         {&loom, &drawboy});
+    }
+    if (!WIFEXITED(drawboy.status()) || WEXITSTATUS(drawboy.status()) != 0)
+        throw failed("drawboy did not exit cleanly", {&drawboy});
+    // fakeloom fails if any lift was not what the draft calls for
+    if (!WIFEXITED(loom.status()) || WEXITSTATUS(loom.status()) != 0)
+        throw failed("fakeloom did not exit cleanly", {&loom});
+
+    if (!std::filesystem::exists(reportPath))
+        throw failed("fakeloom wrote no report", {&loom});
+    auto report = JSONValues::read(reportPath.string(), "the fakeloom report");
+    result.picks = (uint64_t)report.number("picks");
+    result.seconds = report.number("seconds");
+    result.picksPerSecond = report.number("picksPerSecond");
+    result.p50 = report.number("latencyMs.p50");
+    result.p90 = report.number("latencyMs.p90");
+    result.p99 = report.number("latencyMs.p99");
+    result.max = report.number("latencyMs.max");
+    return result;
+}
+
+struct Limits {
+    double minRate;             // picks per second
+    double maxLatency;          // 99th percentile, milliseconds
+    double threshold;           // percent worse than the baseline
+};
+
+// Returns the number of limits broken
+int
+report(const std::vector<Result>& results, const Baseline* baseline, const Limits& limits)
+{
+    std::print("{:<10}{:>8} {:>10} {:>10} {:>10} {:>10} {:>10}\n", "Protocol", "picks",
+               "picks/s", "median ms", "p90 ms", "p99 ms", "max ms");
+    for (auto& r: results)
+        std::print("{:<10}{:>8} {:>10.1f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n", r.name,
+                   r.picks, r.picksPerSecond, r.p50, r.p90, r.p99, r.max);
+
+    int failures = 0;
+    auto fail = [&failures](const std::string& why) {
+        std::print("FAIL  {}\n", why);
+        ++failures;
+    };
+    for (auto& r: results) {
+        if (r.picksPerSecond < limits.minRate)
+            fail(std::format("{}: {:.1f} picks/s is under the {:.1f} picks/s limit", r.name,
+                             r.picksPerSecond, limits.minRate));
+        if (r.p99 > limits.maxLatency)
+            fail(std::format("{}: 99th percentile latency of {:.3f} ms is over the {:.3f} ms limit",
+                             r.name, r.p99, limits.maxLatency));
+        if (!baseline)
+            continue;
+        if (auto change = worseThan(*baseline, r.name, "picksPerSecond", r.picksPerSecond, true);
+            change && *change > limits.threshold)
+            fail(std::format("{}: {:.1f} picks/s is {:.1f}% below the baseline's {:.1f}", r.name,
+                             r.picksPerSecond, *change, baseline->at(r.name).at("picksPerSecond")));
+        if (auto change = worseThan(*baseline, r.name, "p50Ms", r.p50, false);
+            change && *change > limits.threshold)
+            fail(std::format("{}: median latency of {:.3f} ms is {:.1f}% above the baseline's "
+                             "{:.3f} ms", r.name, r.p50, *change, baseline->at(r.name).at("p50Ms")));
+    }
+    if (!failures)
+        std::print("All runs within limits\n");
+    return failures;
+}
+
+std::vector<ResultRecord>
+records(const std::vector<Result>& results)
+{
+    std::vector<ResultRecord> records;
+    for (auto& r: results)
+        records.push_back({r.name, {{"picks", (double)r.picks}, {"seconds", r.seconds},
+            {"picksPerSecond", r.picksPerSecond}, {"p50Ms", r.p50}, {"p90Ms", r.p90},
+            {"p99Ms", r.p99}, {"maxMs", r.max}}});
+    return records;
+}
+
+enum class Protocols {
+    Both,
+    CD1to3,
+    CD4,
+};
+
+std::unordered_map<std::string, Protocols> protocolMap{
+    {"both", Protocols::Both},
+    {"cd1-3", Protocols::CD1to3},
+    {"cd4", Protocols::CD4},
+};
+
+// Removes the scratch directory however the harness ends
+struct ScratchDir {
+    std::filesystem::path path;
+    ScratchDir()
+    {
+        auto base = std::filesystem::temp_directory_path() / "drawboy-harness.XXXXXX";
+        std::string name = base.string();
+        if (!::mkdtemp(name.data()))
+            throw make_system_error("Cannot make a scratch directory");
+        path = name;
+    }
+    ~ScratchDir()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+    }
+};
+
+}
+
+int main(int argc, const char * argv[]) {
+    args::ArgumentParser parser("Times drawboy weaving against fakeloom, end to end.",
+        "Save results with --json and check later runs against them with --compare.");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> _drawboy(parser, "PATH",
+        "The drawboy to run (defaults to the one next to this program)", {"drawboy"}, "",
+        args::Options::Single);
+    args::ValueFlag<std::string> _fakeloom(parser, "PATH",
+        "The fakeloom to run (defaults to the one next to this program)", {"fakeloom"}, "",
+        args::Options::Single);
+    args::MapFlag<std::string, Protocols> _protocol(parser, "PROTOCOL",
+        "Loom protocol to run: cd1-3, cd4, or both (defaults to both)", {"protocol"},
+        protocolMap, Protocols::Both, args::Options::Single);
+    args::ValueFlag<int> _cycles(parser, "CYCLES",
+        "Arm cycles in each run (defaults to 2000)", {"cycles"}, 2000, args::Options::Single);
+    args::ValueFlag<int> _shafts(parser, "SHAFT_COUNT",
+        "Shafts on the loom and in the draft (defaults to 24)", {"shafts"}, 24,
+        args::Options::Single);
+    args::ValueFlag<double> _minRate(parser, "PICKS_PER_SECOND",
+        "Fewest picks per second that pass (defaults to 200)", {"minRate"}, 200.0,
+        args::Options::Single);
+    args::ValueFlag<double> _maxLatency(parser, "MS",
+        "Longest 99th percentile latency from arms down to pick that passes, in milliseconds "
+        "(defaults to 20)", {"maxLatency"}, 20.0, args::Options::Single);
+    ResultOptions results(parser, 20.0,
+        "How much worse than the baseline the throughput or median latency can be "
+        "(defaults to 20)");
+    args::ValueFlag<int> _timeout(parser, "SECONDS",
+        "Longest a run may take (defaults to 120)", {"timeout"}, 120, args::Options::Single);
+
+    return runTool(parser, "drawboy-harness", argc, argv, [&] {
+        Baseline baseline;
+        if (results.compare)
+            baseline = readBaseline(args::get(results.compare), "runs");
+
+        auto here = std::filesystem::path(argv[0]).parent_path();
+        if (here.empty())
+            here = ".";
+        ScratchDir scratch;
+        Settings settings{
+            _drawboy ? std::filesystem::path(args::get(_drawboy)) : here / "drawboy",
+            _fakeloom ? std::filesystem::path(args::get(_fakeloom)) : here / "fakeLoom",
+            scratch.path, scratch.path / "harness.wif",
+            args::get(_shafts), std::max(1, args::get(_cycles)),
+            std::chrono::seconds(std::max(1, args::get(_timeout)))
+        };
+        if (!shaftMap.contains(std::to_string(settings.shafts)))
+            throw std::runtime_error("The loom must have 4 to 40 shafts, in steps of 4.");
+        for (auto& program: {settings.drawboy, settings.fakeloom})
+            if (::access(program.c_str(), X_OK) != 0)
+                throw make_system_error({"Cannot run ", program.string()});
+
+        // One pick more than the cycles, so the draft never wraps around
+        SyntheticDraft draft;
+        draft.shafts = settings.shafts;
+        draft.treadles = settings.shafts + 8;
+        draft.picks = settings.cycles + 1;
+        draft.treadlingOrder = SyntheticDraft::Order::Random;
+        draft.treadlingRepeat = 500;
+        draft.generate();
+        {
+            std::ofstream out(settings.draft);
+            draft.writeWIF(out);
+            if (!out)
+                throw std::runtime_error("Cannot write the harness draft.");
+        }
+
+        std::signal(SIGPIPE, SIG_IGN);
+        std::vector<Result> runs;
+        Protocols protocols = args::get(_protocol);
+        for (bool cd4: {false, true}) {
+            if (protocols == (cd4 ? Protocols::CD1to3 : Protocols::CD4))
+                continue;
+            std::print("Running {} arm cycles with the {} protocol...\n", settings.cycles,
+                       cd4 ? "Compu-Dobby IV" : "Compu-Dobby I-III");
+            std::fflush(stdout);
+            runs.push_back(runProtocol(settings, cd4));
+        }
+
+        std::putchar('\n');
+        int failures = report(runs, results.compare ? &baseline : nullptr,
+                              {args::get(_minRate), args::get(_maxLatency),
+                               args::get(results.threshold)});
+        if (results.json)
+            writeResults(records(runs), "runs", args::get(results.json));
+        return failures ? 1 : 0;
+    });
+}
@@ -5,6 +5,8 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#include <netdb.h>
+#include <memory>
 #include <unistd.h>
 #include "argscommon.h"
 #include <fcntl.h>
@@ -69,6 +71,38 @@ int makeSocket(const std::string& path, Mode _mode)
     
     return sockFD;
 }
+
+int makeTCPSocket(const std::string& host, const std::string& port)
+{
+    addrinfo hint{};
+    hint.ai_flags = AI_PASSIVE;
+    hint.ai_family = AF_UNSPEC;
+    hint.ai_socktype = SOCK_STREAM;
+    addrinfo* results;
+    int err = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hint, &results);
+    if (err != 0)
+        throw make_runtime_error({"Cannot listen on ", host, ":", port, ": ", ::gai_strerror(err)});
+    std::unique_ptr<addrinfo, decltype(&::freeaddrinfo)> aiList(results, ::freeaddrinfo);
+
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        int sockFD = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sockFD == -1)
+            continue;
+        int on = 1;
+        ::setsockopt(sockFD, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (::bind(sockFD, ai->ai_addr, ai->ai_addrlen) != 0 || ::listen(sockFD, 2) != 0) {
+            ::close(sockFD);
+            continue;
+        }
+        int flags = ::fcntl(sockFD, F_GETFL);
+        if (flags == -1 || ::fcntl(sockFD, F_SETFL, flags | O_NONBLOCK) == -1) {
+            ::close(sockFD);
+            throw make_system_error("Could not set socket flags");
+        }
+        return sockFD;
+    }
+    throw make_system_error({"Couldn't listen on ", host, ":", port});
+}
 }
 
 
@@ -120,13 +154,19 @@ Connection::Connection(Connection&& other) noexcept : Socket(std::move(other)) {
 Connection& Connection::operator=(Connection&& other) noexcept
 {
     if (this != &other)
-        *this = std::move(other);
+        Socket::operator=(std::move(other));
     return *this;
 }
 
 Server::Server(const std::string& path)
 : Socket(makeSocket(path, Mode::Server)), socketPath(path) { }
-Server::~Server()                { removeSocketFile(socketPath); }
+Server::Server(const std::string& host, const std::string& port)
+: Socket(makeTCPSocket(host, port)) { }
+Server::~Server()
+{
+    if (!socketPath.empty())
+        removeSocketFile(socketPath);
+}
 
 
 std::optional<Connection>
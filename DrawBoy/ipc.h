@@ -66,10 +66,11 @@ public:
 class Server : public Socket {
 public:
     Server(const std::string& path);
+    Server(const std::string& host, const std::string& port);   // TCP
     ~Server();
 
     std::optional<Connection> accept();
-    std::string socketPath;
+    std::string socketPath;     // empty for TCP
 };
 }
 
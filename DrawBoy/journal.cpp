@@ -0,0 +1,257 @@
+/*
+ *  journal.cpp
+ *  DrawBoy
+ */
+
+
+#include "journal.h"
+#include "argscommon.h"
+#include "trace.h"
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <print>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr char JournalMagic[4] = {'D', 'B', 'J', 'R'};
+
+constexpr std::array<uint32_t, 256> CRCTable = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+    return table;
+}();
+
+uint32_t
+crc32(const void* data, std::size_t length)
+{
+    uint32_t c = 0xffffffffu;
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < length; ++i)
+        c = CRCTable[(c ^ bytes[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+uint32_t
+recordCRC(const JournalRecord& rec)
+{
+    return crc32(&rec, offsetof(JournalRecord, crc));
+}
+
+bool
+intact(const JournalRecord& rec)
+{
+    return std::memcmp(rec.magic, JournalMagic, 4) == 0 && rec.length == sizeof(JournalRecord) &&
+           rec.crc == recordCRC(rec);
+}
+
+// Counts the intact records at the start of the journal, stopping at the
+// first torn or damaged one, and returns the last of them
+std::size_t
+scan(int fd, std::optional<JournalRecord>& last)
+{
+    std::size_t count = 0;
+    JournalRecord rec;
+    ::lseek(fd, 0, SEEK_SET);
+    while (::read(fd, &rec, sizeof(rec)) == (ssize_t)sizeof(rec) && intact(rec)) {
+        last = rec;
+        ++count;
+    }
+    return count;
+}
+
+bool
+writeAll(int fd, const void* data, std::size_t length)
+{
+    auto bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        auto n = ::write(fd, bytes, length);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += n;
+        length -= (std::size_t)n;
+    }
+    return true;
+}
+
+// Opens the journal and takes its lock, returning -1 if another drawboy
+// holds it
+int
+openLocked(const std::string& path)
+{
+    while (true) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw make_system_error("Cannot open weaving journal");
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            int err = errno;
+            ::close(fd);
+            if (err == EWOULDBLOCK)
+                return -1;
+            errno = err;
+            throw make_system_error("Cannot lock weaving journal");
+        }
+        // Compaction by the drawboy that held the lock may have replaced
+        // the file since it was opened
+        struct stat opened, named;
+        if (::fstat(fd, &opened) == 0 && ::stat(path.c_str(), &named) == 0 &&
+            opened.st_dev == named.st_dev && opened.st_ino == named.st_ino)
+            return fd;
+        ::close(fd);
+    }
+}
+
+int
+syncData(int fd)
+{
+#ifdef __APPLE__
+    return ::fsync(fd);
+#else
+    return ::fdatasync(fd);
+#endif
+}
+}
+
+std::unique_ptr<WeavingJournal>
+WeavingJournal::open(const std::string& path)
+{
+    int fd = openLocked(path);
+    if (fd < 0)
+        return nullptr;
+    return std::unique_ptr<WeavingJournal>(new WeavingJournal(fd, path));
+}
+
+WeavingJournal::WeavingJournal(int fd, const std::string& path)
+: _fd(fd)
+{
+    std::optional<JournalRecord> last;
+    auto size = (off_t)(scan(_fd, last) * sizeof(JournalRecord));
+
+    if (last && (std::size_t)size > CompactSize) {
+        // Keep only the last record, replacing the journal atomically. The
+        // new file is locked before it takes the journal's place.
+        std::string tmpPath = path + ".tmp";
+        int tmp = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (tmp >= 0 && ::flock(tmp, LOCK_EX | LOCK_NB) == 0 &&
+            writeAll(tmp, &*last, sizeof(JournalRecord)) && ::fsync(tmp) == 0 &&
+            ::rename(tmpPath.c_str(), path.c_str()) == 0)
+        {
+            ::close(_fd);
+            _fd = tmp;
+            size = sizeof(JournalRecord);
+        } else if (tmp >= 0) {
+            ::close(tmp);
+            ::unlink(tmpPath.c_str());
+        }
+    }
+
+    // Drop anything after the intact records, so that new records are not
+    // appended after a torn one
+    struct stat st;
+    if (::fstat(_fd, &st) == 0 && st.st_size != size && ::ftruncate(_fd, size) != 0) {
+        ::close(_fd);
+        throw make_system_error("Cannot repair weaving journal");
+    }
+
+    if (last)
+        _sequence = last->sequence + 1;
+    _thread = std::thread(&WeavingJournal::writer, this);
+}
+
+WeavingJournal::~WeavingJournal()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+    }
+    _wake.notify_one();
+    if (_thread.joinable())
+        _thread.join();
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+void
+WeavingJournal::record(JournalRecord rec)
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pending.push_back(rec);
+    }
+    _wake.notify_one();
+}
+
+void
+WeavingJournal::writer()
+{
+    std::vector<JournalRecord> batch;
+    bool failed = false;
+    eventTrace.threadName("journal");
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _wake.wait(guard, [this]{ return _stop || !_pending.empty(); });
+            if (_pending.empty())
+                return;             // stopping, and everything is written
+            batch.swap(_pending);
+        }
+
+        // Records that come in while this batch is syncing are written
+        // together in the next one
+        TraceScope traced("journal write", "journal", "records", (int64_t)batch.size());
+        for (auto& rec: batch) {
+            std::memcpy(rec.magic, JournalMagic, 4);
+            rec.length = sizeof(JournalRecord);
+            rec.reserved = 0;
+            rec.sequence = _sequence++;
+            rec.crc = recordCRC(rec);
+        }
+        if (!failed && (!writeAll(_fd, batch.data(), batch.size() * sizeof(JournalRecord)) ||
+                        syncData(_fd) != 0))
+        {
+            std::print(stderr, "\r\nCannot write the weaving journal: {}\r\n", std::strerror(errno));
+            failed = true;
+        }
+        batch.clear();
+    }
+}
+
+std::optional<JournalRecord>
+WeavingJournal::last(const std::string& path)
+{
+    std::optional<JournalRecord> rec;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        scan(fd, rec);
+        ::close(fd);
+    }
+    return rec;
+}
+
+uint64_t
+WeavingJournal::hashFile(const std::string& path)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    if (std::FILE* file = std::fopen(path.c_str(), "rb")) {
+        char buf[4096];
+        std::size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), file)) > 0)
+            for (std::size_t i = 0; i < n; ++i)
+                hash = (hash ^ (unsigned char)buf[i]) * 0x100000001b3ull;
+        std::fclose(file);
+    }
+    return hash;
+}
@@ -0,0 +1,69 @@
+/*
+ *  journal.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One woven pick. Records are appended to the journal file in host byte
+// order, and each ends with a CRC-32 of the rest of the record so that a
+// record torn by a crash or power cut is recognized and dropped.
+struct JournalRecord {
+    char magic[4];              // "DBJR"
+    uint32_t length;            // sizeof(JournalRecord)
+    int64_t time;               // system clock, ns since the epoch
+    uint64_t draftHash;         // of the draft file contents
+    int32_t resumePick;         // the pick that -plast continues at
+    int32_t pickIndex;          // position in the pick list, negative for tabby
+    int32_t draftPick;          // pick in the draft file, negative for tabby
+    uint8_t forward;            // weaving direction
+    uint8_t mode;
+    uint16_t reserved;
+    uint32_t sequence;
+    uint32_t crc;
+};
+
+// Appends a record of each woven pick to the journal, so that the position
+// survives a crash. Records are handed to a background thread that writes
+// and syncs them in batches, so journaling never waits on the disk. The
+// journal is locked while it is open, so only one drawboy writes to it.
+class WeavingJournal {
+  public:
+    // Returns null if another drawboy is journaling to path
+    static std::unique_ptr<WeavingJournal> open(const std::string& path);
+    ~WeavingJournal();
+
+    void record(JournalRecord rec);
+
+    // The last intact record in the journal, if any
+    static std::optional<JournalRecord> last(const std::string& path);
+
+    // FNV-1a hash of a file's contents
+    static uint64_t hashFile(const std::string& path);
+
+    // Rewritten with only the last record when it grows past this
+    static constexpr std::size_t CompactSize = 1024 * 1024;
+
+  private:
+    WeavingJournal(int fd, const std::string& path);
+    void writer();
+
+    int _fd = -1;
+    uint32_t _sequence = 0;
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::vector<JournalRecord> _pending;
+    bool _stop = false;
+    std::thread _thread;
+};
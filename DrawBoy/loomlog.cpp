@@ -0,0 +1,215 @@
+/*
+ *  loomlog.cpp
+ *  DrawBoy
+ */
+
+
+#include "loomlog.h"
+#include "argscommon.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <system_error>
+
+namespace {
+// How long the writer thread sleeps when there is nothing to write
+const std::chrono::milliseconds WriterIdle{20};
+}
+
+LoomLog::LoomLog(std::filesystem::path path, int compuDobbyGen)
+: _path(std::move(path)), _compuDobbyGen(compuDobbyGen),
+  _start(std::chrono::steady_clock::now()),
+  _startTime(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count()),
+  _ring(new char[Capacity])
+{
+    openFile();
+    if (!_file)
+        throw make_system_error("Cannot open log file");
+    // Started before real-time mode is requested, so the writer thread runs
+    // at normal priority.
+    _thread = std::thread(&LoomLog::writer, this);
+}
+
+LoomLog::~LoomLog()
+{
+    _stop.store(true, std::memory_order_release);
+    if (_thread.joinable())
+        _thread.join();
+    if (_file) {
+        if (_dropped) {
+            auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - _start).count();
+            LoomLogRecord lost{now, (uint32_t)std::min<uint64_t>(_dropped, UINT32_MAX),
+                               LoomLogRecord::Dropped, {}};
+            std::fwrite(&lost, sizeof(lost), 1, _file);
+        }
+        std::fclose(_file);
+    }
+}
+
+void
+LoomLog::put(const void* data, std::size_t length)
+{
+    // Copies into the ring at _head, which the caller has checked has room
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    std::size_t pos = head & (Capacity - 1);
+    std::size_t first = std::min(length, Capacity - pos);
+    std::memcpy(_ring.get() + pos, data, first);
+    std::memcpy(_ring.get(), static_cast<const char*>(data) + first, length - first);
+    _head.store(head + length, std::memory_order_release);
+}
+
+void
+LoomLog::get(void* data, std::size_t length)
+{
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    std::size_t pos = tail & (Capacity - 1);
+    std::size_t first = std::min(length, Capacity - pos);
+    std::memcpy(data, _ring.get() + pos, first);
+    std::memcpy(static_cast<char*>(data) + first, _ring.get(), length - first);
+    _tail.store(tail + length, std::memory_order_release);
+}
+
+void
+LoomLog::record(LoomLogRecord::Type type, const char* data, std::size_t length)
+{
+    std::size_t used = _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire);
+    std::size_t needed = sizeof(LoomLogRecord) * (_dropped ? 2 : 1) + length;
+    if (needed > Capacity - used) {
+        _dropped += length;     // never wait for the writer
+        return;
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - _start).count();
+    if (_dropped) {
+        LoomLogRecord lost{now, (uint32_t)std::min<uint64_t>(_dropped, UINT32_MAX),
+                           LoomLogRecord::Dropped, {}};
+        put(&lost, sizeof(lost));
+        _dropped = 0;
+    }
+    LoomLogRecord rec{now, (uint32_t)length, type, {}};
+    put(&rec, sizeof(rec));
+    put(data, length);
+}
+
+void
+LoomLog::writer()
+{
+    while (true) {
+        bool stopping = _stop.load(std::memory_order_acquire);
+        if (!drain()) {
+            if (stopping)
+                break;
+            std::this_thread::sleep_for(WriterIdle);
+        }
+    }
+}
+
+// Writes every complete record in the ring, returns false if there were none
+bool
+LoomLog::drain()
+{
+    bool wrote = false;
+    char buf[256];
+
+    // A record is complete once _head has moved past its data, because
+    // the producer publishes the header and the data separately.
+    while (true) {
+        std::size_t available = _head.load(std::memory_order_acquire) -
+                                _tail.load(std::memory_order_relaxed);
+        LoomLogRecord rec;
+        if (available < sizeof(rec))
+            break;
+        std::size_t pos = _tail.load(std::memory_order_relaxed) & (Capacity - 1);
+        std::size_t first = std::min(sizeof(rec), Capacity - pos);
+        std::memcpy(&rec, _ring.get() + pos, first);
+        std::memcpy(reinterpret_cast<char*>(&rec) + first, _ring.get(), sizeof(rec) - first);
+        std::size_t length = rec.type == LoomLogRecord::Dropped ? 0 : rec.length;
+        if (available < sizeof(rec) + length)
+            break;
+
+        get(&rec, sizeof(rec));
+        if (_file && _fileSize + sizeof(rec) + length > MaxFileSize)
+            rotate();
+        if (_file)
+            std::fwrite(&rec, sizeof(rec), 1, _file);
+        while (length) {
+            std::size_t chunk = std::min(length, sizeof(buf));
+            get(buf, chunk);
+            if (_file)
+                std::fwrite(buf, 1, chunk, _file);
+            length -= chunk;
+        }
+        _fileSize += sizeof(rec) + (rec.type == LoomLogRecord::Dropped ? 0 : rec.length);
+        wrote = true;
+    }
+
+    if (wrote && _file)
+        std::fflush(_file);
+    return wrote;
+}
+
+void
+LoomLog::openFile()
+{
+    _file = std::fopen(_path.c_str(), "wb");
+    if (!_file)
+        return;
+    LoomLogHeader header{};
+    std::memcpy(header.magic, LoomLogMagic, sizeof(header.magic));
+    header.version = LoomLogVersion;
+    header.compuDobbyGen = (uint8_t)_compuDobbyGen;
+    header.startTime = _startTime;
+    std::fwrite(&header, sizeof(header), 1, _file);
+    _fileSize = sizeof(header);
+}
+
+void
+LoomLog::rotate()
+{
+    std::fclose(_file);
+    _file = nullptr;
+    std::error_code ec;
+    for (int i = KeepFiles - 1; i > 0; --i) {
+        auto from = _path;
+        from += std::format(".{}", i);
+        auto to = _path;
+        to += std::format(".{}", i + 1);
+        std::filesystem::rename(from, to, ec);
+    }
+    auto first = _path;
+    first += ".1";
+    std::filesystem::rename(_path, first, ec);
+    openFile();
+}
+
+LoomLogReader::LoomLogReader(const std::string& path)
+{
+    _file = std::fopen(path.c_str(), "rb");
+    if (!_file)
+        throw std::system_error(errno, std::generic_category(), path);
+    if (std::fread(&_header, sizeof(_header), 1, _file) != 1 ||
+        std::memcmp(_header.magic, LoomLogMagic, sizeof(_header.magic)) != 0 ||
+        _header.version != LoomLogVersion)
+    {
+        std::fclose(_file);
+        throw std::runtime_error(path + " is not a drawboy loom log.");
+    }
+}
+
+LoomLogReader::~LoomLogReader()
+{
+    std::fclose(_file);
+}
+
+bool
+LoomLogReader::next(LoomLogRecord& rec, std::string& data)
+{
+    if (std::fread(&rec, sizeof(rec), 1, _file) != 1)
+        return false;
+    data.resize(rec.type == LoomLogRecord::Dropped ? 0 : rec.length);
+    return std::fread(data.data(), 1, data.size(), _file) == data.size();
+}
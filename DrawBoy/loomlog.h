@@ -0,0 +1,101 @@
+/*
+ *  loomlog.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+
+// A loom log file starts with a LoomLogHeader and is followed by records,
+// each a LoomLogRecord followed by length bytes of loom traffic (none for
+// Dropped records). Integers are in host byte order.
+struct LoomLogHeader {
+    char magic[4];              // "DBLG"
+    uint8_t version;
+    uint8_t compuDobbyGen;
+    uint16_t reserved;
+    int64_t startTime;          // system clock, ns since the epoch
+};
+
+struct LoomLogRecord {
+    enum Type : uint8_t {
+        Read,                   // bytes from the loom
+        Write,                  // bytes to the loom
+        Dropped,                // length bytes were lost, the buffer was full
+        Input,                  // bytes typed at the terminal
+    };
+
+    int64_t time;               // ns since startTime
+    uint32_t length;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+
+constexpr char LoomLogMagic[4] = {'D', 'B', 'L', 'G'};
+constexpr uint8_t LoomLogVersion = 1;
+
+// Records loom traffic into a lock-free single-producer ring buffer that a
+// background thread drains to disk, so that logging does not add stdio calls
+// to the loom I/O. The file is rotated when it grows past a size limit,
+// keeping a few older files as path.1, path.2, ...
+class LoomLog {
+  public:
+    LoomLog(std::filesystem::path path, int compuDobbyGen);
+    ~LoomLog();
+
+    // Only called from the loom I/O thread
+    void record(LoomLogRecord::Type type, const char* data, std::size_t length);
+
+    static constexpr uintmax_t MaxFileSize = 16 * 1024 * 1024;
+    static constexpr int KeepFiles = 4;
+
+  private:
+    static constexpr std::size_t Capacity = 1 << 20;    // must be a power of 2
+
+    void put(const void* data, std::size_t length);
+    void get(void* data, std::size_t length);
+    void writer();
+    bool drain();
+    void openFile();
+    void rotate();
+
+    std::filesystem::path _path;
+    int _compuDobbyGen;
+    std::chrono::steady_clock::time_point _start;
+    int64_t _startTime;
+    uint64_t _dropped = 0;          // producer only
+
+    std::unique_ptr<char[]> _ring;
+    std::atomic<std::size_t> _head{0};      // written by the producer
+    std::atomic<std::size_t> _tail{0};      // written by the writer thread
+    std::atomic<bool> _stop{false};
+
+    std::FILE* _file = nullptr;     // writer thread only
+    uintmax_t _fileSize = 0;
+    std::thread _thread;
+};
+
+// Reads the records of a loom log file in order.
+class LoomLogReader {
+  public:
+    explicit LoomLogReader(const std::string& path);
+    ~LoomLogReader();
+
+    const LoomLogHeader& header() const { return _header; }
+
+    // Returns false at the end of the log, or where the log was cut off
+    bool next(LoomLogRecord& rec, std::string& data);
+
+  private:
+    std::FILE* _file;
+    LoomLogHeader _header;
+};
@@ -0,0 +1,153 @@
+/*
+ *  loomlogdump.cpp
+ *  DrawBoy
+ */
+
+
+#include "loomlog.h"
+#include "args.hxx"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <print>
+#include <string>
+
+// Prints binary loom logs written by drawboy --log in the human-readable
+// format that drawboy used to log directly.
+
+namespace {
+
+enum class LogDirection {
+    Unknown,
+    Reading,
+    Writing
+};
+
+struct Dumper {
+    bool showTimes = false;
+    int compuDobbyGen = 0;
+    int64_t startTime = 0;
+    LogDirection logdirn = LogDirection::Unknown;
+
+    void dump(const std::string& path);
+    void prefix(const LoomLogRecord& rec);
+    void prettyPrint(char c, bool text);
+};
+
+void
+Dumper::prefix(const LoomLogRecord& rec)
+{
+    std::putchar('\n');
+    if (showTimes) {
+        using namespace std::chrono;
+        sys_time<nanoseconds> when{nanoseconds(startTime + rec.time)};
+        auto day = floor<days>(when);
+        hh_mm_ss<microseconds> time{floor<microseconds>(when - day)};
+        std::print("[{:02}:{:02}:{:02}.{:06}] ", time.hours().count(), time.minutes().count(),
+                   time.seconds().count(), time.subseconds().count());
+    }
+}
+
+void
+Dumper::prettyPrint(char c, bool text)
+{
+    if (compuDobbyGen < 4 && !text) {
+        std::print("{:#04x}", (int)c);
+    } else {
+        if (std::isprint((int)c) && c != '\\') {
+            std::putchar((int)c);
+        } else {
+            switch (c) {
+                case '\r':
+                    std::fputs("\\r", stdout);
+                    break;
+                case '\n':
+                    std::fputs("\\n", stdout);
+                    break;
+                case '\\':
+                    std::fputs("\\\\", stdout);
+                    break;
+                default:
+                    std::print("\\x{:02x}", (int)c);
+                    break;
+            }
+        }
+    }
+}
+
+void
+Dumper::dump(const std::string& path)
+{
+    LoomLogReader log(path);
+    compuDobbyGen = log.header().compuDobbyGen;
+    startTime = log.header().startTime;
+
+    LoomLogRecord rec;
+    std::string data;
+    while (log.next(rec, data)) {
+        if (rec.type == LoomLogRecord::Dropped) {
+            prefix(rec);
+            std::print("[{} bytes not logged]", rec.length);
+            logdirn = LogDirection::Unknown;
+            continue;
+        }
+
+        LogDirection dirn = LogDirection::Unknown;
+        const char* label = "keys: ";
+        switch (rec.type) {
+            case LoomLogRecord::Read:
+                dirn = LogDirection::Reading;
+                label = "loom: ";
+                break;
+            case LoomLogRecord::Write:
+                dirn = LogDirection::Writing;
+                label = "drawboy: ";
+                break;
+            default:
+                break;
+        }
+        if (logdirn != dirn || dirn == LogDirection::Unknown || showTimes) {
+            prefix(rec);
+            std::fputs(label, stdout);
+            logdirn = dirn;
+        }
+        for (char c: data)
+            prettyPrint(c, dirn == LogDirection::Unknown);
+    }
+}
+
+}
+
+int main(int argc, const char * argv[]) {
+    args::ArgumentParser parser("Prints drawboy loom logs.",
+        "Give rotated logs oldest first: drawboy.dblog.2 drawboy.dblog.1 drawboy.dblog");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::Flag _times(parser, "times", "Shows the time of each read and write", {'t', "times"});
+    args::PositionalList<std::string> _logFiles(parser, "LOG_PATH", "The log files to print",
+        args::Options::Required);
+
+    try {
+        parser.Prog("loomlogdump");
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::Error& e) {
+        std::cerr << e.what() << "\n\n" << parser;
+        return 4;
+    }
+
+    Dumper dumper;
+    dumper.showTimes = _times;
+    try {
+        for (auto& path: args::get(_logFiles))
+            dumper.dump(path);
+    } catch (std::exception& e) {
+        std::fflush(stdout);
+        std::cerr << '\n' << e.what() << std::endl;
+        return 4;
+    }
+    std::putchar('\n');
+    return 0;
+}
@@ -0,0 +1,371 @@
+/*
+ *  loomtransport.cpp
+ *  DrawBoy
+ */
+
+
+#include "loomtransport.h"
+#include "argscommon.h"
+#include "ipc.h"
+#include "startup.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <mutex>
+#include <netdb.h>
+#include <print>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+struct addr_deleter {
+    void operator()(addrinfo* ap) { ::freeaddrinfo(ap); }
+};
+
+using unique_ai = std::unique_ptr<addrinfo, addr_deleter>;
+
+// The address may name a port, as host:port, otherwise the telnet port is used
+int
+openTelnet(const std::string& address)
+{
+    addrinfo hint{AI_ADDRCONFIG, PF_INET, SOCK_STREAM, IPPROTO_TCP};
+    addrinfo* results;
+
+    std::string host = address;
+    std::string port = "telnet";
+    if (auto colon = address.rfind(':'); colon != std::string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+
+    startupProfile.phase("address lookup");
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hint, &results) != 0)
+        return -2;
+
+    auto aiList = unique_ai(results);
+
+    startupProfile.phase("connect");
+
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        int sockFD = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sockFD < 0)
+            continue;
+
+        if (::connect(sockFD, ai->ai_addr, ai->ai_addrlen) < 0) {
+            ::close(sockFD);
+            continue;
+        }
+
+        // The driver expects reads and writes to return instead of waiting
+        ::fcntl(sockFD, F_SETFL, ::fcntl(sockFD, F_GETFL) | O_NONBLOCK);
+        return sockFD;
+    }
+    return -1;
+}
+
+// Pseudo-terminals have no modem lines, but one can stand in for the loom
+// (fakeloom --pty)
+bool
+isPseudoTerminal(std::string_view name)
+{
+    return name.starts_with("/dev/pts/") ||
+           (name.starts_with("/dev/ttys") && name.size() > 9 && std::isdigit((unsigned char)name[9]));
+}
+
+int
+checkForSerial(const std::string& name, bool allowPseudo = false)
+{
+    int fd = ::open(name.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
+    int modemBits = 0;
+    if (fd == -1)
+        return -1;
+    if (!::isatty(fd) ||
+        (::ioctl(fd, TIOCMGET, &modemBits) == -1 && !(allowPseudo && isPseudoTerminal(name))))
+    {
+        ::close(fd);
+        return -2;
+    }
+    return fd;
+}
+
+void
+initLoomPort(int fd, int cdgen, int vtime)
+{
+    struct termios term;
+
+    if (::tcgetattr(fd, &term) < 0)
+        throw make_system_error("Cannot communicate with loom device");
+
+    ::cfmakeraw(&term);
+
+    if (cdgen == 1) {
+        ::cfsetispeed(&term, B1200);            // set 1200 baud
+        ::cfsetospeed(&term, B1200);
+        term.c_cflag |= PARENB;                 // set 7E2
+        term.c_cflag &= (tcflag_t)(~PARODD);
+        term.c_cflag |= CSTOPB;
+        term.c_cflag = (term.c_cflag & (tcflag_t)(~CSIZE)) | CS7;
+    } else {
+        ::cfsetispeed(&term, B9600);            // set 9600 baud
+        ::cfsetospeed(&term, B9600);
+        term.c_cflag &= (tcflag_t)(~PARENB);    // set 8N1
+        term.c_cflag &= (tcflag_t)(~CSTOPB);
+        term.c_cflag = (term.c_cflag & (tcflag_t)(~CSIZE)) | CS8;
+    }
+    term.c_cflag |= CLOCAL;
+    term.c_cc[VMIN] = 0;
+    term.c_cc[VTIME] = (cc_t)vtime;
+
+    if (::tcsetattr(fd, TCSAFLUSH, &term) < 0)
+        throw make_system_error("Cannot communicate with loom device");
+}
+
+int
+openSerial(const std::string& path, int compuDobbyGen, int vtime)
+{
+    startupProfile.phase("serial open");
+    int fd = checkForSerial(path, true);
+
+    if (fd == -1)
+        throw std::runtime_error("Cannot open loom device.");
+    if (fd == -2)
+        throw std::runtime_error("Loom device is not a serial port.");
+
+    startupProfile.phase("port setup");
+    try {
+        initLoomPort(fd, compuDobbyGen, vtime);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return fd;
+}
+
+int
+openNetwork(const std::string& address)
+{
+    int fd = openTelnet(address);
+
+    if (fd == -1)
+        throw std::runtime_error("Cannot open loom on network.");
+    if (fd == -2)
+        throw std::runtime_error("Loom address cannot be found on network.");
+    return fd;
+}
+}
+
+ssize_t
+LoomTransport::read(char* buf, std::size_t len)
+{
+    ssize_t n = doRead(buf, len);
+    if (n > 0) {
+        ++_metrics.reads;
+        _metrics.bytesRead += (uint64_t)n;
+    }
+    return n;
+}
+
+ssize_t
+LoomTransport::write(const char* buf, std::size_t len)
+{
+    ssize_t n = doWrite(buf, len);
+    if (n > 0) {
+        ++_metrics.writes;
+        _metrics.bytesWritten += (uint64_t)n;
+    }
+    if ((n >= 0 && (std::size_t)n < len) || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)))
+        ++_metrics.writesBlocked;
+    return n;
+}
+
+void
+LoomTransport::report() const
+{
+    std::print("\r\nLoom connection ({}): {} bytes read in {} reads, {} bytes written in {} writes",
+               _name, _metrics.bytesRead, _metrics.reads, _metrics.bytesWritten, _metrics.writes);
+    if (_metrics.writesBlocked)
+        std::print(", {} writes blocked", _metrics.writesBlocked);
+    std::print("\r\n");
+}
+
+
+FDTransport::FDTransport(const char* name, int fd)
+: LoomTransport(name), _fd(fd)
+{ }
+
+FDTransport::~FDTransport()
+{
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+ssize_t
+FDTransport::doRead(char* buf, std::size_t len)
+{
+    return ::read(_fd, buf, len);
+}
+
+ssize_t
+FDTransport::doWrite(const char* buf, std::size_t len)
+{
+    return ::write(_fd, buf, len);
+}
+
+
+SerialTransport::SerialTransport(const std::string& path, int compuDobbyGen, int vtime)
+: FDTransport("serial", openSerial(path, compuDobbyGen, vtime))
+{ }
+
+bool
+SerialTransport::probe(const std::string& path)
+{
+    int fd = checkForSerial(path);
+    if (fd < 0)
+        return false;
+    ::close(fd);
+    return true;
+}
+
+TCPTransport::TCPTransport(const std::string& address)
+: FDTransport("network", openNetwork(address))
+{ }
+
+UnixTransport::UnixTransport(const std::string& path)
+: FDTransport("socket", IPC::Client(path).release())
+{ }
+
+
+// Bytes travelling in one direction. The bell pipe holds one byte whenever
+// there is data to read or the channel has closed, so that its read end
+// selects as readable exactly when a read will not return EAGAIN.
+struct LoopbackTransport::Channel {
+    Channel();
+    ~Channel();
+    void ring();            // called with lock held
+    void close();
+
+    mutable std::mutex lock;
+    std::string data;
+    bool closed = false;
+    bool rung = false;
+    int bell[2] = {-1, -1};
+};
+
+LoopbackTransport::Channel::Channel()
+{
+    if (::pipe(bell) != 0)
+        throw make_system_error("Cannot create loopback connection");
+    for (int fd: bell) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+}
+
+LoopbackTransport::Channel::~Channel()
+{
+    for (int fd: bell)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+void
+LoopbackTransport::Channel::ring()
+{
+    if (!rung) {
+        char c = 0;
+        rung = ::write(bell[1], &c, 1) == 1;
+    }
+}
+
+void
+LoopbackTransport::Channel::close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+    ring();
+}
+
+LoopbackTransport::Pair
+LoopbackTransport::makePair()
+{
+    auto a = std::make_shared<Channel>();
+    auto b = std::make_shared<Channel>();
+    return {std::unique_ptr<LoopbackTransport>(new LoopbackTransport(a, b)),
+            std::unique_ptr<LoopbackTransport>(new LoopbackTransport(b, a))};
+}
+
+LoopbackTransport::LoopbackTransport(std::shared_ptr<Channel> in, std::shared_ptr<Channel> out)
+: LoomTransport("loopback"), _in(std::move(in)), _out(std::move(out))
+{ }
+
+LoopbackTransport::~LoopbackTransport()
+{
+    _in->close();
+    _out->close();
+}
+
+int
+LoopbackTransport::readFD() const
+{
+    return _in->bell[0];
+}
+
+int
+LoopbackTransport::writeFD() const
+{
+    // The write end of the outgoing bell only ever holds one byte, so it
+    // always selects as writable. Writes only fail when Capacity bytes are
+    // waiting for the other end, which loom messages never approach.
+    return _out->bell[1];
+}
+
+std::size_t
+LoopbackTransport::pending() const
+{
+    std::lock_guard<std::mutex> guard(_out->lock);
+    return _out->data.size();
+}
+
+ssize_t
+LoopbackTransport::doRead(char* buf, std::size_t len)
+{
+    std::lock_guard<std::mutex> guard(_in->lock);
+    if (_in->data.empty()) {
+        if (_in->closed)
+            return 0;
+        errno = EAGAIN;
+        return -1;
+    }
+    std::size_t n = std::min(len, _in->data.size());
+    _in->data.copy(buf, n);
+    _in->data.erase(0, n);
+    if (_in->data.empty() && !_in->closed && _in->rung) {
+        char c;
+        if (::read(_in->bell[0], &c, 1) == 1)
+            _in->rung = false;
+    }
+    return (ssize_t)n;
+}
+
+ssize_t
+LoopbackTransport::doWrite(const char* buf, std::size_t len)
+{
+    std::lock_guard<std::mutex> guard(_out->lock);
+    if (_out->closed) {
+        errno = EPIPE;
+        return -1;
+    }
+    std::size_t n = std::min(len, Capacity - _out->data.size());
+    if (n == 0 && len > 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    _out->data.append(buf, n);
+    if (n > 0)
+        _out->ring();
+    return (ssize_t)n;
+}
@@ -0,0 +1,122 @@
+/*
+ *  loomtransport.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+
+// A connection to the loom. Reads and writes never block: when nothing can be
+// read or written they return -1 with errno set to EAGAIN, like ::read and
+// ::write on a non-blocking descriptor, and a read returns 0 once the loom has
+// closed the connection. readFD() and writeFD() are the descriptors to select
+// on to learn when a read or write can make progress.
+class LoomTransport {
+  public:
+    struct Metrics {
+        uint64_t reads = 0;             // calls that returned data
+        uint64_t writes = 0;            // calls that took data
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t writesBlocked = 0;     // calls that took nothing, or only part
+    };
+
+    explicit LoomTransport(const char* name) : _name(name) { }
+    virtual ~LoomTransport() = default;
+
+    LoomTransport(const LoomTransport&) = delete;
+    LoomTransport& operator=(const LoomTransport&) = delete;
+
+    ssize_t read(char* buf, std::size_t len);
+    ssize_t write(const char* buf, std::size_t len);
+
+    virtual int readFD() const = 0;
+    virtual int writeFD() const = 0;
+
+    const char* name() const { return _name; }
+    const Metrics& metrics() const { return _metrics; }
+    void report() const;
+
+  protected:
+    virtual ssize_t doRead(char* buf, std::size_t len) = 0;
+    virtual ssize_t doWrite(const char* buf, std::size_t len) = 0;
+
+  private:
+    const char* _name;
+    Metrics _metrics;
+};
+
+// Any connection that is a single file descriptor, which it owns
+class FDTransport : public LoomTransport {
+  public:
+    FDTransport(const char* name, int fd);
+    ~FDTransport() override;
+
+    int readFD() const override { return _fd; }
+    int writeFD() const override { return _fd; }
+
+  protected:
+    ssize_t doRead(char* buf, std::size_t len) override;
+    ssize_t doWrite(const char* buf, std::size_t len) override;
+
+    int _fd;
+};
+
+// A Compu-Dobby on a serial port, or a USB serial adapter
+class SerialTransport : public FDTransport {
+  public:
+    SerialTransport(const std::string& path, int compuDobbyGen, int vtime = 1);
+
+    // Is path a serial port that can be opened?
+    static bool probe(const std::string& path);
+};
+
+// A Compu-Dobby IV/4.5 on the network, reached through its telnet port
+class TCPTransport : public FDTransport {
+  public:
+    explicit TCPTransport(const std::string& address);
+};
+
+// fakeloom, or anything else listening on a Unix domain socket
+class UnixTransport : public FDTransport {
+  public:
+    explicit UnixTransport(const std::string& path);
+};
+
+// One end of an in-process connection. Bytes are passed through memory; each
+// direction only uses a pipe to wake up a select() when it has data, so the
+// driver's event loop works unchanged. Both ends may be used from different
+// threads.
+class LoopbackTransport : public LoomTransport {
+  public:
+    using Pair = std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>>;
+    static Pair makePair();
+
+    ~LoopbackTransport() override;
+
+    int readFD() const override;
+    int writeFD() const override;
+
+    // Bytes written by this end that the other end has not read yet
+    std::size_t pending() const;
+
+    static constexpr std::size_t Capacity = 64 * 1024;  // per direction
+
+    struct Channel;
+
+  protected:
+    ssize_t doRead(char* buf, std::size_t len) override;
+    ssize_t doWrite(const char* buf, std::size_t len) override;
+
+  private:
+    LoopbackTransport(std::shared_ptr<Channel> in, std::shared_ptr<Channel> out);
+
+    std::shared_ptr<Channel> _in;
+    std::shared_ptr<Channel> _out;
+};
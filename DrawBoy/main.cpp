@@ -10,11 +10,13 @@
 #include <string>
 #include "args.h"
 #include "driver.h"
+#include "startup.h"
 
 
 
 int main(int argc, const char * argv[]) {
     try {
+        startupProfile.phase("arguments");
         Options opts(argc, argv);
         
         if (opts.driveLoom)
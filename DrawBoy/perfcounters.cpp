@@ -0,0 +1,165 @@
+/*
+ *  perfcounters.cpp
+ *  DrawBoy
+ */
+
+
+#include "perfcounters.h"
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <print>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+HotPath hotPath;
+
+namespace {
+const char* SectionNames[] = {
+    "draft parse",
+    "lift + encode",
+    "pick display",
+    "terminal event",
+};
+
+#ifdef __linux__
+const uint64_t CounterConfigs[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+int
+openCounter(uint64_t config, int groupFD)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = groupFD < 0;        // the group starts when the leader is enabled
+    attr.exclude_kernel = 1;            // allowed at the default perf_event_paranoid level
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // Only the calling thread, which is the one running the hot sections
+    return (int)::syscall(SYS_perf_event_open, &attr, 0, -1, groupFD, 0);
+}
+#endif
+}
+
+HotPath::~HotPath()
+{
+    for (int fd: _fds)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+void
+HotPath::enable()
+{
+    _enabled = true;
+#ifdef __linux__
+    for (std::size_t i = 0; i < CounterCount; ++i) {
+        int fd = openCounter(CounterConfigs[i], _groupFD);
+        if (fd < 0) {
+            // Without the leader there are no counters at all. Any other
+            // counter the hardware lacks is just left out.
+            if (i == 0) {
+                if (errno == EACCES || errno == EPERM)
+                    _unavailable = "access denied, see perf_event_paranoid";
+                else if (errno == ENOENT || errno == ENODEV || errno == EOPNOTSUPP)
+                    _unavailable = "no hardware counters";
+                else
+                    _unavailable = std::strerror(errno);
+                return;
+            }
+            continue;
+        }
+        if (i == 0)
+            _groupFD = fd;
+        _fds[i] = fd;
+        _slot[i] = (int)_opened++;
+    }
+    ::ioctl(_groupFD, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(_groupFD, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+    _unavailable = "not supported on this system";
+#endif
+}
+
+void
+HotPath::readCounters(std::array<uint64_t, CounterCount>& counts) const
+{
+    if (_groupFD < 0)
+        return;
+    uint64_t values[1 + CounterCount];      // count, then one value per counter
+    if (::read(_groupFD, values, sizeof(values)) < (ssize_t)sizeof(uint64_t))
+        return;
+    for (std::size_t i = 0; i < CounterCount; ++i)
+        if (_slot[i] >= 0 && (uint64_t)_slot[i] < values[0])
+            counts[i] = values[1 + _slot[i]];
+}
+
+HotPath::Scope::Scope(Section section)
+: _section(section), _active(hotPath.enabled()), _counts{}
+{
+    if (!_active)
+        return;
+    hotPath.readCounters(_counts);
+    _start = clock::now();
+}
+
+HotPath::Scope::~Scope()
+{
+    if (!_active)
+        return;
+    auto end = clock::now();
+    std::array<uint64_t, CounterCount> counts{};
+    hotPath.readCounters(counts);
+
+    Totals& totals = hotPath._totals[(std::size_t)_section];
+    ++totals.calls;
+    totals.time += end - _start;
+    for (std::size_t i = 0; i < CounterCount; ++i)
+        totals.counts[i] += counts[i] - _counts[i];
+}
+
+void
+HotPath::report() const
+{
+    if (!_enabled)
+        return;
+    bool counting = _groupFD >= 0;
+    if (counting)
+        std::print("\r\n{:<16}{:>8} {:>9} {:>10} {:>10} {:>6} {:>9} {:>9}\r\n", "Hot path",
+                   "calls", "mean us", "cycles", "instrs", "IPC", "cache mis", "brnch mis");
+    else
+        std::print("\r\n{:<16}{:>8} {:>9} {:>10}   (hardware counters unavailable: {})\r\n",
+                   "Hot path", "calls", "mean us", "total ms", _unavailable);
+
+    for (std::size_t s = 0; s < SectionCount; ++s) {
+        const Totals& t = _totals[s];
+        if (t.calls == 0)
+            continue;
+        double calls = (double)t.calls;
+        double meanMicros = std::chrono::duration<double, std::micro>(t.time).count() / calls;
+        if (!counting) {
+            std::print("{:<16}{:>8} {:>9.2f} {:>10.2f}\r\n", SectionNames[s], t.calls, meanMicros,
+                       std::chrono::duration<double, std::milli>(t.time).count());
+            continue;
+        }
+        // Counters are reported per call, and - where the hardware lacks one
+        auto perCall = [&](std::size_t i) {
+            return _slot[i] < 0 ? std::string("-") : std::format("{:.0f}", (double)t.counts[i] / calls);
+        };
+        std::string ipc = _slot[0] < 0 || _slot[1] < 0 || t.counts[0] == 0 ? std::string("-") :
+                          std::format("{:.2f}", (double)t.counts[1] / (double)t.counts[0]);
+        std::print("{:<16}{:>8} {:>9.2f} {:>10} {:>10} {:>6} {:>9} {:>9}\r\n", SectionNames[s],
+                   t.calls, meanMicros, perCall(0), perCall(1), ipc, perCall(2), perCall(3));
+    }
+}
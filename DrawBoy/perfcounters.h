@@ -0,0 +1,71 @@
+/*
+ *  perfcounters.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Hardware performance counters (cycles, instructions, cache misses and
+// branch misses) around the hot sections of the driver, totalled per section
+// and reported with --stats. Where the counters are unavailable, because
+// the kernel denies access or this is not Linux, only time is measured.
+class HotPath {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    enum class Section {
+        DraftParse,     // reading the WIF or DTX file
+        Lift,           // calculating and encoding a pick for the loom
+        Display,        // drawing the pick line
+        TermEvent,      // reading and parsing a terminal event
+    };
+
+    ~HotPath();
+
+    void enable();
+    void disable() { _enabled = false; }   // for timing the sections without counters
+    bool enabled() const { return _enabled; }
+    void report() const;
+
+    class Scope {
+      public:
+        explicit Scope(Section section);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        Section _section;
+        bool _active;
+        clock::time_point _start;
+        std::array<uint64_t, 4> _counts;
+    };
+
+  private:
+    static constexpr std::size_t SectionCount = 4;
+    static constexpr std::size_t CounterCount = 4;
+
+    void readCounters(std::array<uint64_t, CounterCount>& counts) const;
+
+    struct Totals {
+        uint64_t calls = 0;
+        clock::duration time{};
+        std::array<uint64_t, CounterCount> counts{};
+    };
+
+    bool _enabled = false;
+    int _groupFD = -1;
+    std::array<int, CounterCount> _fds{-1, -1, -1, -1};
+    std::size_t _opened = 0;                        // counters in the group
+    std::array<int, CounterCount> _slot{-1, -1, -1, -1};  // group position of each counter
+    std::string _unavailable;                       // why there are no counters
+    std::array<Totals, SectionCount> _totals{};
+};
+
+extern HotPath hotPath;
@@ -0,0 +1,204 @@
+/*
+ *  picklist.cpp
+ *  DrawBoy
+ */
+
+
+#include "picklist.h"
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+void
+addpick(int _pick, std::vector<int>& newpicks, bool isTabby, bool patternBeforeTabby)
+{
+    if (isTabby) {
+        if (patternBeforeTabby) {
+            newpicks.push_back(_pick);
+            newpicks.push_back(-3);
+        } else {
+            newpicks.push_back(-3);
+            newpicks.push_back(_pick);
+        }
+    } else {
+        newpicks.push_back(_pick);
+    }
+}
+
+int my_stoi(std::string_view str, size_t* pos = nullptr)
+{
+    int v = 0;
+    auto r = std::from_chars(str.begin(), str.end(), v);
+    if (pos)
+        *pos = (size_t)(r.ptr - str.begin());
+    if (r.ec == std::errc::invalid_argument)
+        throw std::invalid_argument(std::string(str));
+    if (r.ec == std::errc::result_out_of_range)
+        throw std::out_of_range(std::string(str));
+    return v;
+}
+
+size_t
+findMatch(std::string_view str)
+{
+    int level = 0;
+    for (size_t i = 0; i < str.length(); ++i) {
+        if (str[i] == '(') ++level;
+        if (str[i] == ')') --level;
+        if (level == 0)
+            return i;
+        if (level < 0)
+            return 0;
+    }
+    return 0;
+}
+
+std::vector<int>
+ParsePicks(std::string_view str, int maxPick, bool patternBeforeTabby, bool threading)
+{
+    std::vector<int> newpicks;
+    
+    while (!str.empty()) {
+        try {
+            int mult = 1;
+            std::vector<int> pickRange;
+            size_t multToken = str.find("x");
+            if (multToken != std::string::npos && std::isdigit(str.front())) {
+                size_t check;
+                mult = my_stoi(str, &check);
+                if (check == multToken) {   // multiplier was for this term
+                    if (mult < 1)
+                        throw std::runtime_error("Syntax error in treadling multiplier.");
+                    str.remove_prefix(multToken + 1);
+                    if (str.empty() || str.front() == ',')
+                        throw std::runtime_error("Syntax error in treadling multiplier.");
+                } else {                    // multiplier was for another term
+                    mult = 1;
+                }
+            }
+            if (std::strchr("ABab", str.front())) {
+                if (threading)
+                    throw std::runtime_error("Tabby entries make no sense in treadle-the-threading mode.");
+                while (!str.empty() && std::strchr("ABab", str.front())) {
+                    switch (str.front()) {
+                        case 'a':
+                        case 'A':
+                            addpick(-1, pickRange, false, false);
+                            break;
+                        case 'b':
+                        case 'B':
+                            addpick(-2, pickRange, false, false);
+                            break;
+                        default:
+                            break;
+                    }
+                    str.remove_prefix(1);
+                }
+            } else if (str.front() == '(') {
+                if (size_t match = findMatch(str)) {
+                    pickRange = ParsePicks(str.substr(1, match - 1), maxPick, patternBeforeTabby, threading);
+                    str.remove_prefix(match + 1);
+                } else {
+                    throw std::runtime_error("Unbalanced parentheses in pick list.");
+                }
+            } else {
+                size_t rangeToken = std::string::npos;
+                bool tabbyRange = str.front() == '~';     // single pick w/tabby
+                if (tabbyRange)
+                    str.remove_prefix(1);
+                if (tabbyRange && threading)
+                    throw std::runtime_error("Tabby entries make no sense in treadle-the-threading mode.");
+                int start = my_stoi(str, &rangeToken);
+                int end = start;
+                if (rangeToken < str.length() && (str[rangeToken] == '~' || str[rangeToken] == '-')) {
+                    if (tabbyRange)
+                        throw std::runtime_error("Spurious ~ in treadling range.");
+                    tabbyRange = str[rangeToken] == '~';  // pick range w/tabby
+                    if (tabbyRange && threading)
+                        throw std::runtime_error("Tabby entries make no sense in treadle-the-threading mode.");
+                    str.remove_prefix(rangeToken + 1);
+                    end = my_stoi(str, &rangeToken);
+                    str.remove_prefix(rangeToken);
+                } else {
+                    str.remove_prefix(rangeToken);
+                }
+                if (start < 1 || end < 1)
+                    throw std::runtime_error("Bad treadling range.");
+                if (start > maxPick || end > maxPick)
+                    throw std::runtime_error("Pick list includes picks that are not in the wif file.");
+                if (start <= end) {
+                    for (int p = start; p <= end; ++p)
+                        addpick(p, pickRange, tabbyRange, patternBeforeTabby);
+                } else {
+                    for (int p = end; p >= start; --p)
+                        addpick(p, pickRange, tabbyRange, patternBeforeTabby);
+                }
+            }
+            if (!str.empty() && str.front() != ',')
+                throw std::runtime_error("Unparsed text in treadling range.");
+            if (!str.empty())
+                str.remove_prefix(1);
+            for (auto i = 0; i < mult; ++i)
+                newpicks.insert(newpicks.end(), pickRange.begin(), pickRange.end());
+        } catch (std::runtime_error& rte) {
+            throw;
+        } catch (...) {
+            throw std::runtime_error("Syntax error in treadling range.");
+        }
+    }
+    return newpicks;
+}
+
+}
+
+std::vector<int>
+parsePickList(const std::string& str, int maxPick, TabbyPattern tabbyPattern, bool threading)
+{
+    std::vector<int> list;
+
+    // If no treadle list provided then treadle the whole liftplan
+    if (str.empty()) {
+        list.resize((size_t)maxPick);
+        for (int i = 0; i < maxPick; ++i)
+            list[(size_t)i] = i + 1;
+        return list;
+    }
+    
+    bool patternBeforeTabby = tabbyPattern == TabbyPattern::xAyB || tabbyPattern == TabbyPattern::xByA;
+    bool tabbyAFirst = tabbyPattern == TabbyPattern::xAyB || tabbyPattern == TabbyPattern::AxBy;
+    
+    list = ParsePicks(str, maxPick, patternBeforeTabby, threading);
+
+    // Replace auto-tabby picks with actual tabby A or tabby B
+    bool tabbyIsA = tabbyAFirst;
+    int picksSinceTabby = 10;       // anything > 1
+    for (auto& _pick: list) {
+        if (_pick == -3) {
+            if (picksSinceTabby > 1)
+                tabbyIsA = tabbyAFirst;
+            _pick = tabbyIsA ? TabbyA : TabbyB;
+            tabbyIsA = !tabbyIsA;
+            picksSinceTabby = 0;
+        } else {
+            ++picksSinceTabby;
+        }
+    }
+    return list;
+}
+
+std::pair<uint64_t, uint64_t>
+parseTabby(const std::string& spec)
+{
+    uint64_t tabbyA = 0, tabbyB = 0;
+    for (size_t shaft = 0; shaft < spec.length(); ++shaft) {
+        if (spec[shaft] == 'a')
+            tabbyA |= 1ull << shaft;
+        else if (spec[shaft] == 'b')
+            tabbyB |= 1ull << shaft;
+        else
+            throw std::runtime_error("Bad character in tabby specification.");
+    }
+    return {tabbyA, tabbyB};
+}
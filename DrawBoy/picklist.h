@@ -0,0 +1,25 @@
+/*
+ *  picklist.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include "argscommon.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Pick lists and tabby specifications, as given on the command line. These
+// are shared by drawboy and by fakeloom's --verify, so the two always agree
+// on what is to be woven.
+
+// Turns a pick list into draft picks, counting from 1, with TabbyA and
+// TabbyB for tabby picks. An empty list is every pick in the draft.
+std::vector<int> parsePickList(const std::string& str, int maxPick, TabbyPattern tabbyPattern,
+                               bool threading);
+
+// The shafts raised for tabby A and for tabby B by a spec such as "abab"
+std::pair<uint64_t, uint64_t> parseTabby(const std::string& spec);
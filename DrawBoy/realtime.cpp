@@ -0,0 +1,117 @@
+/*
+ *  realtime.cpp
+ *  DrawBoy
+ */
+
+
+#include "realtime.h"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <print>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+const size_t PrefaultStack = 256 * 1024;
+const size_t PrefaultHeap = 4 * 1024 * 1024;
+
+void
+prefaultStack()
+{
+    unsigned char stack[PrefaultStack];
+    volatile unsigned char* touch = stack;
+    for (size_t i = 0; i < PrefaultStack; i += 4096)
+        touch[i] = 0;
+}
+
+void
+prefaultHeap()
+{
+#if defined(__GLIBC__)
+    // Keep freed memory in the heap instead of returning it to the system
+    ::mallopt(M_TRIM_THRESHOLD, -1);
+    ::mallopt(M_MMAP_MAX, 0);
+#endif
+    if (auto heap = static_cast<unsigned char*>(std::malloc(PrefaultHeap))) {
+        for (size_t i = 0; i < PrefaultHeap; i += 4096)
+            heap[i] = 0;
+        std::free(heap);
+    }
+}
+
+double
+toMillis(Jitter::clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+}
+
+void
+enableRealtime(int cpu)
+{
+    if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        std::print("Cannot lock memory ({}), continuing without it.\n", std::strerror(errno));
+    prefaultStack();
+    prefaultHeap();
+
+    if (cpu >= 0) {
+#if defined(__linux__)
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((size_t)cpu, &cpus);
+        if (::sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            std::print("Cannot pin loom I/O to CPU {} ({}), continuing unpinned.\n",
+                       cpu, std::strerror(errno));
+#else
+        std::print("CPU pinning is not supported on this system, continuing unpinned.\n");
+#endif
+    }
+
+    sched_param param{};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+    if (int err = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param))
+        std::print("Real-time scheduling is not permitted ({}), continuing at normal priority.\n",
+                   std::strerror(err));
+    else
+        std::print("Real-time scheduling enabled.\n");
+}
+
+void
+Jitter::record(clock::duration expected, clock::duration actual)
+{
+    auto delay = actual - expected;
+    if (delay < clock::duration::zero())
+        delay = clock::duration::zero();
+    ++samples;
+    total += delay;
+    if (delay > worst)
+        worst = delay;
+    if (delay > lateThreshold) {
+        if (late < lateDelays.size())
+            lateDelays[late] = delay;
+        ++late;
+    }
+}
+
+void
+Jitter::report() const
+{
+    if (samples == 0) {
+        std::print("\r\nNo scheduling jitter samples.\r\n");
+        return;
+    }
+    std::print("\r\nScheduling jitter: {} samples, mean {:.3f}ms, worst {:.3f}ms, {} over {:.0f}ms\r\n",
+               samples, toMillis(total) / (double)samples, toMillis(worst), late,
+               toMillis(lateThreshold));
+    if (late == 0)
+        return;
+    std::print("Late wakeups:");
+    for (uint64_t i = 0; i < late && i < lateDelays.size(); ++i)
+        std::print(" {:.1f}ms", toMillis(lateDelays[i]));
+    std::print("{}\r\n", late > lateDelays.size() ? " ..." : "");
+}
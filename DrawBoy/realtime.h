@@ -0,0 +1,34 @@
+/*
+ *  realtime.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Locks the process in memory, pre-faults the stack and heap, optionally pins
+// the process to a CPU, and requests SCHED_FIFO. Each step that the system
+// refuses is reported and skipped.
+void enableRealtime(int cpu);
+
+// Tracks how late the process wakes up from a timed wait. Late wakeups are
+// kept for report() rather than printed as they happen, which would stall
+// the loop being measured.
+struct Jitter {
+    using clock = std::chrono::steady_clock;
+
+    void record(clock::duration expected, clock::duration actual);
+    void report() const;
+
+    uint64_t samples = 0;
+    clock::duration total{0};
+    clock::duration worst{0};
+    uint64_t late = 0;          // wakeups later than lateThreshold
+    std::array<clock::duration, 16> lateDelays{};   // the first of them
+
+    static constexpr clock::duration lateThreshold = std::chrono::milliseconds(5);
+};
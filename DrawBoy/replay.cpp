@@ -0,0 +1,240 @@
+/*
+ *  replay.cpp
+ *  DrawBoy
+ */
+
+
+#include "replay.h"
+#include "argscommon.h"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <poll.h>
+#include <print>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+// How long the driver gets to read a recorded input or send a recorded output
+const std::chrono::seconds ReplayTimeout{5};
+const std::chrono::microseconds ConsumePoll{50};
+
+std::string
+printable(std::string_view bytes)
+{
+    std::string out;
+    for (char c: bytes) {
+        if (std::isprint((int)c) && c != '\\')
+            out.push_back(c);
+        else if (c == '\r')
+            out.append("\\r");
+        else if (c == '\\')
+            out.append("\\\\");
+        else
+            out.append(std::format("\\x{:02x}", (int)(unsigned char)c));
+    }
+    return out;
+}
+}
+
+Replay::Replay(const std::string& path, bool realTime)
+: _log(path), _realTime(realTime), _loom(LoopbackTransport::makePair())
+{
+    if (::pipe(_input) != 0)
+        throw make_system_error("Cannot create replay input");
+    ::fcntl(_input[0], F_SETFL, ::fcntl(_input[0], F_GETFL) | O_NONBLOCK);
+}
+
+Replay::~Replay()
+{
+    _driverDone = true;
+    if (_thread.joinable())
+        _thread.join();
+    for (int fd: _input)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+std::unique_ptr<LoomTransport>
+Replay::loomTransport()
+{
+    return std::move(_loom.first);
+}
+
+void
+Replay::start()
+{
+    _start = clock::now();
+    _thread = std::thread(&Replay::feed, this);
+}
+
+void
+Replay::finish()
+{
+    _driverDone = true;
+    if (_thread.joinable())
+        _thread.join();
+
+    double secs = std::chrono::duration<double>(_elapsed).count();
+    if (!_failure.empty()) {
+        std::print("\r\nReplay diverged after {} records: {}\r\n", _records, _failure);
+        throw std::runtime_error("");
+    }
+    std::print("\r\nReplay matched: {} records, {} bytes sent to the loom, in {:.3f}s\r\n",
+               _records, _matched, secs);
+}
+
+void
+Replay::feed()
+{
+    LoomLogRecord rec;
+    std::string data;
+    bool started = false;
+
+    while (_failure.empty() && _log.next(rec, data)) {
+        if (_firstTime < 0)
+            _firstTime = rec.time;
+        switch (rec.type) {
+            case LoomLogRecord::Write:
+                started = true;
+                if (expect(data))
+                    _matched += data.size();
+                break;
+            case LoomLogRecord::Read:
+                // Loom output from before the first write was drained and
+                // discarded when the driver started
+                if (!started)
+                    break;
+                pace(rec.time);
+                if (waitConsumed() && sendLoom(data))
+                    waitConsumed();
+                break;
+            case LoomLogRecord::Input:
+                pace(rec.time);
+                if (waitConsumed() && send(data))
+                    waitConsumed();
+                break;
+            case LoomLogRecord::Dropped:
+                _failure = std::format("the log is missing {} bytes here", rec.length);
+                break;
+            default:
+                _failure = std::format("unknown record type {}", (int)rec.type);
+                break;
+        }
+        ++_records;
+    }
+    _elapsed = clock::now() - _start;
+
+    // Make the driver quit if the log ended first, and keep reading what it
+    // sends so that it does not block on a full socket.
+    if (!_driverDone)
+        send("\x03");
+    while (!_driverDone) {
+        struct pollfd pfd{_loom.second->readFD(), POLLIN, 0};
+        char buf[256];
+        if (::poll(&pfd, 1, 50) > 0 && _loom.second->read(buf, sizeof(buf)) == 0)
+            break;
+    }
+}
+
+void
+Replay::pace(int64_t time)
+{
+    if (_realTime)
+        std::this_thread::sleep_until(_start + std::chrono::nanoseconds(time - _firstTime));
+}
+
+// Types recorded keys at the driver
+bool
+Replay::send(const std::string& data)
+{
+    std::string_view remaining(data);
+    while (!remaining.empty()) {
+        auto n = ::write(_input[1], remaining.data(), remaining.size());
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            _failure = std::format("cannot write to the driver: {}", std::strerror(errno));
+            return false;
+        }
+        remaining.remove_prefix((size_t)n);
+    }
+    return true;
+}
+
+// Sends recorded loom output to the driver
+bool
+Replay::sendLoom(const std::string& data)
+{
+    auto deadline = clock::now() + ReplayTimeout;
+    std::string_view remaining(data);
+    while (!remaining.empty()) {
+        auto n = _loom.second->write(remaining.data(), remaining.size());
+        if (n < 0) {
+            if (errno != EAGAIN || _driverDone || clock::now() > deadline) {
+                _failure = "the driver stopped reading before the log ended";
+                return false;
+            }
+            std::this_thread::sleep_for(ConsumePoll);
+            continue;
+        }
+        remaining.remove_prefix((size_t)n);
+    }
+    return true;
+}
+
+// Waits until the driver has read everything sent to it
+bool
+Replay::waitConsumed()
+{
+    auto deadline = clock::now() + ReplayTimeout;
+    int pending = 0;
+    while (_loom.second->pending() > 0 ||
+           (::ioctl(_input[0], FIONREAD, &pending) == 0 && pending > 0))
+    {
+        if (_driverDone || clock::now() > deadline) {
+            _failure = "the driver stopped reading before the log ended";
+            return false;
+        }
+        std::this_thread::sleep_for(ConsumePoll);
+    }
+    return true;
+}
+
+// Reads what the driver sends until it can be compared with the recording
+bool
+Replay::expect(const std::string& data)
+{
+    auto deadline = clock::now() + ReplayTimeout;
+    while (_received.size() < data.size()) {
+        auto now = clock::now();
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        struct pollfd pfd{_loom.second->readFD(), POLLIN, 0};
+        int ready = ::poll(&pfd, 1, _driverDone ? 0 : (int)std::max<long long>(wait, 0));
+        if (ready <= 0) {
+            if (ready < 0 && errno == EINTR)
+                continue;
+            _failure = std::format("the driver did not send \"{}\"", printable(data));
+            return false;
+        }
+        char buf[256];
+        auto n = _loom.second->read(buf, sizeof(buf));
+        if (n < 0 && errno == EAGAIN)
+            continue;
+        if (n <= 0) {
+            _failure = std::format("the driver closed the loom before sending \"{}\"", printable(data));
+            return false;
+        }
+        _received.append(buf, (size_t)n);
+    }
+    if (_received.compare(0, data.size(), data) != 0) {
+        _failure = std::format("the driver sent \"{}\" instead of \"{}\"",
+                               printable(std::string_view(_received).substr(0, data.size())),
+                               printable(data));
+        return false;
+    }
+    _received.erase(0, data.size());
+    return true;
+}
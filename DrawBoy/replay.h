@@ -0,0 +1,57 @@
+/*
+ *  replay.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include "loomlog.h"
+#include "loomtransport.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Plays back a session recorded with --log. The recorded loom output and
+// keystrokes are fed to the driver through a loopback transport and a pipe, and
+// everything the driver writes to the loom is checked against the recording.
+// Each recorded input is sent only after the driver has read the previous
+// one, so the driver sees them in the recorded order however fast it runs.
+class Replay {
+  public:
+    Replay(const std::string& path, bool realTime);
+    ~Replay();
+
+    int compuDobbyGen() const { return _log.header().compuDobbyGen; }
+    std::unique_ptr<LoomTransport> loomTransport();    // the driver's end
+    int inputFD() const { return _input[0]; }
+
+    void start();
+    void finish();                  // throws if the driver did not match
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    void feed();
+    void pace(int64_t time);
+    bool send(const std::string& data);
+    bool sendLoom(const std::string& data);
+    bool waitConsumed();
+    bool expect(const std::string& data);
+
+    LoomLogReader _log;
+    bool _realTime;
+    LoopbackTransport::Pair _loom;  // driver's end, replay's end
+    int _input[2] = {-1, -1};       // driver reads, replay writes
+    std::thread _thread;
+    std::atomic<bool> _driverDone{false};
+
+    clock::time_point _start;
+    int64_t _firstTime = -1;
+    std::string _received;          // written by the driver, not yet matched
+    uint64_t _records = 0;
+    uint64_t _matched = 0;
+    std::string _failure;
+    clock::duration _elapsed{0};
+};
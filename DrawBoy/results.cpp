@@ -0,0 +1,353 @@
+/*
+ *  results.cpp
+ *  DrawBoy
+ */
+
+
+#include "results.h"
+#include "argscommon.h"
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <print>
+#include <sstream>
+#include <stdexcept>
+
+// Reads a JSON document, recording each scalar value under its path
+class JSONValues::Reader {
+  public:
+    Reader(std::string_view text, JSONValues& values)
+    : _text(text), _values(values)
+    { }
+
+    void read()
+    {
+        value("");
+        space();
+        if (_pos != _text.size())
+            fail("unexpected text");
+    }
+
+  private:
+    std::string_view _text;
+    JSONValues& _values;
+    std::size_t _pos = 0;
+
+    [[noreturn]] void fail(const char* why) const
+    {
+        throw std::runtime_error(std::format("Bad JSON in {}: {} at byte {}.",
+                                             _values._what, why, _pos));
+    }
+
+    void space()
+    {
+        while (_pos < _text.size() && std::isspace((unsigned char)_text[_pos]))
+            ++_pos;
+    }
+
+    bool next(char c)
+    {
+        space();
+        if (_pos < _text.size() && _text[_pos] == c) {
+            ++_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!next(c))
+            fail(std::format("expected '{}'", c).c_str());
+    }
+
+    static std::string member(const std::string& path, std::string_view key)
+    {
+        return path.empty() ? std::string(key) : std::format("{}.{}", path, key);
+    }
+
+    void value(const std::string& path)
+    {
+        space();
+        if (_pos == _text.size())
+            fail("unexpected end");
+        char c = _text[_pos];
+        if (c == '{') {
+            ++_pos;
+            if (next('}'))
+                return;
+            do {
+                space();
+                std::string key = string();
+                expect(':');
+                value(member(path, key));
+            } while (next(','));
+            expect('}');
+        } else if (c == '[') {
+            ++_pos;
+            std::size_t count = 0;
+            if (!next(']')) {
+                do
+                    value(member(path, std::to_string(count++)));
+                while (next(','));
+                expect(']');
+            }
+            _values._sizes[path] = count;
+        } else if (c == '"') {
+            _values._values[path] = {string(), true};
+        } else {
+            // numbers, true, false and null
+            auto start = _pos;
+            while (_pos < _text.size() && (std::isalnum((unsigned char)_text[_pos]) ||
+                                           _text[_pos] == '-' || _text[_pos] == '+' ||
+                                           _text[_pos] == '.'))
+                ++_pos;
+            if (_pos == start)
+                fail("unexpected character");
+            _values._values[path] = {std::string(_text.substr(start, _pos - start)), false};
+        }
+    }
+
+    // Appends the character of a \u escape in UTF-8
+    void unicode(std::string& s)
+    {
+        unsigned code = 0;
+        auto digits = _text.substr(_pos + 1, 4);
+        auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), code, 16);
+        if (digits.size() != 4 || ec != std::errc() || end != digits.data() + 4)
+            fail("bad unicode escape");
+        _pos += 4;
+        if (code < 0x80) {
+            s.push_back((char)code);
+        } else if (code < 0x800) {
+            s.push_back((char)(0xc0 | (code >> 6)));
+            s.push_back((char)(0x80 | (code & 0x3f)));
+        } else {
+            s.push_back((char)(0xe0 | (code >> 12)));
+            s.push_back((char)(0x80 | ((code >> 6) & 0x3f)));
+            s.push_back((char)(0x80 | (code & 0x3f)));
+        }
+    }
+
+    std::string string()
+    {
+        if (_pos == _text.size() || _text[_pos] != '"')
+            fail("expected a string");
+        std::string s;
+        for (++_pos; _pos < _text.size() && _text[_pos] != '"'; ++_pos) {
+            if (_text[_pos] != '\\') {
+                s.push_back(_text[_pos]);
+                continue;
+            }
+            if (++_pos == _text.size())
+                break;
+            switch (_text[_pos]) {
+                case 'n':   s.push_back('\n'); break;
+                case 'r':   s.push_back('\r'); break;
+                case 't':   s.push_back('\t'); break;
+                case 'b':   s.push_back('\b'); break;
+                case 'f':   s.push_back('\f'); break;
+                case 'u':   unicode(s); break;
+                default:    s.push_back(_text[_pos]); break;
+            }
+        }
+        if (_pos >= _text.size())
+            fail("unterminated string");
+        ++_pos;
+        return s;
+    }
+};
+
+JSONValues::JSONValues(std::string_view text, std::string what)
+: _what(std::move(what))
+{
+    Reader(text, *this).read();
+}
+
+JSONValues
+JSONValues::read(const std::string& path, const std::string& what)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw make_system_error({"Cannot open ", what});
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return JSONValues(contents.str(), what);
+}
+
+double
+JSONValues::number(const std::string& key) const
+{
+    auto it = _values.find(key);
+    if (it == _values.end())
+        throw std::runtime_error(std::format("No {} in {}.", key, _what));
+    double value = 0.0;
+    auto& text = it->second.text;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (it->second.isString || ec != std::errc() || end != text.data() + text.size())
+        throw std::runtime_error(std::format("The {} in {} is not a number.", key, _what));
+    return value;
+}
+
+const std::string&
+JSONValues::text(const std::string& key) const
+{
+    auto it = _values.find(key);
+    if (it == _values.end() || !it->second.isString)
+        throw std::runtime_error(std::format("No {} in {}.", key, _what));
+    return it->second.text;
+}
+
+std::size_t
+JSONValues::size(const std::string& array) const
+{
+    auto it = _sizes.find(array);
+    return it == _sizes.end() ? 0 : it->second;
+}
+
+std::map<std::string, double>
+JSONValues::numbers(const std::string& object) const
+{
+    std::map<std::string, double> numbers;
+    std::string prefix = object.empty() ? object : object + '.';
+    for (auto it = _values.lower_bound(prefix); it != _values.end() && it->first.starts_with(prefix);
+         ++it)
+    {
+        std::string_view key = std::string_view(it->first).substr(prefix.size());
+        auto& text = it->second.text;
+        double value = 0.0;
+        if (key.contains('.') || it->second.isString)
+            continue;
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec == std::errc() && end == text.data() + text.size())
+            numbers[std::string(key)] = value;
+    }
+    return numbers;
+}
+
+namespace {
+std::string
+jsonString(std::string_view text)
+{
+    std::string s = "\"";
+    for (char c: text) {
+        switch (c) {
+            case '"':   s += "\\\""; break;
+            case '\\':  s += "\\\\"; break;
+            case '\n':  s += "\\n"; break;
+            case '\r':  s += "\\r"; break;
+            case '\t':  s += "\\t"; break;
+            case '\b':  s += "\\b"; break;
+            case '\f':  s += "\\f"; break;
+            default:
+                if ((unsigned char)c < 0x20)
+                    s += std::format("\\u{:04x}", (unsigned)c);
+                else
+                    s.push_back(c);
+                break;
+        }
+    }
+    s.push_back('"');
+    return s;
+}
+
+// JSON has no NaN or infinity, which a run too short to time can produce
+std::string
+jsonNumber(double value)
+{
+    return std::isfinite(value) ? std::format("{}", value) : "null";
+}
+}
+
+void
+writeResults(const std::vector<ResultRecord>& records, const char* list, const std::string& path)
+{
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out)
+        throw make_system_error({"Cannot write ", path});
+    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+    std::print(out, "{{\n  \"time\": \"{:%FT%TZ}\",\n  {}: [", now, jsonString(list));
+    const char* sep = "\n";
+    for (auto& r: records) {
+        std::print(out, "{}    {{\"name\": {}", sep, jsonString(r.name));
+        for (auto& [key, value]: r.fields) {
+            if (auto text = std::get_if<std::string>(&value))
+                std::print(out, ", {}: {}", jsonString(key), jsonString(*text));
+            else
+                std::print(out, ", {}: {}", jsonString(key), jsonNumber(std::get<double>(value)));
+        }
+        std::print(out, "}}");
+        sep = ",\n";
+    }
+    std::print(out, "\n  ]\n}}\n");
+    bool failed = std::ferror(out) != 0;
+    if (std::fclose(out) != 0 || failed)
+        throw make_system_error({"Cannot write ", path});
+}
+
+Baseline
+readBaseline(const std::string& path, const char* list)
+{
+    JSONValues values = JSONValues::read(path, "the baseline");
+    Baseline baseline;
+    for (std::size_t i = 0; i < values.size(list); ++i) {
+        std::string record = std::format("{}.{}", list, i);
+        baseline[values.text(record + ".name")] = values.numbers(record);
+    }
+    if (baseline.empty())
+        throw std::runtime_error("No results in the baseline.");
+    return baseline;
+}
+
+std::optional<double>
+worseThan(const Baseline& baseline, const std::string& name, const std::string& key, double value,
+          bool higherIsBetter)
+{
+    auto record = baseline.find(name);
+    if (record == baseline.end())
+        return std::nullopt;
+    auto base = record->second.find(key);
+    if (base == record->second.end() || base->second <= 0.0)
+        return std::nullopt;
+    double ratio = value / base->second;
+    return (higherIsBetter ? 1.0 - ratio : ratio - 1.0) * 100.0;
+}
+
+ResultOptions::ResultOptions(args::ArgumentParser& parser, double defaultThreshold,
+                             const std::string& thresholdHelp)
+: json(parser, "JSON_PATH", "Writes the results to a JSON file", {"json"}, "",
+       args::Options::Single),
+  compare(parser, "BASELINE_PATH", "Compares the results with ones saved by --json", {"compare"},
+          "", args::Options::Single),
+  threshold(parser, "PERCENT", thresholdHelp, {"threshold"}, defaultThreshold,
+            args::Options::Single)
+{ }
+
+int
+runTool(args::ArgumentParser& parser, const char* prog, int argc, const char* argv[],
+        const std::function<int()>& run)
+{
+    try {
+        parser.Prog(prog);
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::Error& e) {
+        std::cerr << e.what() << "\n\n" << parser;
+        return 4;
+    }
+
+    try {
+        return run();
+    } catch (std::exception& e) {
+        std::fflush(stdout);
+        std::cerr << '\n' << e.what() << std::endl;
+        return 4;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ *  results.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include "args.hxx"
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Saving results from drawboy-bench and drawboy-harness with --json, and
+// comparing later runs against them with --compare.
+
+// A JSON document read into its scalar values by path: object members are
+// joined with dots and array elements by their index, as in "latencyMs.p50"
+// or "runs.1.name".
+class JSONValues {
+  public:
+    // what names the document in error messages
+    JSONValues(std::string_view text, std::string what);
+    static JSONValues read(const std::string& path, const std::string& what);
+
+    bool contains(const std::string& key) const { return _values.contains(key); }
+    double number(const std::string& key) const;
+    const std::string& text(const std::string& key) const;
+    std::size_t size(const std::string& array) const;      // 0 if there is no such array
+    std::map<std::string, double> numbers(const std::string& object) const;   // its number members
+
+  private:
+    class Reader;
+
+    struct Scalar {
+        std::string text;           // unescaped strings, other values as written
+        bool isString;
+    };
+
+    std::string _what;
+    std::map<std::string, Scalar> _values;
+    std::map<std::string, std::size_t> _sizes;
+};
+
+// One benchmark or harness run: its name and what was measured, in the
+// order it is written
+struct ResultRecord {
+    using Value = std::variant<std::string, double>;
+
+    std::string name;
+    std::vector<std::pair<std::string, Value>> fields;
+};
+
+// Writes the records, with the time, as the array named list
+void writeResults(const std::vector<ResultRecord>& records, const char* list,
+                  const std::string& path);
+
+// The numbers in each record written by writeResults, by record name and
+// then by key
+using Baseline = std::map<std::string, std::map<std::string, double>>;
+
+Baseline readBaseline(const std::string& path, const char* list);
+
+// How much worse than the baseline a measurement is, in percent, or nothing
+// if the baseline lacks it
+std::optional<double> worseThan(const Baseline& baseline, const std::string& name,
+                                const std::string& key, double value, bool higherIsBetter);
+
+// The options that save results and compare with a baseline
+struct ResultOptions {
+    ResultOptions(args::ArgumentParser& parser, double defaultThreshold,
+                  const std::string& thresholdHelp);
+
+    args::ValueFlag<std::string> json;
+    args::ValueFlag<std::string> compare;
+    args::ValueFlag<double> threshold;
+};
+
+// Parses the arguments and calls run, returning its exit status: 0 after
+// showing the help, and 4 for bad arguments or any error run throws
+int runTool(args::ArgumentParser& parser, const char* prog, int argc, const char* argv[],
+            const std::function<int()>& run);
@@ -0,0 +1,301 @@
+/*
+ *  script.cpp
+ *  DrawBoy
+ */
+
+
+#include "script.h"
+#include "argscommon.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <format>
+#include <map>
+#include <poll.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+const std::chrono::milliseconds ConsumePoll{1};
+const std::chrono::milliseconds SleepSlice{10};
+// Longer than Term's escape timeout, so that a lone escape is not read as
+// the start of the next key
+const std::chrono::milliseconds EscapePause{50};
+
+const std::map<std::string_view, std::string_view> namedKeys = {
+    {"tabby",       "t"},
+    {"liftplan",    "l"},
+    {"reverse",     "r"},
+    {"quit",        "q"},
+    {"up",          "\x1b[A"},
+    {"down",        "\x1b[B"},
+    {"right",       "\x1b[C"},
+    {"left",        "\x1b[D"},
+    {"home",        "\x1b[H"},
+    {"end",         "\x1b[F"},
+    {"insert",      "\x1b[2~"},
+    {"delete",      "\x1b[3~"},
+    {"pageup",      "\x1b[5~"},
+    {"pagedown",    "\x1b[6~"},
+    {"enter",       "\r"},
+    {"tab",         "\t"},
+    {"escape",      "\x1b"},
+    {"backspace",   "\x7f"},
+};
+
+std::string
+unescape(std::string_view text)
+{
+    std::string keys;
+    for (std::size_t i = 0; i < text.length(); ++i) {
+        if (text[i] != '\\') {
+            keys.push_back(text[i]);
+            continue;
+        }
+        if (++i == text.length())
+            throw std::runtime_error("escape at end of line");
+        switch (text[i]) {
+            case 'r':   keys.push_back('\r');   break;
+            case 'n':   keys.push_back('\n');   break;
+            case 't':   keys.push_back('\t');   break;
+            case 'e':   keys.push_back('\x1b'); break;
+            case '\\':  keys.push_back('\\');   break;
+            case 'x': {
+                std::string hex(text.substr(i + 1, 2));
+                if (hex.length() != 2 || !std::isxdigit((unsigned char)hex[0]) ||
+                    !std::isxdigit((unsigned char)hex[1]))
+                    throw std::runtime_error("\\x needs two hex digits");
+                keys.push_back((char)std::stoi(hex, nullptr, 16));
+                i += 2;
+                break;
+            }
+            default:
+                throw std::runtime_error(std::format("unknown escape \\{}", text[i]));
+        }
+    }
+    return keys;
+}
+
+bool
+readLine(std::FILE* stream, std::string& line)
+{
+    line.clear();
+    int c;
+    while ((c = std::fgetc(stream)) != EOF) {
+        if (c == '\n')
+            return true;
+        line.push_back((char)c);
+    }
+    return !line.empty();
+}
+}
+
+Script::Step
+Script::parseLine(const std::string& line)
+{
+    std::string_view rest(line);
+    while (!rest.empty() && std::isspace((unsigned char)rest.front()))
+        rest.remove_prefix(1);
+    while (!rest.empty() && std::isspace((unsigned char)rest.back()))
+        rest.remove_suffix(1);
+    if (rest.empty() || rest.front() == '#')
+        return {};
+
+    auto space = rest.find_first_of(" \t");
+    std::string command(rest.substr(0, space));
+    rest.remove_prefix(space == std::string_view::npos ? rest.length() : space);
+    while (!rest.empty() && std::isspace((unsigned char)rest.front()))
+        rest.remove_prefix(1);
+    for (auto& c: command)
+        c = (char)std::tolower((unsigned char)c);
+
+    if (command == "keys") {
+        if (rest.empty())
+            throw std::runtime_error("keys needs some text");
+        return {unescape(rest)};
+    }
+    if (command == "pick" || command == "picks") {
+        if (rest.empty())
+            throw std::runtime_error(std::format("{} needs a value", command));
+        return {std::format("{}{}\r", command == "pick" ? 's' : 'p', rest)};
+    }
+    if (command == "sleep") {
+        double secs = -1.0;
+        try {
+            std::size_t pos = 0;
+            secs = std::stod(std::string(rest), &pos);
+            if (pos != rest.length())
+                secs = -1.0;
+        } catch (std::exception&) { }
+        if (!(secs >= 0.0))
+            throw std::runtime_error(std::format("sleep needs a number of seconds, not '{}'", rest));
+        return {"", std::chrono::milliseconds((long long)(secs * 1000.0))};
+    }
+    if (auto key = namedKeys.find(command); key != namedKeys.end()) {
+        if (!rest.empty())
+            throw std::runtime_error(std::format("{} does not take a value", command));
+        return {std::string(key->second)};
+    }
+    throw std::runtime_error(std::format("unknown command '{}'", command));
+}
+
+Script::Script(const std::string& path)
+{
+    if (path == "-") {
+        _streamFD = STDIN_FILENO;
+    } else {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (!file)
+            throw make_system_error("Cannot open script file");
+        std::string line;
+        try {
+            for (int lineNum = 1; readLine(file, line); ++lineNum) {
+                try {
+                    _steps.push_back(parseLine(line));
+                } catch (std::runtime_error& e) {
+                    throw std::runtime_error(std::format("Script line {}: {}", lineNum, e.what()));
+                }
+            }
+        } catch (...) {
+            std::fclose(file);
+            throw;
+        }
+        std::fclose(file);
+    }
+
+    if (::pipe(_input) != 0)
+        throw make_system_error("Cannot create script input");
+    ::fcntl(_input[0], F_SETFL, ::fcntl(_input[0], F_GETFL) | O_NONBLOCK);
+}
+
+Script::~Script()
+{
+    _driverDone = true;
+    if (_thread.joinable())
+        _thread.join();
+    for (int fd: _input)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+void
+Script::start()
+{
+    _thread = std::thread(&Script::feed, this);
+}
+
+void
+Script::finish()
+{
+    _driverDone = true;
+    if (_thread.joinable())
+        _thread.join();
+    if (!_failure.empty())
+        throw std::runtime_error(_failure);
+}
+
+void
+Script::feed()
+{
+    if (_streamFD >= 0) {
+        std::string line;
+        for (int lineNum = 1; readStreamLine(line); ++lineNum) {
+            try {
+                if (!type(parseLine(line)))
+                    break;
+            } catch (std::runtime_error& e) {
+                _failure = std::format("Script line {}: {}", lineNum, e.what());
+                break;
+            }
+        }
+    } else {
+        for (auto& step: _steps)
+            if (!type(step))
+                break;
+    }
+
+    // The script is over, or went wrong
+    if (!_driverDone)
+        type({"\x03"});
+}
+
+// Reads the next line from standard input. Waits in short slices so that the
+// thread notices when the driver is done, instead of blocking in read until
+// another line arrives and holding up the driver's exit.
+bool
+Script::readStreamLine(std::string& line)
+{
+    while (!_driverDone) {
+        if (auto end = _streamText.find('\n'); end != std::string::npos) {
+            line = _streamText.substr(0, end);
+            _streamText.erase(0, end + 1);
+            return true;
+        }
+        if (_streamEnded) {
+            line = std::move(_streamText);
+            _streamText.clear();
+            return !line.empty();
+        }
+
+        struct pollfd pfd{_streamFD, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, (int)SleepSlice.count());
+        if (ready < 0 && errno != EINTR)
+            break;
+        if (ready <= 0)
+            continue;
+        char buf[256];
+        auto n = ::read(_streamFD, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            break;
+        }
+        if (n == 0)
+            _streamEnded = true;
+        _streamText.append(buf, (std::size_t)n);
+    }
+    if (!_driverDone)
+        _failure = make_system_error("Cannot read script").what();
+    return false;
+}
+
+// Types one step at the driver and waits for it to be read
+bool
+Script::type(const Step& step)
+{
+    std::string_view remaining(step.keys);
+    while (!remaining.empty()) {
+        auto n = ::write(_input[1], remaining.data(), remaining.size());
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        remaining.remove_prefix((size_t)n);
+    }
+    if (!waitConsumed())
+        return false;
+    if (step.keys.ends_with('\x1b'))
+        std::this_thread::sleep_for(EscapePause);
+
+    auto until = std::chrono::steady_clock::now() + step.pause;
+    while (!_driverDone && std::chrono::steady_clock::now() < until)
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            SleepSlice, until - std::chrono::steady_clock::now()));
+    return !_driverDone;
+}
+
+bool
+Script::waitConsumed()
+{
+    int pending = 0;
+    while (::ioctl(_input[0], FIONREAD, &pending) == 0 && pending > 0) {
+        if (_driverDone)
+            return false;
+        std::this_thread::sleep_for(ConsumePoll);
+    }
+    return true;
+}
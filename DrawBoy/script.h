@@ -0,0 +1,64 @@
+/*
+ *  script.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Types keyboard commands at the driver from a script file, or from standard
+// input when the path is "-", so that drawboy can run without a terminal.
+// Each line of the script is one command:
+//
+//   # comment
+//   keys TEXT         types TEXT, with \r \n \t \e \\ and \xHH escapes
+//   tabby | liftplan | reverse | quit
+//                     the t, l, r and q commands
+//   pick N            the s command, entering pick N
+//   picks LIST        the p command, entering pick list LIST
+//   up | down | left | right | home | end | pageup | pagedown |
+//   insert | delete | enter | tab | escape | backspace
+//                     a single key
+//   sleep SECONDS     waits before the next command
+//
+// Each command is typed once the driver has read the previous one. When the
+// script ends the driver quits.
+class Script {
+  public:
+    explicit Script(const std::string& path);
+    ~Script();
+
+    int inputFD() const { return _input[0]; }
+
+    void start();
+    void finish();                  // throws if the script had an error
+
+    struct Step {
+        std::string keys;
+        std::chrono::milliseconds pause{0};
+    };
+
+    // Throws std::runtime_error for a line that is not a command
+    static Step parseLine(const std::string& line);
+
+  private:
+    void feed();
+    bool readStreamLine(std::string& line);
+    bool type(const Step& step);
+    bool waitConsumed();
+
+    int _streamFD = -1;             // script read as it runs, from stdin
+    std::string _streamText;        // read from it but not yet run
+    bool _streamEnded = false;
+    std::vector<Step> _steps;       // script read in advance, from a file
+    int _input[2] = {-1, -1};       // driver reads, script writes
+    std::thread _thread;
+    std::atomic<bool> _driverDone{false};
+    std::string _failure;
+};
@@ -0,0 +1,122 @@
+/*
+ *  startup.cpp
+ *  DrawBoy
+ */
+
+
+#include "startup.h"
+#include "argscommon.h"
+#include <cstdio>
+#include <format>
+#include <print>
+#include <sys/resource.h>
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+StartupProfile startupProfile;
+
+namespace {
+// Bytes that malloc has handed out and not had back, on the platforms that
+// say, otherwise zero
+int64_t
+heapInUse()
+{
+#ifdef __APPLE__
+    malloc_statistics_t stats{};
+    ::malloc_zone_statistics(nullptr, &stats);
+    return (int64_t)stats.size_in_use;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = ::mallinfo2();
+    return (int64_t)(info.uordblks + info.hblkhd);
+#else
+    return 0;
+#endif
+}
+}
+
+StartupProfile::Sample
+StartupProfile::Sample::now()
+{
+    Sample s;
+    s.wall = std::chrono::steady_clock::now();
+    struct rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    s.cpu = std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+            std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#ifdef __APPLE__
+    s.peakRSS = usage.ru_maxrss / 1024;     // bytes on macOS
+#else
+    s.peakRSS = usage.ru_maxrss;            // KB on Linux
+#endif
+    s.minorFaults = usage.ru_minflt;
+    s.heapBytes = heapInUse();
+    return s;
+}
+
+void
+StartupProfile::phase(const char* name)
+{
+    finish();
+    _current = name;
+    _start = Sample::now();
+}
+
+void
+StartupProfile::finish()
+{
+    if (!_current)
+        return;
+    Sample end = Sample::now();
+    _phases.push_back({
+        _current,
+        _start.wall,
+        std::chrono::duration<double, std::milli>(end.wall - _start.wall).count(),
+        std::chrono::duration<double, std::milli>(end.cpu - _start.cpu).count(),
+        end.heapBytes - _start.heapBytes,
+        end.minorFaults - _start.minorFaults,
+        end.peakRSS
+    });
+    _current = nullptr;
+}
+
+void
+StartupProfile::report() const
+{
+    std::print("\r\n{:<18}{:>10} {:>10} {:>10} {:>8} {:>10}\r\n",
+               "Startup phase", "wall ms", "cpu ms", "heap KB", "faults", "peak KB");
+    Phase total{"total", {}, 0.0, 0.0, 0, 0, 0};
+    for (auto& p: _phases) {
+        std::print("{:<18}{:>10.2f} {:>10.2f} {:>10.1f} {:>8} {:>10}\r\n", p.name, p.wallMillis,
+                   p.cpuMillis, (double)p.heapBytes / 1024.0, p.minorFaults, p.peakRSS);
+        total.wallMillis += p.wallMillis;
+        total.cpuMillis += p.cpuMillis;
+        total.heapBytes += p.heapBytes;
+        total.minorFaults += p.minorFaults;
+        total.peakRSS = p.peakRSS;
+    }
+    std::print("{:<18}{:>10.2f} {:>10.2f} {:>10.1f} {:>8} {:>10}\r\n", total.name, total.wallMillis,
+               total.cpuMillis, (double)total.heapBytes / 1024.0, total.minorFaults, total.peakRSS);
+}
+
+void
+StartupProfile::writeJSON(const std::string& path) const
+{
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out)
+        throw make_system_error("Cannot write startup profile");
+
+    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+    std::print(out, "{{\n  \"time\": \"{:%FT%TZ}\",\n  \"phases\": [", now);
+    const char* sep = "\n";
+    for (auto& p: _phases) {
+        std::print(out, "{}    {{\"name\": \"{}\", \"wallMs\": {:.3f}, \"cpuMs\": {:.3f}, "
+                   "\"heapBytes\": {}, \"minorFaults\": {}, \"peakRSSKB\": {}}}",
+                   sep, p.name, p.wallMillis, p.cpuMillis, p.heapBytes, p.minorFaults, p.peakRSS);
+        sep = ",\n";
+    }
+    std::print(out, "\n  ]\n}}\n");
+    std::fclose(out);
+}
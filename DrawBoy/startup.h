@@ -0,0 +1,54 @@
+/*
+ *  startup.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Measures each phase of starting up, from parsing the arguments to the end
+// of the loom handshake: wall and CPU time, the change in heap memory in
+// use, minor page faults, and the peak resident set size when the phase
+// ended. Phases follow each other, so
+// starting one ends the one before.
+class StartupProfile {
+  public:
+    void phase(const char* name);
+    void finish();                  // ends the current phase, if any
+
+    void report() const;
+    void writeJSON(const std::string& path) const;
+
+    struct Phase {
+        const char* name;
+        std::chrono::steady_clock::time_point start;
+        double wallMillis;
+        double cpuMillis;
+        int64_t heapBytes;          // change in heap memory in use
+        long minorFaults;
+        long peakRSS;
+    };
+
+    const std::vector<Phase>& phases() const { return _phases; }
+
+  private:
+    struct Sample {
+        std::chrono::steady_clock::time_point wall;
+        std::chrono::microseconds cpu;
+        int64_t heapBytes;
+        long minorFaults;
+        long peakRSS;               // KB
+        static Sample now();
+    };
+
+    const char* _current = nullptr;
+    Sample _start;
+    std::vector<Phase> _phases;
+};
+
+extern StartupProfile startupProfile;
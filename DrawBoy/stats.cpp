@@ -0,0 +1,177 @@
+/*
+ *  stats.cpp
+ *  DrawBoy
+ */
+
+
+#include "stats.h"
+#include <bit>
+#include <cmath>
+#include <format>
+#include <print>
+
+namespace {
+double
+toMillis(std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+double
+usecsToMillis(uint64_t usecs)
+{
+    return (double)usecs / 1000.0;
+}
+}
+
+int
+Histogram::bucketOf(uint64_t usecs)
+{
+    if (usecs < SubBuckets)
+        return (int)usecs;
+    if (usecs > UINT32_MAX)
+        usecs = UINT32_MAX;
+    int shift = std::bit_width(usecs) - (SubBucketBits + 1);
+    return (shift + 1) * SubBuckets + (int)((usecs >> shift) - SubBuckets);
+}
+
+uint64_t
+Histogram::highestIn(int bucket)
+{
+    if (bucket < SubBuckets)
+        return (uint64_t)bucket;
+    int shift = bucket / SubBuckets - 1;
+    uint64_t sub = (uint64_t)(bucket % SubBuckets + SubBuckets);
+    return ((sub + 1) << shift) - 1;
+}
+
+void
+Histogram::record(std::chrono::steady_clock::duration d)
+{
+    auto usecs = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    uint64_t value = usecs < 0 ? 0 : (uint64_t)usecs;
+    ++_counts[(size_t)bucketOf(value)];
+    ++_count;
+    _total += value;
+    if (value < _min) _min = value;
+    if (value > _max) _max = value;
+}
+
+double
+Histogram::percentile(double p) const
+{
+    if (_count == 0)
+        return 0.0;
+    auto target = (uint64_t)std::ceil(p / 100.0 * (double)_count);
+    if (target < 1) target = 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < Buckets; ++bucket) {
+        seen += _counts[(size_t)bucket];
+        if (seen >= target)
+            return usecsToMillis(std::min(highestIn(bucket), _max));
+    }
+    return usecsToMillis(_max);
+}
+
+double
+Histogram::min() const
+{
+    return _count ? usecsToMillis(_min) : 0.0;
+}
+
+double
+Histogram::max() const
+{
+    return usecsToMillis(_max);
+}
+
+double
+Histogram::mean() const
+{
+    return _count ? usecsToMillis(_total) / (double)_count : 0.0;
+}
+
+PickStats::PickStats(bool waitsForReady, int budgetMillis)
+: _waitsForReady(waitsForReady), _budget(std::chrono::milliseconds(budgetMillis)),
+  _intervals{{
+    {"shed open to lift", Step::Down, Step::Lift, {}},
+    {"lift to written", Step::Lift, Step::Written, {}},
+    {"written to ready", Step::Written, Step::Ready, {}},
+    {"pick latency", Step::Down, waitsForReady ? Step::Ready : Step::Written, {}},
+    {"shed open time", Step::Down, Step::Up, {}},
+    {"pick display", Step::Up, Step::Shown, {}},
+  }}
+{ }
+
+bool
+PickStats::mark(Step step, clock::time_point when)
+{
+    auto& down = _marks[(size_t)Step::Down];
+    if (step == Step::Down) {
+        if (down)
+            finishPick();       // the shed never closed, e.g. <arm null>
+        down = when;
+        return false;
+    }
+    auto& mark = _marks[(size_t)step];
+    if (!down || mark)
+        return false;           // not picking, or already reached this step
+    mark = when;
+
+    bool over = false;
+    if (step == (_waitsForReady ? Step::Ready : Step::Written) &&
+        _budget > clock::duration::zero() && when - *down > _budget)
+    {
+        ++_overBudget;
+        std::print("\r\nPick took {:.1f}ms, over the {:.0f}ms latency budget\r\n",
+                   toMillis(when - *down), toMillis(_budget));
+        over = true;
+    }
+    if (step == Step::Shown)
+        finishPick();
+    return over;
+}
+
+void
+PickStats::finishPick()
+{
+    for (auto& interval: _intervals) {
+        auto& from = _marks[(size_t)interval.from];
+        auto& to = _marks[(size_t)interval.to];
+        if (from && to)
+            interval.histogram.record(*to - *from);
+    }
+    ++_picks;
+    _marks.fill(std::nullopt);
+}
+
+std::string
+PickStats::statusLine() const
+{
+    const Histogram& latency = _intervals[3].histogram;
+    if (latency.count() == 0)
+        return "No picks timed yet.";
+    auto line = std::format("{} picks, latency p50 {:.1f}ms, p99 {:.1f}ms, max {:.1f}ms",
+                            _picks, latency.percentile(50), latency.percentile(99), latency.max());
+    if (_budget > clock::duration::zero())
+        line += std::format(", {} over budget", _overBudget);
+    return line;
+}
+
+void
+PickStats::report() const
+{
+    std::print("\r\n{:<18}{:>8} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}\r\n",
+               "Pick timing (ms)", "count", "min", "p50", "p90", "p99", "max", "mean");
+    for (auto& interval: _intervals) {
+        const Histogram& h = interval.histogram;
+        if (h.count() == 0)
+            continue;
+        std::print("{:<18}{:>8} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f}\r\n",
+                   interval.name, h.count(), h.min(), h.percentile(50), h.percentile(90),
+                   h.percentile(99), h.max(), h.mean());
+    }
+    if (_budget > clock::duration::zero())
+        std::print("{} of {} picks over the {:.0f}ms latency budget\r\n",
+                   _overBudget, _picks, toMillis(_budget));
+}
@@ -0,0 +1,83 @@
+/*
+ *  stats.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Log-linear histogram of durations in microseconds, in the style of
+// HdrHistogram: each power of two is split into 32 linear buckets, so any
+// recorded value is reported to within about 3%.
+class Histogram {
+  public:
+    void record(std::chrono::steady_clock::duration d);
+
+    uint64_t count() const { return _count; }
+    double percentile(double p) const;      // milliseconds
+    double min() const;                     // milliseconds
+    double max() const;                     // milliseconds
+    double mean() const;                    // milliseconds
+
+  private:
+    static constexpr int SubBucketBits = 5;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int Buckets = (32 - SubBucketBits + 1) * SubBuckets;
+
+    static int bucketOf(uint64_t usecs);
+    static uint64_t highestIn(int bucket);
+
+    std::array<uint64_t, Buckets> _counts{};
+    uint64_t _count = 0;
+    uint64_t _total = 0;
+    uint64_t _min = UINT64_MAX;
+    uint64_t _max = 0;
+};
+
+// Timestamps of each step of a pick, from the loom opening the shed to it
+// closing again, aggregated over the session.
+class PickStats {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    enum class Step {
+        Down,       // loom reported the shed open
+        Lift,       // lift calculated
+        Written,    // last byte of the pick written to the loom
+        Ready,      // loom acknowledged the pick (Compu-Dobby IV only)
+        Up,         // loom reported the shed closed
+        Shown,      // next pick displayed
+    };
+
+    PickStats(bool waitsForReady, int budgetMillis);
+
+    // Returns true if this step put the pick over the latency budget
+    bool mark(Step step, clock::time_point when = clock::now());
+
+    std::string statusLine() const;
+    void report() const;
+
+  private:
+    static constexpr std::size_t StepCount = 6;
+
+    struct Interval {
+        const char* name;
+        Step from, to;
+        Histogram histogram;
+    };
+
+    void finishPick();
+
+    bool _waitsForReady;
+    clock::duration _budget;
+    uint64_t _picks = 0;
+    uint64_t _overBudget = 0;
+    std::array<std::optional<clock::time_point>, StepCount> _marks;
+    std::array<Interval, 6> _intervals;
+};
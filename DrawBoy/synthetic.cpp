@@ -0,0 +1,237 @@
+/*
+ *  synthetic.cpp
+ *  DrawBoy
+ */
+
+
+#include "synthetic.h"
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+// The order'th entry of a threading or treadling over count shafts or treadles
+int
+ordered(SyntheticDraft::Order order, int index, int count, std::mt19937_64& rng)
+{
+    switch (order) {
+        case SyntheticDraft::Order::Straight:
+            return index % count + 1;
+        case SyntheticDraft::Order::Point: {
+            if (count == 1)
+                return 1;
+            int k = index % (2 * count - 2);
+            return k < count ? k + 1 : 2 * count - 1 - k;
+        }
+        case SyntheticDraft::Order::Random:
+        default:
+            return (int)(rng() % (uint64_t)count) + 1;
+    }
+}
+
+void
+writeShafts(std::ostream& out, uint64_t lift)
+{
+    bool first = true;
+    for (int shaft = 1; lift; lift >>= 1, ++shaft)
+        if (lift & 1) {
+            if (!first) out << ',';
+            out << shaft;
+            first = false;
+        }
+}
+
+// Palette colors spread around the color wheel
+void
+paletteEntry(int i, int& red, int& green, int& blue)
+{
+    red = i * 37 % 256;
+    green = i * 91 % 256;
+    blue = i * 53 % 256;
+}
+}
+
+void
+SyntheticDraft::generate()
+{
+    if (shafts < 1 || shafts > 40)
+        throw std::runtime_error("Synthetic draft shafts must be from 1 to 40.");
+    if (treadles < 1 || treadles > 64)
+        throw std::runtime_error("Synthetic draft treadles must be from 1 to 64.");
+    if (ends < 1 || picks < 1)
+        throw std::runtime_error("Synthetic draft needs at least one end and one pick.");
+    if (colors < 2)
+        throw std::runtime_error("Synthetic draft palette needs at least two colors.");
+    if (threadingRepeat < 0 || treadlingRepeat < 0)
+        throw std::runtime_error("Synthetic draft repeats cannot be negative.");
+
+    std::mt19937_64 rng(seed);
+    uint64_t allShafts = (1ull << shafts) - 1;
+
+    // Twill tie-up for the first treadles, any other treadles tied at random.
+    // No treadle is tied to nothing, as a WIF key line cannot be empty.
+    _tieup.assign((size_t)treadles, 0);
+    int span = shafts > 1 ? shafts / 2 : 1;
+    for (int t = 0; t < treadles; ++t) {
+        if (t < shafts) {
+            for (int j = 0; j < span; ++j)
+                _tieup[(size_t)t] |= 1ull << ((t + j) % shafts);
+        } else {
+            while ((_tieup[(size_t)t] = rng() & allShafts) == 0) { }
+        }
+    }
+
+    int threadingLength = threadingRepeat > 0 && threadingRepeat < ends ? threadingRepeat : ends;
+    int treadlingLength = treadlingRepeat > 0 && treadlingRepeat < picks ? treadlingRepeat : picks;
+    _threading.resize((size_t)threadingLength);
+    _warpColors.resize((size_t)threadingLength);
+    for (int i = 0; i < threadingLength; ++i) {
+        _threading[(size_t)i] = ordered(threadingOrder, i, shafts, rng);
+        _warpColors[(size_t)i] = (int)(rng() % (uint64_t)colors) + 1;
+    }
+    _treadling.resize((size_t)treadlingLength);
+    _weftColors.resize((size_t)treadlingLength);
+    for (int i = 0; i < treadlingLength; ++i) {
+        _treadling[(size_t)i] = ordered(treadlingOrder, i, treadles, rng);
+        _weftColors[(size_t)i] = (int)(rng() % (uint64_t)colors) + 1;
+    }
+}
+
+int
+SyntheticDraft::shaftOf(int end) const
+{
+    return _threading[(size_t)(end - 1) % _threading.size()];
+}
+
+int
+SyntheticDraft::treadleOf(int pick) const
+{
+    return _treadling[(size_t)(pick - 1) % _treadling.size()];
+}
+
+uint64_t
+SyntheticDraft::liftOf(int pick) const
+{
+    return _tieup[(size_t)treadleOf(pick) - 1];
+}
+
+int
+SyntheticDraft::warpColorOf(int end) const
+{
+    return _warpColors[(size_t)(end - 1) % _warpColors.size()];
+}
+
+int
+SyntheticDraft::weftColorOf(int pick) const
+{
+    return _weftColors[(size_t)(pick - 1) % _weftColors.size()];
+}
+
+void
+SyntheticDraft::writeWIF(std::ostream& out) const
+{
+    out << "[WIF]\nVersion=1.1\nSource Program=draftgen\n"
+           "[CONTENTS]\nCOLOR PALETTE=true\nWEAVING=true\nWARP=true\nWEFT=true\n"
+           "COLOR TABLE=true\nTHREADING=true\nWARP COLORS=true\nWEFT COLORS=true\n"
+        << (liftplan ? "LIFTPLAN=true\n" : "TIEUP=true\nTREADLING=true\n")
+        << "[WEAVING]\nShafts=" << shafts << "\nTreadles=" << treadles << "\nRising Shed=true\n"
+        << "[WARP]\nThreads=" << ends << "\nColor=1\n"
+        << "[WEFT]\nThreads=" << picks << "\nColor=2\n"
+        << "[COLOR PALETTE]\nEntries=" << colors << "\nRange=0,255\n[COLOR TABLE]\n";
+    for (int i = 1; i <= colors; ++i) {
+        int red, green, blue;
+        paletteEntry(i, red, green, blue);
+        out << i << '=' << red << ',' << green << ',' << blue << '\n';
+    }
+
+    out << "[WARP COLORS]\n";
+    for (int end = 1; end <= ends; ++end)
+        out << end << '=' << warpColorOf(end) << '\n';
+    out << "[WEFT COLORS]\n";
+    for (int pick = 1; pick <= picks; ++pick)
+        out << pick << '=' << weftColorOf(pick) << '\n';
+    out << "[THREADING]\n";
+    for (int end = 1; end <= ends; ++end)
+        out << end << '=' << shaftOf(end) << '\n';
+
+    if (liftplan) {
+        out << "[LIFTPLAN]\n";
+        for (int pick = 1; pick <= picks; ++pick) {
+            out << pick << '=';
+            writeShafts(out, liftOf(pick));
+            out << '\n';
+        }
+    } else {
+        out << "[TIEUP]\n";
+        for (int t = 1; t <= treadles; ++t) {
+            out << t << '=';
+            writeShafts(out, _tieup[(size_t)t - 1]);
+            out << '\n';
+        }
+        out << "[TREADLING]\n";
+        for (int pick = 1; pick <= picks; ++pick)
+            out << pick << '=' << treadleOf(pick) << '\n';
+    }
+}
+
+void
+SyntheticDraft::writeDTX(std::ostream& out) const
+{
+    out << "@@StartDTX\n\n@@Contents\nInfo\nColor Palet\nWarp Colors\nWeft Colors\nThreading\n"
+        << (liftplan ? "Liftplan\n" : "Tieup\nTreadling\n")
+        << "\n@@Info\n%%shafts " << shafts << "\n%%treadles " << treadles
+        << "\n%%ends " << ends << "\n%%picks " << picks << "\n\n@@Color Palet\n";
+    // The palette is numbered from 0, which the colors here never use
+    out << "0,0,0\n";
+    for (int i = 1; i <= colors; ++i) {
+        int red, green, blue;
+        paletteEntry(i, red, green, blue);
+        out << red << ',' << green << ',' << blue << '\n';
+    }
+
+    // Sections of numbers have twenty to a line
+    auto numbers = [&out](const char* section, int count, auto valueOf) {
+        out << "\n@@" << section << '\n';
+        for (int i = 1; i <= count; ++i)
+            out << valueOf(i) << (i % 20 == 0 || i == count ? '\n' : ' ');
+    };
+    numbers("Warp Colors", ends, [this](int end) { return warpColorOf(end); });
+    numbers("Weft Colors", picks, [this](int pick) { return weftColorOf(pick); });
+    numbers("Threading", ends, [this](int end) { return shaftOf(end); });
+
+    if (liftplan) {
+        out << "\n@@Liftplan\n";
+        for (int pick = 1; pick <= picks; ++pick) {
+            uint64_t lift = liftOf(pick);
+            for (int shaft = 0; shaft < shafts; ++shaft)
+                out << (lift & (1ull << shaft) ? '1' : '0');
+            out << '\n';
+        }
+    } else {
+        // Highest shaft first
+        out << "\n@@Tieup\n";
+        for (int shaft = shafts - 1; shaft >= 0; --shaft) {
+            for (int t = 0; t < treadles; ++t)
+                out << (_tieup[(size_t)t] & (1ull << shaft) ? '1' : '0');
+            out << '\n';
+        }
+        numbers("Treadling", picks, [this](int pick) { return treadleOf(pick); });
+    }
+    out << "\n@@EndDTX\n";
+}
+
+std::string
+SyntheticDraft::wifText() const
+{
+    std::ostringstream out;
+    writeWIF(out);
+    return out.str();
+}
+
+std::string
+SyntheticDraft::dtxText() const
+{
+    std::ostringstream out;
+    writeDTX(out);
+    return out.str();
+}
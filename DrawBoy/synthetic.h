@@ -0,0 +1,54 @@
+/*
+ *  synthetic.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A reproducible draft of any size, for benchmarks and parser tests. The
+// threading and treadling are each a repeat that is woven over and over, so
+// that a draft of millions of picks needs only as much memory as its repeat.
+struct SyntheticDraft {
+    enum class Order {
+        Straight,       // 1, 2, 3, 4, 1, 2, ...
+        Point,          // 1, 2, 3, 4, 3, 2, 1, 2, ...
+        Random,
+    };
+
+    int shafts = 8;             // 1 to 40
+    int treadles = 10;          // 1 to 64
+    int ends = 400;
+    int picks = 1000;
+    int colors = 8;             // palette size, at least 2
+    bool liftplan = false;      // a liftplan instead of a tie-up and treadling
+    Order threadingOrder = Order::Straight;
+    Order treadlingOrder = Order::Straight;
+    int threadingRepeat = 0;    // ends in the threading repeat, or 0 for all of them
+    int treadlingRepeat = 0;    // picks in the treadling repeat, or 0 for all of them
+    uint64_t seed = 1;
+
+    // Checks the parameters and builds the repeats
+    void generate();
+
+    void writeWIF(std::ostream& out) const;
+    void writeDTX(std::ostream& out) const;
+    std::string wifText() const;
+    std::string dtxText() const;
+
+    int shaftOf(int end) const;             // 1-based, like the draft classes
+    int treadleOf(int pick) const;          // 1-based
+    uint64_t liftOf(int pick) const;        // shafts raised on a pick
+    int warpColorOf(int end) const;         // palette entry, 1-based
+    int weftColorOf(int pick) const;
+
+  private:
+    std::vector<int> _threading, _treadling;
+    std::vector<int> _warpColors, _weftColors;
+    std::vector<uint64_t> _tieup;
+};
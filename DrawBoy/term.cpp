@@ -11,7 +11,10 @@
 #include <exception>
 #include <system_error>
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <unistd.h>
 #include "color.h"
 
@@ -22,12 +25,18 @@ namespace {
     void sigwinch_handler(int /* signal */) { pendingResize = true; }
     int flushwrite(const char* str, std::FILE* f = stdout)
         { auto ret = std::fputs(str, f); std::fflush(f); return ret; }
+
+    const int EscapeTimeout = 25;       // ms to wait for the rest of an escape sequence
+    const int PasteTimeout = 250;       // ms to wait for the rest of a paste
+    const std::size_t MaxSequence = 32;
+    const char* PasteEnd = "\x1b[201~";
 }
 
 Term::Term(bool ansi)
 {
     _good = false;
     _ansiOK = ansi;
+    _inputFD = STDIN_FILENO;
     _rows = 0;
     _cols = 0;
 
@@ -42,7 +51,7 @@ Term::Term(bool ansi)
     _original_termios = t;
     ::cfmakeraw(&t);
     t.c_cc[VMIN] = 0;
-    t.c_cc[VTIME] = 1;
+    t.c_cc[VTIME] = 0;
     err = ::tcsetattr(STDOUT_FILENO, TCSAFLUSH, &t);
     if (err != 0) throw std::system_error(errno, std::generic_category(), "setting term attr");
 
@@ -55,15 +64,26 @@ Term::Term(bool ansi)
             //"\x1b[?1049h"   // use alternate buffer, saving cursor first
             //"\x1b[2J"       // erase whole screen
             "\x1b[?7l"      // turn off wrapping
+            "\x1b[?2004h"   // turn on bracketed paste
             TermStyleReset  // reset style
         );
 
     _good = true;
 }
 
+Term::Term(bool ansi, int inputFD)
+{
+    _ansiOK = ansi;
+    _headless = true;
+    _inputFD = inputFD;
+    _rows = 24;
+    _cols = 80;
+    _good = true;
+}
+
 Term::~Term()
 {
-    if (!_good) return;
+    if (!_good || _headless) return;
 
     std::signal(SIGWINCH, SIG_DFL);
 
@@ -71,6 +91,7 @@ Term::~Term()
         flushwrite(
             //"\x1b[?1049l"   // use original buffer, restore cursor
             "\x1b[?7h"      // turn on wrapping
+            "\x1b[?2004l"   // turn off bracketed paste
             TermStyleReset  // reset style
         );
 
@@ -149,96 +170,232 @@ const char* Term::colorToStyle(const color &c, bool truecolor)
     return buf;
 }
 
-void Term::remainingInput(const std::string& s, std::size_t pos)
+void Term::readInput()
 {
-    _pending_input = s.substr(pos);
+    char buf[256];
+
+    if (_inputFD < 0) return;     // headless without input
+
+    bool waited = false;        // polled for the rest of a cut-off sequence
+    while (true) {
+        auto n = ::read(_inputFD, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            throw std::system_error(errno, std::generic_category(), "error in read");
+        }
+        if (n == 0) {
+            if (_state == InputState::Ground)
+                break;
+            // An escape sequence or paste was cut off. Wait briefly for the
+            // rest of it, otherwise take it as it is (e.g., a lone escape key).
+            // Nothing more to read after the poll said there was, or a hang
+            // up, means the input has ended.
+            struct pollfd pfd{_inputFD, POLLIN, 0};
+            int wait = _state == InputState::Paste ? PasteTimeout : EscapeTimeout;
+            if (!waited && ::poll(&pfd, 1, wait) > 0 && (pfd.revents & POLLIN) &&
+                !(pfd.revents & POLLHUP))
+            {
+                waited = true;
+                continue;
+            }
+            finishInput();
+            break;
+        }
+        waited = false;
+        if (inputTap)
+            inputTap(buf, (std::size_t)n);
+        for (ssize_t i = 0; i < n; ++i)
+            parseInput(buf[i]);
+    }
 }
 
-std::string Term::readInput()
+Term::Event& Term::pushEvent(EventType type)
 {
-    std::string o = std::move(_pending_input);
-    _pending_input.clear();
+    Event& ev = _events.emplace_back();
+    ev.type = type;
+    ev.character = '\0';
+    ev.key = Key::Up;
+    ev.shift = ev.alt = ev.control = ev.meta = false;
+    return ev;
+}
 
-    char c;
-    while (true) {
-        auto n = ::read(STDIN_FILENO, &c, 1);
-        if (n < 0) throw std::system_error(errno, std::generic_category(), "error in read");
-        if (n == 0) break;
-        o.push_back(c);
-    };
+void Term::parseInput(char c)
+{
+    switch (_state) {
+        case InputState::Ground:
+            if (c == '\x1b') {
+                _state = InputState::Escape;
+                _sequence.assign(1, c);
+            } else {
+                pushEvent(EventType::Char).character = c;
+            }
+            break;
+        case InputState::Escape:
+            if (c == '[' || c == 'O') {
+                _state = c == '[' ? InputState::CSI : InputState::SS3;
+                _sequence.push_back(c);
+            } else {
+                // ESC ESC is the escape key, ESC x is alt-x
+                Event& ev = pushEvent(EventType::Char);
+                ev.character = c;
+                ev.alt = c != '\x1b';
+                _state = InputState::Ground;
+            }
+            break;
+        case InputState::SS3: {
+            _sequence.push_back(c);
+            _state = InputState::Ground;
+            const char* keys = "ABCDHF";
+            if (const char* k = std::strchr(keys, c); k && c) {
+                pushEvent(EventType::Key).key = (Key)(k - keys);
+            } else {
+                pushEvent(EventType::UnknownEscapeSequence).unknown = _sequence;
+            }
+            break;
+        }
+        case InputState::CSI:
+            _sequence.push_back(c);
+            if (c >= '\x40' && c <= '\x7e') {
+                _state = InputState::Ground;
+                parseCSI();
+            } else if (c < '\x20' || c > '\x3f' || _sequence.length() > MaxSequence) {
+                _state = InputState::Ground;
+                pushEvent(EventType::UnknownEscapeSequence).unknown = _sequence;
+            }
+            break;
+        case InputState::Paste:
+            _sequence.push_back(c);
+            if (_sequence.ends_with(PasteEnd)) {
+                _sequence.resize(_sequence.length() - std::strlen(PasteEnd));
+                finishInput();
+            }
+            break;
+    }
+}
 
-    return o;
+// Finishes whatever was cut off at the end of the input
+void Term::finishInput()
+{
+    switch (_state) {
+        case InputState::Ground:
+            break;
+        case InputState::Escape:
+            pushEvent(EventType::Char).character = '\x1b';
+            break;
+        case InputState::SS3:
+        case InputState::CSI:
+            if (_sequence.length() == 2) {
+                Event& ev = pushEvent(EventType::Char);
+                ev.character = _sequence[1];
+                ev.alt = true;
+            } else {
+                pushEvent(EventType::UnknownEscapeSequence).unknown = _sequence;
+            }
+            break;
+        case InputState::Paste:
+            pushEvent(EventType::Paste).text = std::move(_sequence);
+            break;
+    }
+    _state = InputState::Ground;
+    _sequence.clear();
+}
+
+// Parses a complete ESC [ params final sequence. Cursor keys and the ~ keys
+// take an optional modifier parameter: 1 + (shift | alt<<1 | control<<2 | meta<<3)
+void Term::parseCSI()
+{
+    int params[2] = {0, 0};
+    int count = 0;
+    char final = _sequence.back();
+    for (std::size_t i = 2; i < _sequence.length() - 1; ++i) {
+        char c = _sequence[i];
+        if (c >= '0' && c <= '9' && count < 2) {
+            params[count] = params[count] * 10 + (c - '0');
+            if (params[count] > 9999) count = 3;
+        } else if (c == ';' && count < 1) {
+            ++count;
+        } else {
+            count = 3;      // private or unexpected parameters
+            break;
+        }
+    }
+
+    Key key;
+    bool known = count < 3;
+    switch (final) {
+        case 'A':   key = Key::Up;      break;
+        case 'B':   key = Key::Down;    break;
+        case 'C':   key = Key::Right;   break;
+        case 'D':   key = Key::Left;    break;
+        case 'H':   key = Key::Home;    break;
+        case 'F':   key = Key::End;     break;
+        case '~':
+            switch (params[0]) {
+                case 1: case 7:     key = Key::Home;        break;
+                case 4: case 8:     key = Key::End;         break;
+                case 2:             key = Key::Insert;      break;
+                case 3:             key = Key::Delete;      break;
+                case 5:             key = Key::PageUp;      break;
+                case 6:             key = Key::PageDown;    break;
+                case 200:
+                    if (count == 0) {
+                        _state = InputState::Paste;
+                        _sequence.clear();
+                        return;
+                    }
+                    known = false;
+                    break;
+                default:
+                    known = false;
+                    break;
+            }
+            break;
+        default:
+            known = false;
+            break;
+    }
+
+    if (!known) {
+        pushEvent(EventType::UnknownEscapeSequence).unknown = _sequence;
+        return;
+    }
+
+    Event& ev = pushEvent(EventType::Key);
+    ev.key = key;
+    if (int mods = params[1] - 1; count == 1 && mods > 0) {
+        ev.shift   = mods & 1;
+        ev.alt     = mods & 2;
+        ev.control = mods & 4;
+        ev.meta    = mods & 8;
+    }
 }
 
 bool Term::pendingEvent()
 {
-    return (!_pending_input.empty()) || pendingResize;
+    return (!_events.empty()) || pendingResize;
 }
 
 Term::Event Term::getEvent()
 {
-    Event ev;
-    ev.type = EventType::None;
-    ev.shift = ev.alt = ev.control = ev.meta = false;
-
     if (pendingResize) {
         pendingResize = false;
         fetchWindowSize();
+        Event ev{};
         ev.type = EventType::Resize;
         return ev;
     }
 
-    std::string s = readInput();
+    if (_events.empty())
+        readInput();
 
-    if (s.empty()) {
+    if (_events.empty()) {
+        Event ev{};
         ev.type = EventType::None;
         return ev;
     }
 
-    // We know: s.length() > 0
-    if (s.length() == 1 || s[0] != '\x1b') {
-        remainingInput(s, 1);
-        ev.type = EventType::Char;
-        ev.character = s[0];
-        return ev;
-    }
-
-    // We know: s.length() > 1 && s[0] == '\x1b'
-    if (s == "\x1b\x1b") {
-        remainingInput(s, 2);
-        ev.type = EventType::Char;
-        ev.character = '\x1b';
-        return ev;
-    };
-
-    // We know: s.length() > 1 && s[0] == '\x1b && s != "\x1b\x1b"
-    if (s.length() == 2 || s[1] != '[') {
-        remainingInput(s, 2);
-        ev.type = EventType::Char;
-        ev.alt = true;
-        ev.character = s[1];
-        return ev;
-    }
-
-    // We know: s.length() > 2 && s[0] == '\x1b && s[1] == '['
-    if (s.length() == 3) {
-        switch (s[2]) {
-            case 'A':   ev.key = Term::Key::Up;     break;
-            case 'B':   ev.key = Term::Key::Down;   break;
-            case 'C':   ev.key = Term::Key::Right;  break;
-            case 'D':   ev.key = Term::Key::Left;   break;
-            case 'H':   ev.key = Term::Key::Home;   break;
-            case 'F':   ev.key = Term::Key::End;    break;
-            default:
-                goto unknown;
-        }
-        ev.type = EventType::Key;
-        return ev;
-    }
-
-unknown:
-    ev.type = EventType::UnknownEscapeSequence;
-    ev.unknown = s;
+    Event ev = std::move(_events.front());
+    _events.pop_front();
     return ev;
 }
-
@@ -9,15 +9,22 @@
 
 #include <termios.h>
 #include <string>
+#include <deque>
+#include <functional>
 
 class color;
 
 class Term {
   public:
     Term(bool ansi = true);
+    Term(bool ansi, int inputFD);   // headless, reads input from inputFD, or none if -1
     ~Term();
 
     bool good() const { return _good; }
+    int inputFD() const { return _inputFD; }
+
+    // Sees every chunk of input as it is read
+    std::function<void(const char*, std::size_t)> inputTap;
 
     int rows() const { return _rows; };
     int cols() const { return _cols; };
@@ -25,6 +32,8 @@ class Term {
   private:
     bool _good;
     bool _ansiOK;
+    bool _headless = false;
+    int _inputFD;
 
     struct termios _original_termios;
 
@@ -53,6 +62,7 @@ class Term {
       Char,
       Key,
       Resize,
+      Paste,
       UnknownEscapeSequence,
     };
 
@@ -63,6 +73,10 @@ class Term {
       Left,
       Home,
       End,
+      Insert,
+      Delete,
+      PageUp,
+      PageDown,
     };
 
     struct Event {
@@ -77,15 +91,30 @@ class Term {
       bool meta;
 
       std::string unknown;
+      std::string text;     // text from Paste event
     };
 
     Event getEvent();
     bool pendingEvent();
 
   private:
-    std::string _pending_input;
-    void remainingInput(const std::string& s, std::size_t pos = 0);
-    std::string readInput();
+    enum class InputState {
+      Ground,
+      Escape,       // after ESC
+      CSI,          // after ESC [
+      SS3,          // after ESC O
+      Paste,        // between ESC [ 200 ~ and ESC [ 201 ~
+    };
+
+    InputState _state = InputState::Ground;
+    std::string _sequence;      // escape sequence or pasted text so far
+    std::deque<Event> _events;
+
+    void readInput();
+    void parseInput(char c);
+    void finishInput();
+    void parseCSI();
+    Event& pushEvent(EventType type);
 
     void fetchWindowSize();
 };
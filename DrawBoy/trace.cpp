@@ -0,0 +1,167 @@
+/*
+ *  trace.cpp
+ *  DrawBoy
+ */
+
+
+#include "trace.h"
+#include "argscommon.h"
+#include "startup.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <unistd.h>
+#include <vector>
+
+EventTrace eventTrace;
+
+namespace {
+struct Event {
+    const char* name;
+    const char* category;
+    char phase;                     // 'X' complete, 'i' instant, 'M' thread name
+    EventTrace::clock::time_point start;
+    EventTrace::clock::duration duration;
+    const char* argName;
+    int64_t arg;
+};
+
+// A thread's events. The lock is only ever contended while the trace is
+// being written.
+struct Buffer {
+    int tid;
+    std::mutex lock;
+    std::vector<Event> events;
+};
+
+std::mutex buffersLock;
+std::vector<std::unique_ptr<Buffer>> buffers;
+
+Buffer&
+threadBuffer()
+{
+    // Buffers are never freed, so that events from threads that have
+    // finished are still written
+    thread_local Buffer* mine = nullptr;
+    if (!mine) {
+        std::lock_guard<std::mutex> guard(buffersLock);
+        buffers.push_back(std::make_unique<Buffer>());
+        mine = buffers.back().get();
+        mine->tid = (int)buffers.size();
+        mine->events.reserve(4096);
+    }
+    return *mine;
+}
+
+// JSON string contents, for the names of commands and the like
+std::string
+escaped(const char* text)
+{
+    std::string out;
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\')
+            out.push_back('\\');
+        if ((unsigned char)*text < ' ')
+            continue;
+        out.push_back(*text);
+    }
+    return out;
+}
+}
+
+void
+EventTrace::open(const std::string& path)
+{
+    _file = std::fopen(path.c_str(), "w");
+    if (!_file)
+        throw make_system_error("Cannot open trace file");
+    _enabled = true;
+    threadName("driver");
+}
+
+void
+EventTrace::append(const char* name, const char* category, char phase, clock::time_point start,
+                   clock::duration duration, const char* argName, int64_t arg)
+{
+    Buffer& buf = threadBuffer();
+    std::lock_guard<std::mutex> guard(buf.lock);
+    buf.events.push_back({name, category, phase, start, duration, argName, arg});
+}
+
+void
+EventTrace::complete(const char* name, const char* category, clock::time_point start,
+                     clock::time_point end, const char* argName, int64_t arg)
+{
+    if (enabled())
+        append(name, category, 'X', start, end - start, argName, arg);
+}
+
+void
+EventTrace::instant(const char* name, const char* category, const char* argName, int64_t arg)
+{
+    if (enabled())
+        append(name, category, 'i', clock::now(), {}, argName, arg);
+}
+
+void
+EventTrace::threadName(const char* name)
+{
+    if (enabled())
+        append(name, "", 'M', {}, {}, nullptr, 0);
+}
+
+void
+EventTrace::write()
+{
+    if (!enabled())
+        return;
+    _enabled = false;
+
+    auto& phases = startupProfile.phases();
+    if (!phases.empty())
+        _origin = std::min(_origin, phases.front().start);
+    int pid = (int)::getpid();
+    auto micros = [this](clock::time_point t) {
+        return std::chrono::duration<double, std::micro>(t - _origin).count();
+    };
+
+    std::print(_file, "{{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char* sep = "";
+    for (auto& p: phases) {
+        std::print(_file, "{}{{\"name\": \"{}\", \"cat\": \"startup\", \"ph\": \"X\", \"ts\": {:.3f}, "
+                   "\"dur\": {:.3f}, \"pid\": {}, \"tid\": 1}}",
+                   sep, p.name, micros(p.start), p.wallMillis * 1000.0, pid);
+        sep = ",\n";
+    }
+
+    std::lock_guard<std::mutex> guard(buffersLock);
+    for (auto& buf: buffers) {
+        std::lock_guard<std::mutex> bufGuard(buf->lock);
+        for (auto& ev: buf->events) {
+            if (ev.phase == 'M') {
+                std::print(_file, "{}{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": {}, "
+                           "\"tid\": {}, \"args\": {{\"name\": \"{}\"}}}}",
+                           sep, pid, buf->tid, escaped(ev.name));
+                sep = ",\n";
+                continue;
+            }
+            std::print(_file, "{}{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"{}\", \"ts\": {:.3f}, ",
+                       sep, escaped(ev.name), ev.category, ev.phase, micros(ev.start));
+            if (ev.phase == 'X')
+                std::print(_file, "\"dur\": {:.3f}, ",
+                           std::chrono::duration<double, std::micro>(ev.duration).count());
+            else
+                std::print(_file, "\"s\": \"t\", ");
+            std::print(_file, "\"pid\": {}, \"tid\": {}", pid, buf->tid);
+            if (ev.argName)
+                std::print(_file, ", \"args\": {{\"{}\": {}}}", ev.argName, ev.arg);
+            std::print(_file, "}}");
+            sep = ",\n";
+        }
+        buf->events.clear();
+    }
+    std::print(_file, "\n]}}\n");
+    std::fclose(_file);
+    _file = nullptr;
+}
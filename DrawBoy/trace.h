@@ -0,0 +1,73 @@
+/*
+ *  trace.h
+ *  DrawBoy
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Records a timeline of driver activity and writes it in the Chrome
+// trace-event format, for viewing in Perfetto or chrome://tracing. Each
+// thread appends to its own buffer, so recording an event costs a clock read
+// and an uncontended lock. Nothing is recorded until a trace file is opened.
+class EventTrace {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    void open(const std::string& path);
+    bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+    // Names must be string literals, or otherwise outlive the trace
+    void complete(const char* name, const char* category, clock::time_point start,
+                  clock::time_point end, const char* argName = nullptr, int64_t arg = 0);
+    void instant(const char* name, const char* category, const char* argName = nullptr,
+                 int64_t arg = 0);
+    void threadName(const char* name);
+
+    // Writes every buffered event, including the startup phases, and closes
+    // the trace file
+    void write();
+
+  private:
+    void append(const char* name, const char* category, char phase, clock::time_point start,
+                clock::duration duration, const char* argName, int64_t arg);
+
+    std::atomic<bool> _enabled{false};
+    std::FILE* _file = nullptr;
+    clock::time_point _origin = clock::now();
+};
+
+extern EventTrace eventTrace;
+
+// Records a complete event spanning its own lifetime
+class TraceScope {
+  public:
+    TraceScope(const char* name, const char* category, const char* argName = nullptr,
+               int64_t arg = 0)
+    : _name(eventTrace.enabled() ? name : nullptr), _category(category), _argName(argName),
+      _arg(arg)
+    {
+        if (_name)
+            _start = EventTrace::clock::now();
+    }
+    ~TraceScope()
+    {
+        if (_name)
+            eventTrace.complete(_name, _category, _start, EventTrace::clock::now(), _argName, _arg);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+  private:
+    const char* _name;
+    const char* _category;
+    const char* _argName;
+    int64_t _arg;
+    EventTrace::clock::time_point _start;
+};
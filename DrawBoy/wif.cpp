@@ -94,7 +94,7 @@ namespace  {
 
 }
 
-wif::wif(std::ifstream& _wifstream)
+wif::wif(std::istream& _wifstream)
 : wifstream(_wifstream)
 {
     if (!seekSection("WIF"))
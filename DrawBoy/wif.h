@@ -11,7 +11,7 @@
 
 class wif : public draft {
 public:
-    wif(std::ifstream& _wifstream);
+    wif(std::istream& _wifstream);
     
 private:
     bool seekSection(const char* name);
@@ -21,7 +21,7 @@ private:
     std::vector<color> processColorLines(const std::vector<color>& palette, size_t def);
 
     std::vector<std::string>   treadling;
-    std::ifstream& wifstream;
+    std::istream& wifstream;
     std::map<std::string, std::string> nameKeys;
     std::vector<std::string> numberKeys;
 };